@@ -0,0 +1,210 @@
+#include "device_json_stream.h"
+#include <algorithm>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Запись строки в JSON с экранированием
+static size_t appendJsonString(char *buffer, size_t size, size_t pos, const char *text)
+{
+    if (pos < size)
+    {
+        buffer[pos] = '"';
+    }
+    pos++;
+    for (const char *c = text; *c != '\0'; c++)
+    {
+        char escaped[7];
+        size_t length = 1;
+        escaped[0] = *c;
+        if (*c == '"' || *c == '\\')
+        {
+            escaped[0] = '\\';
+            escaped[1] = *c;
+            length = 2;
+        }
+        else if ((uint8_t)*c < 0x20)
+        {
+            length = snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8_t)*c);
+        }
+        if (pos + length < size)
+        {
+            memcpy(buffer + pos, escaped, length);
+        }
+        pos += length;
+    }
+    if (pos < size)
+    {
+        buffer[pos] = '"';
+    }
+    return pos + 1;
+}
+
+// snprintf с накоплением позиции; при переполнении позиция уходит за size
+static size_t appendFormat(char *buffer, size_t size, size_t pos, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(pos < size ? buffer + pos : nullptr, pos < size ? size - pos : 0, format, args);
+    va_end(args);
+    return pos + (written > 0 ? written : 0);
+}
+
+size_t formatClientJson(const DeviceSnapshotEntry &device, char *buffer, size_t size)
+{
+    char mac[MAC_ADDRESS_TEXT_SIZE];
+    formatMacAddress(device.mac, mac);
+    size_t pos = appendFormat(buffer, size, 0, "{\"name\":");
+    pos = appendJsonString(buffer, size, pos, device.name);
+    pos = appendFormat(buffer, size, pos,
+                       ",\"macAddress\":\"%s\",\"currentTemperature\":%.2f,\"targetTemperature\":%.2f,"
+                       "\"enabled\":%s,\"isOnline\":%s,\"heatingActive\":%s,\"controller\":\"%s\",\"humidity\":%.2f,"
+                       "\"battery\":%u,\"batteryV\":%u,\"lastUpdate\":%lu,\"totalHeatingTime\":%lu,\"gpioPins\":[",
+                       mac, device.currentTemperature, device.targetTemperature,
+                       device.enabled ? "true" : "false", device.isOnline ? "true" : "false",
+                       device.heatingActive ? "true" : "false", heatingControllerName(device.controllerType), device.humidity,
+                       device.battery, device.batteryV, device.lastUpdate, device.totalHeatingTime);
+    for (uint8_t i = 0; i < device.gpioCount; i++)
+    {
+        pos = appendFormat(buffer, size, pos, i == 0 ? "%u" : ",%u", device.gpioPins[i]);
+    }
+    pos = appendFormat(buffer, size, pos, "]}");
+    return pos < size ? pos : 0;
+}
+
+size_t formatHeatingStatsJson(const DeviceSnapshotEntry &device, char *buffer, size_t size)
+{
+    char mac[MAC_ADDRESS_TEXT_SIZE];
+    char heatingTime[HEATING_TIME_TEXT_SIZE];
+    formatMacAddress(device.mac, mac);
+    formatHeatingTime(device.totalHeatingTime, heatingTime, sizeof(heatingTime));
+    size_t pos = appendFormat(buffer, size, 0, "{\"name\":");
+    pos = appendJsonString(buffer, size, pos, device.name);
+    pos = appendFormat(buffer, size, pos,
+                       ",\"macAddress\":\"%s\",\"currentTemperature\":%.2f,\"targetTemperature\":%.2f,"
+                       "\"heatingActive\":%s,\"totalHeatingTimeMs\":%lu,\"totalHeatingTimeFormatted\":\"%s\"}",
+                       mac, device.currentTemperature, device.targetTemperature,
+                       device.heatingActive ? "true" : "false", device.totalHeatingTime,
+                       heatingTime);
+    return pos < size ? pos : 0;
+}
+
+size_t formatStateEventJson(const DeviceSnapshotEntry &device, char *buffer, size_t size)
+{
+    char mac[MAC_ADDRESS_TEXT_SIZE];
+    char heatingTime[HEATING_TIME_TEXT_SIZE];
+    formatMacAddress(device.mac, mac);
+    formatHeatingTime(device.totalHeatingTime, heatingTime, sizeof(heatingTime));
+    size_t pos = appendFormat(buffer, size, 0, "{\"seq\":%lu,\"name\":", (unsigned long)device.changeSeq);
+    pos = appendJsonString(buffer, size, pos, device.name);
+    pos = appendFormat(buffer, size, pos,
+                       ",\"macAddress\":\"%s\",\"currentTemperature\":%.2f,\"targetTemperature\":%.2f,"
+                       "\"humidity\":%.2f,\"battery\":%u,\"batteryV\":%u,\"enabled\":%s,\"isOnline\":%s,"
+                       "\"heatingActive\":%s,\"lastUpdate\":%lu,\"totalHeatingTimeMs\":%lu,\"totalHeatingTimeFormatted\":\"%s\"}",
+                       mac, device.currentTemperature, device.targetTemperature,
+                       device.humidity, device.battery, device.batteryV,
+                       device.enabled ? "true" : "false", device.isOnline ? "true" : "false",
+                       device.heatingActive ? "true" : "false", device.lastUpdate, device.totalHeatingTime,
+                       heatingTime);
+    return pos < size ? pos : 0;
+}
+
+// DeviceJsonStream +++++++++++++++++++++++++++
+bool deviceSnapshotNeedsFull(const DeviceSnapshot *snapshot, uint32_t sinceSeq)
+{
+    // sinceSeq больше текущего - номер из прошлой загрузки контроллера
+    return snapshot == nullptr || sinceSeq == 0 || sinceSeq > snapshot->changeSeq || snapshot->removedSeq > sinceSeq;
+}
+
+DeviceJsonStream::DeviceJsonStream(DeviceSnapshotStore &store, DeviceJsonFormatter formatter, bool delta, uint32_t sinceSeq) : store(store),
+                                                                    formatter(formatter),
+                                                                    snapshot(store.acquire()),
+                                                                    delta(delta),
+                                                                    full(!delta || deviceSnapshotNeedsFull(snapshot, sinceSeq)),
+                                                                    sinceSeq(sinceSeq),
+                                                                    firstRecord(true),
+                                                                    stage(STREAM_OPEN),
+                                                                    nextDevice(0),
+                                                                    recordLength(0),
+                                                                    recordOffset(0)
+{
+}
+
+DeviceJsonStream::~DeviceJsonStream()
+{
+    store.release(snapshot);
+}
+
+// Подготовка следующего фрагмента в record, false - данных больше нет
+bool DeviceJsonStream::formatNext()
+{
+    recordOffset = 0;
+    recordLength = 0;
+    size_t count = snapshot != nullptr ? snapshot->count : 0;
+    switch (stage)
+    {
+    case STREAM_OPEN:
+        if (delta)
+        {
+            recordLength = snprintf(record, sizeof(record), "{\"seq\":%lu,\"full\":%s,\"devices\":[",
+                                    (unsigned long)(snapshot != nullptr ? snapshot->changeSeq : 0), full ? "true" : "false");
+        }
+        else
+        {
+            record[recordLength++] = '[';
+        }
+        stage = STREAM_RECORDS;
+        return true;
+    case STREAM_RECORDS:
+        while (nextDevice < count && recordLength == 0)
+        {
+            const DeviceSnapshotEntry &device = snapshot->entries[nextDevice++];
+            if (!full && device.changeSeq <= sinceSeq)
+            {
+                continue;
+            }
+            size_t prefix = firstRecord ? 0 : 1;
+            size_t length = formatter(device, record + prefix, sizeof(record) - prefix);
+            if (length > 0)
+            {
+                record[0] = prefix ? ',' : record[0];
+                recordLength = prefix + length;
+                firstRecord = false;
+            }
+        }
+        if (recordLength > 0)
+        {
+            return true;
+        }
+        stage = STREAM_CLOSE;
+        return formatNext();
+    case STREAM_CLOSE:
+        record[recordLength++] = ']';
+        if (delta)
+        {
+            record[recordLength++] = '}';
+        }
+        stage = STREAM_DONE;
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t DeviceJsonStream::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (recordOffset >= recordLength && !formatNext())
+        {
+            break;
+        }
+        size_t chunk = std::min(recordLength - recordOffset, maxLen - written);
+        memcpy(buffer + written, record + recordOffset, chunk);
+        recordOffset += chunk;
+        written += chunk;
+    }
+    return written;
+}
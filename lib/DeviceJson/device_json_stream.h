@@ -0,0 +1,65 @@
+#ifndef DEVICE_JSON_STREAM_H
+#define DEVICE_JSON_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <device_snapshot.h>
+
+// JSON-записи устройств из снимка без выделения памяти на запись (без Arduino, проверяется в test/)
+
+#define DEVICE_JSON_RECORD_MAX (512 + 6 * DEVICE_NAME_MAX) // Буфер для одной JSON-записи устройства: имя с экранированием \uXXXX каждого байта (байт)
+
+// Форматирование одной записи устройства в JSON, возвращает длину записи (0 - не поместилась)
+typedef size_t (*DeviceJsonFormatter)(const DeviceSnapshotEntry &device, char *buffer, size_t size);
+
+// Запись для /clients
+size_t formatClientJson(const DeviceSnapshotEntry &device, char *buffer, size_t size);
+// Запись для /heating_stats
+size_t formatHeatingStatsJson(const DeviceSnapshotEntry &device, char *buffer, size_t size);
+// Компактная запись для /state_events: текущее состояние без настроек GPIO
+size_t formatStateEventJson(const DeviceSnapshotEntry &device, char *buffer, size_t size);
+
+// Потоковая выдача JSON-массива устройств из снимка.
+// Записи форматируются по одной прямо в буфер TCP, поэтому память на запрос не зависит от числа устройств.
+// В режиме дельты (delta = true) выдается объект {"seq":N,"full":bool,"devices":[...]} только с устройствами,
+// изменившимися после sinceSeq (или всеми, если после sinceSeq устройства удалялись)
+class DeviceJsonStream
+{
+public:
+    DeviceJsonStream(DeviceSnapshotStore &store, DeviceJsonFormatter formatter, bool delta = false, uint32_t sinceSeq = 0);
+    ~DeviceJsonStream();
+
+    // Заполнение очередного фрагмента chunked-ответа, 0 - ответ завершен
+    size_t fill(uint8_t *buffer, size_t maxLen);
+    // Номер изменения выдаваемого снимка
+    uint32_t changeSeq() const { return snapshot != nullptr ? snapshot->changeSeq : 0; }
+
+private:
+    bool formatNext();
+
+    enum Stage
+    {
+        STREAM_OPEN,
+        STREAM_RECORDS,
+        STREAM_CLOSE,
+        STREAM_DONE
+    };
+
+    DeviceSnapshotStore &store;
+    DeviceJsonFormatter formatter;
+    const DeviceSnapshot *snapshot;
+    bool delta;
+    bool full;
+    uint32_t sinceSeq;
+    bool firstRecord;
+    Stage stage;
+    size_t nextDevice;
+    char record[DEVICE_JSON_RECORD_MAX];
+    size_t recordLength;
+    size_t recordOffset;
+};
+
+// Нужен ли клиенту, знающему состояние на sinceSeq, полный список устройств
+bool deviceSnapshotNeedsFull(const DeviceSnapshot *snapshot, uint32_t sinceSeq);
+
+#endif
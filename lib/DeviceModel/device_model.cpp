@@ -0,0 +1,132 @@
+#include "device_model.h"
+#include <stdio.h>
+#include <string.h>
+
+bool parseMacAddress(const char *text, uint64_t &mac)
+{
+    unsigned int b[6];
+    char tail;
+    if (text == nullptr ||
+        sscanf(text, "%2x:%2x:%2x:%2x:%2x:%2x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &tail) != 6)
+    {
+        return false;
+    }
+    uint8_t bytes[6];
+    for (int i = 0; i < 6; i++)
+    {
+        bytes[i] = (uint8_t)b[i];
+    }
+    mac = macFromBytes(bytes);
+    return true;
+}
+
+void formatMacAddress(uint64_t mac, char *text)
+{
+    snprintf(text, MAC_ADDRESS_TEXT_SIZE, "%02x:%02x:%02x:%02x:%02x:%02x",
+             (uint8_t)(mac >> 40), (uint8_t)(mac >> 32), (uint8_t)(mac >> 24),
+             (uint8_t)(mac >> 16), (uint8_t)(mac >> 8), (uint8_t)mac);
+}
+
+std::string formatMacAddress(uint64_t mac)
+{
+    char buffer[MAC_ADDRESS_TEXT_SIZE];
+    formatMacAddress(mac, buffer);
+    return std::string(buffer);
+}
+
+void formatHeatingTime(unsigned long timeInMillis, char *buffer, size_t size)
+{
+    unsigned long totalSeconds = timeInMillis / 1000;
+    unsigned long days = totalSeconds / 86400;
+    unsigned long hours = (totalSeconds % 86400) / 3600;
+    unsigned long minutes = (totalSeconds % 3600) / 60;
+    unsigned long seconds = totalSeconds % 60;
+    snprintf(buffer, size, "%lud %02lu:%02lu:%02lu", days, hours, minutes, seconds);
+}
+
+// DeviceRegistry +++++++++++++++++++++++++++
+DeviceRegistry::DeviceRegistry() : changeSeq(0), removedSeq(0)
+{
+    // Резервируем память заранее, чтобы указатели на устройства не менялись при добавлении
+    items.reserve(DEVICE_REGISTRY_CAPACITY);
+    memset(index, 0, sizeof(index));
+}
+
+size_t DeviceRegistry::hashSlot(uint64_t mac)
+{
+    // Мультипликативный хеш: младшие байты MAC (часть NIC) перемешиваются в старшие биты
+    return (size_t)((mac * 0x9E3779B97F4A7C15ULL) >> 32) & (DEVICE_REGISTRY_INDEX_SIZE - 1);
+}
+
+void DeviceRegistry::insertIndex(uint64_t mac, size_t position)
+{
+    size_t slot = hashSlot(mac);
+    while (index[slot] != 0)
+    {
+        slot = (slot + 1) & (DEVICE_REGISTRY_INDEX_SIZE - 1);
+    }
+    index[slot] = (uint8_t)(position + 1);
+}
+
+void DeviceRegistry::rebuildIndex()
+{
+    memset(index, 0, sizeof(index));
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        insertIndex(items[i].mac, i);
+    }
+}
+
+int DeviceRegistry::indexOf(uint64_t mac) const
+{
+    size_t slot = hashSlot(mac);
+    while (index[slot] != 0)
+    {
+        size_t position = index[slot] - 1;
+        if (items[position].mac == mac)
+        {
+            return (int)position;
+        }
+        slot = (slot + 1) & (DEVICE_REGISTRY_INDEX_SIZE - 1);
+    }
+    return -1;
+}
+
+DeviceData *DeviceRegistry::find(uint64_t mac)
+{
+    int position = indexOf(mac);
+    return position < 0 ? nullptr : &items[position];
+}
+
+DeviceData *DeviceRegistry::add(const DeviceData &device)
+{
+    if (items.size() >= DEVICE_REGISTRY_CAPACITY || indexOf(device.mac) >= 0)
+    {
+        return nullptr;
+    }
+    items.push_back(device);
+    insertIndex(device.mac, items.size() - 1);
+    touch(items.back());
+    return &items.back();
+}
+
+bool DeviceRegistry::remove(uint64_t mac)
+{
+    int position = indexOf(mac);
+    if (position < 0)
+    {
+        return false;
+    }
+    items.erase(items.begin() + position);
+    removedSeq = ++changeSeq;
+    // Удаление редкое, проще пересобрать индекс, чем поддерживать надгробия
+    rebuildIndex();
+    return true;
+}
+
+void DeviceRegistry::clear()
+{
+    items.clear();
+    memset(index, 0, sizeof(index));
+    removedSeq = ++changeSeq;
+}
@@ -0,0 +1,174 @@
+#ifndef DEVICE_MODEL_H
+#define DEVICE_MODEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <heating_controller.h>
+
+// Таблица устройств и настройки GPIO без зависимостей от железа: время передается параметром
+
+#define XIAOMI_OFFLINE_TIMEOUT 300000 // 5 минут до перехода в оффлайн
+#define DEVICE_REGISTRY_CAPACITY 64    // Максимальное количество устройств
+#define DEVICE_REGISTRY_INDEX_SIZE 128 // Размер хеш-индекса по MAC (степень двойки, не меньше 2 * емкости)
+#define DEVICE_NAME_MAX 255            // Максимальная длина имени устройства (байт UTF-8), столько хранит blob NVS
+#define MAC_ADDRESS_TEXT_SIZE 18       // "aa:bb:cc:dd:ee:ff" с завершающим нулем
+#define HEATING_TIME_TEXT_SIZE 30      // Время работы обогрева "1d 02:03:04" с завершающим нулем
+
+// Упаковка 6-байтового MAC-адреса (в порядке отображения) в 48-битный ключ
+inline uint64_t macFromBytes(const uint8_t *mac)
+{
+    return ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) | ((uint64_t)mac[2] << 24) |
+           ((uint64_t)mac[3] << 16) | ((uint64_t)mac[4] << 8) | (uint64_t)mac[5];
+}
+
+// Разбор MAC-адреса вида "aa:bb:cc:dd:ee:ff" в 48-битный ключ
+bool parseMacAddress(const char *text, uint64_t &mac);
+
+// Форматирование 48-битного ключа в строку вида "aa:bb:cc:dd:ee:ff"
+std::string formatMacAddress(uint64_t mac);
+// То же в буфер text размером не меньше MAC_ADDRESS_TEXT_SIZE, без выделения памяти
+void formatMacAddress(uint64_t mac, char *text);
+
+// Время работы обогрева в виде "1d 02:03:04" в буфер размером size (HEATING_TIME_TEXT_SIZE достаточно)
+void formatHeatingTime(unsigned long timeInMillis, char *buffer, size_t size);
+
+// Объединенная структура данных для клиента/датчика
+struct DeviceData
+{
+    std::string name;               // Имя устройства
+    std::string macAddress;         // MAC-адрес датчика (текстовый, для отображения)
+    uint64_t mac = 0;               // MAC-адрес датчика (48-битный ключ)
+    float targetTemperature = 25.0; // Целевая температура
+    float currentTemperature = 0.0; // Текущая температура
+    float humidity = 0.0;           // Влажность
+    uint8_t battery = 0;            // Уровень заряда батареи
+    bool enabled = true;            // Включено ли устройство
+    bool isOnline = false;          // Находится ли устройство в сети
+    unsigned long lastUpdate = 0;   // Время последнего обновления данных
+    std::vector<uint8_t> gpioPins;  // Пины GPIO для управления
+    bool heatingActive = false;     // Добавляем поле для отслеживания текущего состояния обогрева
+    unsigned long heatingStartTime; // Время последнего включения обогрева
+    unsigned long totalHeatingTime; // Общее время работы обогрева в миллисекундах
+    uint16_t batteryV = 0;
+    uint32_t changeSeq = 0;         // Номер последнего изменения (см. DeviceRegistry::touch)
+    uint8_t persistDirty = 0;       // Несохраненные изменения, флаги PERSIST_DIRTY_*
+    bool controlPending = false;    // Устройство ждет пересчета в задаче управления (см. heating_control.h)
+    uint64_t demandMask = 0;        // Пины, которые устройство сейчас требует включить (учтены в счетчиках спроса)
+    uint8_t controllerType = CONTROLLER_HYSTERESIS; // Алгоритм управления обогревом (см. heating_controller.h)
+    HeatingControllerState controllerState = {};    // Состояние алгоритма и изученная модель помещения
+    // Конструктор по умолчанию
+    DeviceData() : name(""),
+                   macAddress(""),
+                   currentTemperature(25.0),
+                   humidity(0.0),
+                   battery(0),
+                   batteryV(0),
+                   lastUpdate(0),
+                   isOnline(false),
+                   targetTemperature(25.0),
+                   enabled(false),
+                   heatingStartTime(0),
+                   totalHeatingTime(0) {}
+
+    // Конструктор с основными параметрами
+    DeviceData(const std::string &_name, uint64_t _mac) : name(_name),
+                                                                    macAddress(formatMacAddress(_mac)),
+                                                                    mac(_mac),
+                                                                    currentTemperature(25.0),
+                                                                    humidity(0.0),
+                                                                    battery(0),
+                                                                    batteryV(0),
+                                                                    lastUpdate(0),
+                                                                    isOnline(true),
+                                                                    targetTemperature(25.0),
+                                                                    enabled(false),
+                                                                    heatingStartTime(0),
+                                                                    totalHeatingTime(0) {}
+
+    // Метод для обновления данных датчика на момент now, возвращает true если показания или статус изменились
+    bool updateSensorData(float temp, float hum, uint8_t bat, uint16_t batV, unsigned long now)
+    {
+        bool changed = !isOnline || currentTemperature != temp || humidity != hum ||
+                       battery != bat || batteryV != batV;
+        currentTemperature = temp;
+        humidity = hum;
+        battery = bat;
+        lastUpdate = now;
+        isOnline = true;
+        batteryV = batV;
+        return changed;
+    }
+
+    // Метод для проверки актуальности данных на момент now
+    bool isDataValid(unsigned long now, unsigned long timeout = XIAOMI_OFFLINE_TIMEOUT) const
+    {
+        return isOnline && (now - lastUpdate < timeout);
+    }
+};
+
+enum stateGpioPin : uint8_t
+{
+    STATE_GPIO_AUTO,
+    STATE_GPIO_ON,
+    STATE_GPIO_OFF
+};
+
+struct GpioPin
+{
+    uint8_t pin;
+    uint8_t state; // 0-авто, 1-вкл 2-выкл
+    std::string name;
+    unsigned long totalHeatingTime; // Общее время работы обогрева в миллисекундах
+    bool outputActive = false;      // Текущий уровень выхода (установлен задачей управления)
+    GpioPin() : pin(0),
+                state(STATE_GPIO_AUTO),
+                name(""),
+                totalHeatingTime(0) {}
+    GpioPin(uint8_t p, uint8_t s, const std::string &n) : pin(p), state(s), name(n), totalHeatingTime(0) {}
+};
+// Реестр устройств с индексом по 48-битному MAC-адресу (открытая адресация)
+class DeviceRegistry
+{
+public:
+    DeviceRegistry();
+
+    // Поиск устройства по MAC-адресу, nullptr если не найдено
+    DeviceData *find(uint64_t mac);
+    // Позиция устройства в списке, -1 если не найдено
+    int indexOf(uint64_t mac) const;
+    // Добавление устройства, nullptr если реестр заполнен или MAC уже есть
+    DeviceData *add(const DeviceData &device);
+    // Удаление устройства по MAC-адресу
+    bool remove(uint64_t mac);
+    void clear();
+
+    // Отметка изменения устройства: присваивает ему следующий номер изменения
+    void touch(DeviceData &device) { device.changeSeq = ++changeSeq; }
+    // Номер последнего изменения таблицы
+    uint32_t currentSeq() const { return changeSeq; }
+    // Номер последнего удаления устройств (после него клиенту нужен полный список)
+    uint32_t lastRemovalSeq() const { return removedSeq; }
+
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    DeviceData &operator[](size_t i) { return items[i]; }
+    const DeviceData &operator[](size_t i) const { return items[i]; }
+    std::vector<DeviceData>::iterator begin() { return items.begin(); }
+    std::vector<DeviceData>::iterator end() { return items.end(); }
+    std::vector<DeviceData>::const_iterator begin() const { return items.begin(); }
+    std::vector<DeviceData>::const_iterator end() const { return items.end(); }
+
+private:
+    static size_t hashSlot(uint64_t mac);
+    void insertIndex(uint64_t mac, size_t position);
+    void rebuildIndex();
+
+    std::vector<DeviceData> items;
+    uint8_t index[DEVICE_REGISTRY_INDEX_SIZE]; // Позиция в items + 1, 0 - пустая ячейка
+    uint32_t changeSeq;
+    uint32_t removedSeq;
+};
+
+#endif
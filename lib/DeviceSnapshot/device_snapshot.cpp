@@ -0,0 +1,144 @@
+#include "device_snapshot.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+static void *allocateZeroed(size_t size)
+{
+    return calloc(1, size);
+}
+
+DeviceSnapshotStore::DeviceSnapshotStore() : current(-1), version(0), notifiedSeq(0), listener(nullptr), retry(nullptr), pending(false)
+{
+    for (int i = 0; i < DEVICE_SNAPSHOT_BUFFERS; i++)
+    {
+        buffers[i] = nullptr;
+        refs[i] = 0;
+    }
+}
+
+bool DeviceSnapshotStore::begin(DeviceSnapshotAllocator allocate)
+{
+    if (allocate == nullptr)
+    {
+        allocate = allocateZeroed;
+    }
+    for (int i = 0; i < DEVICE_SNAPSHOT_BUFFERS; i++)
+    {
+        if (buffers[i] == nullptr)
+        {
+            buffers[i] = (DeviceSnapshot *)allocate(sizeof(DeviceSnapshot));
+            if (buffers[i] == nullptr)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Копирование строки с обрезкой по границе символа UTF-8
+static void copyUtf8(char *destination, size_t capacity, const std::string &source)
+{
+    size_t length = std::min(source.length(), capacity - 1);
+    while (length > 0 && length < source.length() && (source[length] & 0xC0) == 0x80)
+    {
+        length--;
+    }
+    memcpy(destination, source.data(), length);
+    destination[length] = '\0';
+}
+
+void DeviceSnapshotStore::publish(const DeviceRegistry &registry)
+{
+    int published = current.load();
+    int target = -1;
+    for (int i = 0; i < DEVICE_SNAPSHOT_BUFFERS && target < 0; i++)
+    {
+        if (i != published && buffers[i] != nullptr && refs[i].load() == 0)
+        {
+            target = i;
+        }
+    }
+    // Все буферы заняты читателями - публикацию повторит release(), освободивший буфер
+    if (target < 0)
+    {
+        pending = true;
+        return;
+    }
+    pending = false;
+
+    DeviceSnapshot *snapshot = buffers[target];
+    snapshot->count = std::min(registry.size(), (size_t)DEVICE_REGISTRY_CAPACITY);
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        const DeviceData &device = registry[i];
+        DeviceSnapshotEntry &entry = snapshot->entries[i];
+        entry.mac = device.mac;
+        copyUtf8(entry.name, sizeof(entry.name), device.name);
+        entry.targetTemperature = device.targetTemperature;
+        entry.currentTemperature = device.currentTemperature;
+        entry.humidity = device.humidity;
+        entry.battery = device.battery;
+        entry.batteryV = device.batteryV;
+        entry.enabled = device.enabled;
+        entry.isOnline = device.isOnline;
+        entry.heatingActive = device.heatingActive;
+        entry.controllerType = device.controllerType;
+        entry.lastUpdate = device.lastUpdate;
+        entry.totalHeatingTime = device.totalHeatingTime;
+        entry.gpioCount = (uint8_t)std::min(device.gpioPins.size(), (size_t)DEVICE_SNAPSHOT_GPIO_MAX);
+        memcpy(entry.gpioPins, device.gpioPins.data(), entry.gpioCount);
+        entry.changeSeq = device.changeSeq;
+    }
+    snapshot->changeSeq = registry.currentSeq();
+    snapshot->removedSeq = registry.lastRemovalSeq();
+    snapshot->version = ++version;
+    current.store(target);
+
+    if (listener != nullptr && snapshot->changeSeq != notifiedSeq)
+    {
+        notifiedSeq = snapshot->changeSeq;
+        listener();
+    }
+}
+
+const DeviceSnapshot *DeviceSnapshotStore::acquire()
+{
+    for (;;)
+    {
+        int index = current.load();
+        if (index < 0)
+        {
+            return nullptr;
+        }
+        refs[index]++;
+        // Буфер мог быть заменен и отдан писателю между чтением индекса и увеличением счетчика
+        if (current.load() == index)
+        {
+            return buffers[index];
+        }
+        refs[index]--;
+    }
+}
+
+void DeviceSnapshotStore::release(const DeviceSnapshot *snapshot)
+{
+    if (snapshot == nullptr)
+    {
+        return;
+    }
+    for (int i = 0; i < DEVICE_SNAPSHOT_BUFFERS; i++)
+    {
+        if (buffers[i] == snapshot)
+        {
+            refs[i]--;
+            break;
+        }
+    }
+    // Иначе изменения (и уведомление listener) ждали бы следующего, не связанного с ними изменения таблицы
+    if (pending.load() && retry != nullptr)
+    {
+        retry();
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef DEVICE_SNAPSHOT_H
+#define DEVICE_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <device_model.h>
+
+// Снимок таблицы устройств для читателей (HTTP, LCD) без зависимостей от железа
+
+#define DEVICE_SNAPSHOT_NAME_MAX (DEVICE_NAME_MAX + 1) // Имя в снимке целиком: /clients отдает его в форму правки
+#define DEVICE_SNAPSHOT_GPIO_MAX 16    // Максимальное количество GPIO устройства в снимке
+#define DEVICE_SNAPSHOT_BUFFERS 3      // Количество буферов снимка (опубликованный, удерживаемый читателем, заполняемый)
+
+// Состояние устройства в снимке (POD, без динамической памяти)
+struct DeviceSnapshotEntry
+{
+    uint64_t mac;
+    char name[DEVICE_SNAPSHOT_NAME_MAX];
+    float targetTemperature;
+    float currentTemperature;
+    float humidity;
+    uint8_t battery;
+    uint16_t batteryV;
+    bool enabled;
+    bool isOnline;
+    bool heatingActive;
+    uint8_t controllerType;
+    unsigned long lastUpdate;
+    unsigned long totalHeatingTime;
+    uint8_t gpioCount;
+    uint8_t gpioPins[DEVICE_SNAPSHOT_GPIO_MAX];
+    uint32_t changeSeq;
+
+    // Актуальность показаний на момент now (как DeviceData::isDataValid)
+    bool isDataValid(unsigned long now, unsigned long timeout = XIAOMI_OFFLINE_TIMEOUT) const
+    {
+        return isOnline && (now - lastUpdate < timeout);
+    }
+};
+
+// Неизменяемый снимок таблицы устройств
+struct DeviceSnapshot
+{
+    uint32_t version;    // Номер публикации
+    uint32_t changeSeq;  // Номер последнего изменения таблицы
+    uint32_t removedSeq; // Номер последнего удаления устройств
+    size_t count;
+    DeviceSnapshotEntry entries[DEVICE_REGISTRY_CAPACITY];
+};
+
+// Уведомление о публикации снимка с новыми изменениями (вызывается под блокировкой таблицы, должно быть коротким)
+typedef void (*DeviceSnapshotListener)();
+// Повтор публикации, пропущенной из-за занятых буферов: вызывается из release() без блокировки таблицы,
+// обработчик сам берет блокировку и вызывает publish(), если publishPending() еще верно
+typedef void (*DeviceSnapshotRetry)();
+// Выделение обнуленной памяти под буфер снимка, nullptr - нет памяти
+typedef void *(*DeviceSnapshotAllocator)(size_t size);
+
+// Хранилище снимков таблицы устройств.
+// Писатель (под блокировкой таблицы) заполняет свободный буфер и публикует его атомарной заменой индекса,
+// читатели (HTTP, LCD) работают только с опубликованным снимком и никогда не ждут блокировок.
+class DeviceSnapshotStore
+{
+public:
+    DeviceSnapshotStore();
+
+    // Выделение буферов (allocate == nullptr - calloc)
+    bool begin(DeviceSnapshotAllocator allocate = nullptr);
+    // Публикация нового снимка (вызывать при захваченной блокировке таблицы)
+    void publish(const DeviceRegistry &registry);
+    // Захват текущего снимка, nullptr если снимков еще нет. Обязательно освобождать через release()
+    const DeviceSnapshot *acquire();
+    // Освобождение снимка; если публикация была пропущена из-за занятых буферов, вызывается обработчик повтора.
+    // Не вызывать при захваченной блокировке таблицы
+    void release(const DeviceSnapshot *snapshot);
+    // Публикация пропущена и еще не повторена
+    bool publishPending() const { return pending.load(); }
+    // Подписка на публикацию снимков, в которых изменился номер изменения
+    void setListener(DeviceSnapshotListener callback) { listener = callback; }
+    void setRetryHandler(DeviceSnapshotRetry callback) { retry = callback; }
+
+private:
+    DeviceSnapshot *buffers[DEVICE_SNAPSHOT_BUFFERS];
+    std::atomic<int> refs[DEVICE_SNAPSHOT_BUFFERS];
+    std::atomic<int> current; // Индекс опубликованного буфера, -1 - нет
+    uint32_t version;
+    uint32_t notifiedSeq; // Номер изменения, о котором listener уже уведомлен
+    DeviceSnapshotListener listener;
+    DeviceSnapshotRetry retry;
+    std::atomic<bool> pending; // Публикация пропущена: все свободные буферы удерживались читателями
+};
+
+#endif
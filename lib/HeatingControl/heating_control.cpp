@@ -0,0 +1,258 @@
+#include "heating_control.h"
+#include <persist_scheduler.h>
+#include <heating_journal.h>
+#include "relay_output_esp32.h"
+#include <heating_controller.h>
+
+static TaskHandle_t controlTask = nullptr;
+static unsigned long lastSweepTime = 0;
+static unsigned long lastOutputTime = 0;
+static bool sweepDone = false;
+
+// Спрос на выходы ведется инкрементально: счетчик устройств с активным обогревом на каждый пин
+// и маска пинов с ненулевым счетчиком. Меняются только при смене вклада устройства (DeviceData::demandMask)
+static uint8_t pinDemand[CONTROL_MAX_PINS];
+static uint64_t demandMask = 0;
+// Уровни выходов, минимальные времена работы/паузы и ступенчатое включение реле
+static RelayOutputStage relayStage;
+
+static uint64_t pinBit(uint8_t pin)
+{
+    return pin < CONTROL_MAX_PINS ? 1ULL << pin : 0;
+}
+
+static uint64_t pinMask(const std::vector<uint8_t> &pins)
+{
+    uint64_t mask = 0;
+    for (uint8_t pin : pins)
+    {
+        mask |= pinBit(pin);
+    }
+    return mask;
+}
+
+// Замена вклада устройства в спрос: затрагиваются только пины, вошедшие в вклад или вышедшие из него
+static void setDeviceDemand(DeviceData &device, uint64_t mask)
+{
+    uint64_t added = mask & ~device.demandMask;
+    uint64_t removed = device.demandMask & ~mask;
+    while (added)
+    {
+        int pin = __builtin_ctzll(added);
+        added &= added - 1;
+        if (pinDemand[pin]++ == 0)
+        {
+            demandMask |= 1ULL << pin;
+        }
+    }
+    while (removed)
+    {
+        int pin = __builtin_ctzll(removed);
+        removed &= removed - 1;
+        if (--pinDemand[pin] == 0)
+        {
+            demandMask &= ~(1ULL << pin);
+        }
+    }
+    device.demandMask = mask;
+}
+
+void initHeatingControl()
+{
+    controlTask = xTaskGetCurrentTaskHandle();
+    lastOutputTime = millis();
+}
+
+static void notifyControl(uint32_t bits)
+{
+    // До запуска задачи уведомлять некого: первый проход будет полным
+    if (controlTask != nullptr)
+    {
+        xTaskNotify(controlTask, bits, eSetBits);
+    }
+}
+
+void requestDeviceControl(DeviceData &device)
+{
+    device.controlPending = true;
+    notifyControl(CONTROL_NOTIFY_DEVICE);
+}
+
+void initHeatingOutputs()
+{
+    uint64_t pins = 0;
+    for (const auto &gpio : availableGpio)
+    {
+        pins |= pinBit(gpio.pin);
+    }
+    relayStage.configure(relayOutputs(), pins);
+}
+
+void releaseDeviceControl(DeviceData &device)
+{
+    setDeviceDemand(device, 0);
+}
+
+void requestControlSweep()
+{
+    notifyControl(CONTROL_NOTIFY_SWEEP);
+}
+
+void wakeHeatingControl()
+{
+    notifyControl(CONTROL_NOTIFY_WAKE);
+}
+
+// Решение по обогреву одного устройства. Время работы считается от heatingStartTime -
+// момента прошлого пересчета, поэтому не зависит от того, как часто приходят события.
+// Решение принимает выбранный для устройства алгоритм (heating_controller.h)
+static void evaluateDevice(DeviceData &device, unsigned long now)
+{
+    bool wasHeating = device.heatingActive;
+    if (wasHeating)
+    {
+        device.totalHeatingTime += now - device.heatingStartTime;
+    }
+    device.heatingStartTime = now;
+
+    if (device.isDataValid(now))
+    {
+        HeatingControllerInput input = {device.currentTemperature, device.targetTemperature, hysteresisTemp, wasHeating, now};
+        if (device.enabled)
+        {
+            device.heatingActive = heatingControllerDecide(device.controllerType, input, device.controllerState);
+            if (device.heatingActive && !wasHeating)
+            {
+                logAndSend("Включаем обогрев для: " + String(device.name.c_str()));
+            }
+            else if (!device.heatingActive && wasHeating)
+            {
+                logAndSend("Выключаем обогрев для:" + String(device.name.c_str()));
+            }
+        }
+        else
+        {
+            // Выключенное устройство продолжает обучать модель помещения (остывание)
+            heatingControllerObserve(input, device.controllerState);
+            // Устройство выключено пользователем - выключаем обогрев
+            if (wasHeating)
+            {
+                logAndSend("Устройство выключено. Выключаем обогрев для: " + String(device.name.c_str()));
+                device.heatingActive = false;
+            }
+        }
+    }
+    else if (device.isOnline)
+    {
+        logAndSend("Устройство: " + String(device.name.c_str()) + " перешло в оффлайн");
+        device.isOnline = false;
+        device.heatingActive = false;
+        devices.touch(device);
+    }
+
+    // Вклад в спрос пересчитывается и при смене набора пинов без переключения обогрева
+    setDeviceDemand(device, device.heatingActive ? pinMask(device.gpioPins) : 0);
+
+    if (wasHeating != device.heatingActive)
+    {
+        heatingJournalStateChanged(device);
+    }
+    // Переключение обогрева и накопление времени работы - изменение состояния устройства
+    if (wasHeating || device.heatingActive)
+    {
+        devices.touch(device);
+        // Журнал на SPIFFS точнее, но стирается при перепрошивке SPIFFS (uploadfs) -
+        // тогда время работы берется из NVS, поэтому оно пишется и при работающем журнале
+        markDeviceStatsDirty(device);
+    }
+}
+
+// Установка выходов GPIO: решение по всем пинам - одна операция над масками, затем планировщик
+// реле (минимальные времена, ступенчатое включение); в драйвер уходят только пины,
+// уровень которых изменился (одной записью на банк регистров)
+static void applyOutputs(unsigned long now)
+{
+    uint64_t configuredMask = 0;
+    uint64_t autoMask = 0;
+    uint64_t onMask = 0;
+    for (auto &gpio : availableGpio)
+    {
+        uint64_t bit = pinBit(gpio.pin);
+        configuredMask |= bit;
+        if (gpio.state == STATE_GPIO_AUTO)
+        {
+            autoMask |= bit;
+        }
+        else if (gpio.state == STATE_GPIO_ON)
+        {
+            onMask |= bit;
+        }
+        // Время работы выхода - за интервал, в течение которого он был включен
+        if (gpio.outputActive)
+        {
+            gpio.totalHeatingTime += now - lastOutputTime;
+            markGpioStatsDirty();
+        }
+    }
+
+    uint64_t desired = relayStage.apply(relayOutputs(), demandMask, configuredMask, autoMask, onMask, now);
+
+    for (auto &gpio : availableGpio)
+    {
+        gpio.outputActive = (desired & pinBit(gpio.pin)) != 0;
+    }
+    lastOutputTime = now;
+}
+
+void runHeatingControl()
+{
+    unsigned long waitStart = millis();
+    unsigned long sinceSweep = waitStart - lastSweepTime;
+    uint32_t waitMs = (!sweepDone || sinceSweep >= CONTROL_DELAY) ? 0 : CONTROL_DELAY - sinceSweep;
+    // Отложенные планировщиком переключения реле тоже будят задачу
+    uint32_t relayWait = relayStage.scheduler().nextChangeIn();
+    if (relayWait > 0 && relayWait < waitMs)
+    {
+        waitMs = relayWait;
+    }
+    uint32_t events = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &events, pdMS_TO_TICKS(waitMs));
+
+    unsigned long now = millis();
+    bool sweep = !sweepDone || (events & CONTROL_NOTIFY_SWEEP) || now - lastSweepTime >= CONTROL_DELAY;
+    bool relayDue = relayWait > 0 && now - waitStart >= relayWait;
+    if (!sweep && !(events & CONTROL_NOTIFY_DEVICE) && !relayDue)
+    {
+        return;
+    }
+    if (!devicesLock.lock())
+    {
+        // Флаги controlPending сохранились, повторим при следующем пробуждении
+        xTaskNotify(controlTask, events, eSetBits);
+        return;
+    }
+
+    if (sweep)
+    {
+        logAndSend("Проверка необходимости включения GPIO");
+    }
+    for (auto &device : devices)
+    {
+        if (sweep || device.controlPending)
+        {
+            device.controlPending = false;
+            evaluateDevice(device, now);
+        }
+    }
+    applyOutputs(now);
+    if (sweep)
+    {
+        // Отметка работы в журнале - только при полном обходе, чтобы события не раздували журнал
+        heatingJournalControlCycle(devices);
+        lastSweepTime = now;
+        sweepDone = true;
+    }
+    // Публикуем состояние устройств для HTTP и LCD
+    deviceSnapshots.publish(devices);
+    devicesLock.unlock();
+}
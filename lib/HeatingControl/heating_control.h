@@ -0,0 +1,35 @@
+#ifndef HEATING_CONTROL_H
+#define HEATING_CONTROL_H
+
+#include <Arduino.h>
+#include <variables_info.h>
+
+// Биты уведомления задачи управления
+#define CONTROL_NOTIFY_DEVICE 0x01 // Изменились показания или настройки устройств (флаг controlPending)
+#define CONTROL_NOTIFY_SWEEP 0x02  // Нужен полный обход (изменены GPIO или гистерезис)
+#define CONTROL_NOTIFY_WAKE 0x04   // Пробуждение без управления (проверка режима OTA)
+#define CONTROL_MAX_PINS 64        // Номера GPIO, учитываемые масками выходов (0..63)
+
+// Управление обогревом по событиям: задача спит, пока BLE или настройки не сообщат об изменении,
+// и пересчитывает только изменившиеся устройства. Полный обход раз в CONTROL_DELAY -
+// страховка (переход в оффлайн, пропущенные события) и отметка работы в журнале обогрева
+
+// Регистрация текущей задачи как задачи управления (вызывать из нее до runHeatingControl)
+void initHeatingControl();
+
+// Перевод всех настроенных GPIO в выходы с низким уровнем (setup, до запуска задачи управления)
+void initHeatingOutputs();
+
+// Устройство нужно пересчитать (вызывать при захваченном devicesLock)
+void requestDeviceControl(DeviceData &device);
+// Снятие запросов устройства на выходы перед его удалением (при захваченном devicesLock)
+void releaseDeviceControl(DeviceData &device);
+// Пересчитать все устройства и выходы
+void requestControlSweep();
+// Разбудить задачу управления без пересчета
+void wakeHeatingControl();
+
+// Ожидание события или срока полного обхода и выполнение управления
+void runHeatingControl();
+
+#endif
@@ -0,0 +1,51 @@
+#include "relay_output_esp32.h"
+#include <soc/gpio_struct.h>
+
+void GpioRegisterOutputDriver::configure(uint64_t pins)
+{
+    // Уровень задается до включения выхода, чтобы реле не щелкнули при настройке
+    write(0, pins);
+    while (pins)
+    {
+        int pin = __builtin_ctzll(pins);
+        pins &= pins - 1;
+        pinMode(pin, OUTPUT);
+    }
+}
+
+void GpioRegisterOutputDriver::write(uint64_t setMask, uint64_t clearMask)
+{
+    uint32_t clearLow = (uint32_t)clearMask;
+    uint32_t clearHigh = (uint32_t)(clearMask >> 32);
+    uint32_t setLow = (uint32_t)setMask;
+    uint32_t setHigh = (uint32_t)(setMask >> 32);
+    if (clearLow)
+    {
+        GPIO.out_w1tc = clearLow;
+    }
+    if (clearHigh)
+    {
+        GPIO.out1_w1tc.val = clearHigh;
+    }
+    if (setLow)
+    {
+        GPIO.out_w1ts = setLow;
+    }
+    if (setHigh)
+    {
+        GPIO.out1_w1ts.val = setHigh;
+    }
+}
+
+static GpioRegisterOutputDriver registerDriver;
+static RelayOutputDriver *currentDriver = &registerDriver;
+
+RelayOutputDriver &relayOutputs()
+{
+    return *currentDriver;
+}
+
+void setRelayOutputDriver(RelayOutputDriver *driver)
+{
+    currentDriver = driver != nullptr ? driver : &registerDriver;
+}
@@ -0,0 +1,20 @@
+#ifndef RELAY_OUTPUT_ESP32_H
+#define RELAY_OUTPUT_ESP32_H
+
+#include <Arduino.h>
+#include <relay_output.h>
+
+// Запись через регистры GPIO_OUT_W1TS/W1TC (пины 0-31) и GPIO_OUT1_W1TS/W1TC (32-53):
+// пины одного банка переключаются одной записью, сначала снимаются, затем включаются
+class GpioRegisterOutputDriver : public RelayOutputDriver
+{
+public:
+    void configure(uint64_t pins) override;
+    void write(uint64_t setMask, uint64_t clearMask) override;
+};
+
+// Текущий драйвер выходов (по умолчанию GpioRegisterOutputDriver)
+RelayOutputDriver &relayOutputs();
+void setRelayOutputDriver(RelayOutputDriver *driver);
+
+#endif
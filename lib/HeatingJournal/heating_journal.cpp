@@ -0,0 +1,360 @@
+#include "heating_journal.h"
+#include <SPIFFS.h>
+#include <persist_scheduler.h>
+#include <atomic>
+#include <vector>
+
+// Состояние устройства при восстановлении из журнала
+struct JournalDeviceState
+{
+    uint64_t mac;
+    uint32_t total;
+    uint32_t onSince;
+    bool on;
+};
+
+static bool journalReady = false;
+static portMUX_TYPE journalMux = portMUX_INITIALIZER_UNLOCKED;
+static HeatingJournalRecord journalBuffer[HEATING_JOURNAL_BUFFER_RECORDS];
+static size_t journalCount = 0;
+static uint32_t journalDropped = 0;
+static unsigned long lastJournalFlush = 0;
+// Сжатие: размер превышен -> снимок при полном обходе задачи управления -> перезапись файла в heatingJournalTick
+static std::atomic<bool> compactionRequested(false);
+static std::vector<HeatingJournalRecord> compactionSnapshot;
+static bool compactionPending = false;
+
+static uint8_t journalCrc8(const uint8_t *data, size_t length)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint8_t recordCrc(const HeatingJournalRecord &record)
+{
+    HeatingJournalRecord copy = record;
+    copy.crc = 0;
+    return journalCrc8((const uint8_t *)&copy, sizeof(copy));
+}
+
+static HeatingJournalRecord makeRecord(uint8_t type, uint64_t mac, uint32_t value, uint32_t time)
+{
+    HeatingJournalRecord record;
+    record.time = time;
+    for (int i = 0; i < 6; i++)
+    {
+        record.mac[i] = (mac >> (8 * (5 - i))) & 0xFF;
+    }
+    record.type = type;
+    record.value = value;
+    record.crc = 0;
+    record.crc = recordCrc(record);
+    return record;
+}
+
+static uint32_t temperatureValue(float temperature)
+{
+    return (uint32_t)(int32_t)(temperature * 100.0f);
+}
+
+static HeatingJournalRecord checkpointRecord(const DeviceData &device, uint32_t time)
+{
+    uint8_t type = HEATING_JOURNAL_CHECKPOINT | (device.heatingActive ? HEATING_JOURNAL_ACTIVE_FLAG : 0);
+    return makeRecord(type, device.mac, device.totalHeatingTime, time);
+}
+
+static void appendRecord(const HeatingJournalRecord &record)
+{
+    if (!journalReady)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&journalMux);
+    if (journalCount < HEATING_JOURNAL_BUFFER_RECORDS)
+    {
+        journalBuffer[journalCount++] = record;
+    }
+    else
+    {
+        journalDropped++;
+    }
+    portEXIT_CRITICAL(&journalMux);
+}
+
+// Восстановление +++++++++++++++++++++++++++++++++++++
+static JournalDeviceState &findState(std::vector<JournalDeviceState> &states, uint64_t mac)
+{
+    for (auto &state : states)
+    {
+        if (state.mac == mac)
+        {
+            return state;
+        }
+    }
+    states.push_back({mac, 0, 0, false});
+    return states.back();
+}
+
+// Конец загрузки: обогрев, не выключенный записью OFF, считается работавшим до последней отметки
+static void closeSegment(std::vector<JournalDeviceState> &states, uint32_t lastTime)
+{
+    for (auto &state : states)
+    {
+        if (state.on)
+        {
+            state.total += lastTime - state.onSince;
+            state.on = false;
+        }
+    }
+}
+
+static void replayJournal(std::vector<JournalDeviceState> &states)
+{
+    File file = SPIFFS.open(HEATING_JOURNAL_PATH, FILE_READ);
+    if (!file)
+    {
+        return;
+    }
+    HeatingJournalRecord record;
+    uint32_t lastTime = 0;
+    size_t count = 0;
+    while (file.read((uint8_t *)&record, sizeof(record)) == sizeof(record))
+    {
+        if (record.crc != recordCrc(record))
+        {
+            // Недописанная при сбое запись - дальше данных нет
+            logAndSend("Heating journal: damaged record " + String(count) + ", replay stopped");
+            break;
+        }
+        count++;
+        uint64_t mac = macFromBytes(record.mac);
+        switch (record.type & ~HEATING_JOURNAL_ACTIVE_FLAG)
+        {
+        case HEATING_JOURNAL_BOOT:
+            closeSegment(states, lastTime);
+            break;
+        case HEATING_JOURNAL_ON:
+        {
+            JournalDeviceState &state = findState(states, mac);
+            if (!state.on)
+            {
+                state.on = true;
+                state.onSince = record.time;
+            }
+            break;
+        }
+        case HEATING_JOURNAL_OFF:
+        {
+            JournalDeviceState &state = findState(states, mac);
+            if (state.on)
+            {
+                state.total += record.time - state.onSince;
+                state.on = false;
+            }
+            break;
+        }
+        case HEATING_JOURNAL_CHECKPOINT:
+        {
+            JournalDeviceState &state = findState(states, mac);
+            state.total = record.value;
+            state.on = (record.type & HEATING_JOURNAL_ACTIVE_FLAG) != 0;
+            state.onSince = record.time;
+            break;
+        }
+        default:
+            break;
+        }
+        lastTime = record.time;
+    }
+    closeSegment(states, lastTime);
+    file.close();
+    logAndSend("Heating journal: replayed " + String(count) + " records");
+}
+
+// Перезапись журнала содержимым records (через временный файл)
+static bool rewriteJournal(const std::vector<HeatingJournalRecord> &records)
+{
+    File file = SPIFFS.open(HEATING_JOURNAL_TMP_PATH, FILE_WRITE);
+    if (!file)
+    {
+        return false;
+    }
+    size_t size = records.size() * sizeof(HeatingJournalRecord);
+    bool ok = file.write((const uint8_t *)records.data(), size) == size;
+    file.close();
+    if (!ok)
+    {
+        SPIFFS.remove(HEATING_JOURNAL_TMP_PATH);
+        return false;
+    }
+    recordPersistWrite(size);
+    SPIFFS.remove(HEATING_JOURNAL_PATH);
+    return SPIFFS.rename(HEATING_JOURNAL_TMP_PATH, HEATING_JOURNAL_PATH);
+}
+
+void initHeatingJournal()
+{
+    // Сбой между удалением старого журнала и переименованием нового
+    if (!SPIFFS.exists(HEATING_JOURNAL_PATH) && SPIFFS.exists(HEATING_JOURNAL_TMP_PATH))
+    {
+        SPIFFS.rename(HEATING_JOURNAL_TMP_PATH, HEATING_JOURNAL_PATH);
+    }
+
+    std::vector<JournalDeviceState> states;
+    replayJournal(states);
+
+    // Новый журнал начинается с контрольной точки всех устройств
+    std::vector<HeatingJournalRecord> records;
+    uint32_t now = millis();
+    records.push_back(makeRecord(HEATING_JOURNAL_BOOT, 0, HEATING_JOURNAL_VERSION, now));
+    if (!devicesLock.lock())
+    {
+        logAndSend("Failed to take devicesLock");
+        return;
+    }
+    for (auto &device : devices)
+    {
+        for (const auto &state : states)
+        {
+            if (state.mac == device.mac && state.total != device.totalHeatingTime)
+            {
+                device.totalHeatingTime = state.total;
+                devices.touch(device);
+            }
+        }
+        records.push_back(checkpointRecord(device, now));
+    }
+    deviceSnapshots.publish(devices);
+    devicesLock.unlock();
+
+    journalReady = rewriteJournal(records);
+    lastJournalFlush = millis();
+    if (!journalReady)
+    {
+        logAndSend("Heating journal: failed to write " HEATING_JOURNAL_PATH ", totals come from NVS only");
+    }
+}
+
+// События +++++++++++++++++++++++++++++++++++++++++++
+void heatingJournalStateChanged(const DeviceData &device)
+{
+    uint8_t type = device.heatingActive ? HEATING_JOURNAL_ON : HEATING_JOURNAL_OFF;
+    appendRecord(makeRecord(type, device.mac, temperatureValue(device.currentTemperature), millis()));
+}
+
+void heatingJournalCheckpoint(const DeviceData &device)
+{
+    appendRecord(checkpointRecord(device, millis()));
+}
+
+void heatingJournalControlCycle(const DeviceRegistry &registry)
+{
+    if (!journalReady)
+    {
+        return;
+    }
+    uint32_t now = millis();
+    bool anyHeating = false;
+    for (const auto &device : registry)
+    {
+        anyHeating = anyHeating || device.heatingActive;
+    }
+    // Отметка ограничивает потерю времени работы при сбое питания интервалом сброса буфера
+    if (anyHeating)
+    {
+        appendRecord(makeRecord(HEATING_JOURNAL_HEARTBEAT, 0, 0, now));
+    }
+
+    if (compactionRequested.exchange(false))
+    {
+        std::vector<HeatingJournalRecord> snapshot;
+        snapshot.reserve(registry.size());
+        for (const auto &device : registry)
+        {
+            snapshot.push_back(checkpointRecord(device, now));
+        }
+        // Записи в буфере учтены контрольной точкой и в новый файл не попадают
+        portENTER_CRITICAL(&journalMux);
+        compactionSnapshot.swap(snapshot);
+        compactionPending = true;
+        journalCount = 0;
+        portEXIT_CRITICAL(&journalMux);
+    }
+}
+
+void heatingJournalTick()
+{
+    if (!journalReady)
+    {
+        return;
+    }
+
+    std::vector<HeatingJournalRecord> snapshot;
+    HeatingJournalRecord pending[HEATING_JOURNAL_BUFFER_RECORDS];
+    size_t pendingCount = 0;
+    uint32_t dropped = 0;
+    unsigned long now = millis();
+    bool flushDue = now - lastJournalFlush >= HEATING_JOURNAL_FLUSH_INTERVAL;
+
+    portENTER_CRITICAL(&journalMux);
+    if (compactionPending)
+    {
+        snapshot.swap(compactionSnapshot);
+        compactionPending = false;
+    }
+    if (journalCount > 0 && (flushDue || journalCount >= HEATING_JOURNAL_BUFFER_RECORDS / 2))
+    {
+        pendingCount = journalCount;
+        memcpy(pending, journalBuffer, pendingCount * sizeof(HeatingJournalRecord));
+        journalCount = 0;
+    }
+    dropped = journalDropped;
+    journalDropped = 0;
+    portEXIT_CRITICAL(&journalMux);
+
+    if (dropped > 0)
+    {
+        logAndSend("Heating journal: buffer full, dropped " + String(dropped) + " records");
+    }
+    if (!snapshot.empty() && !rewriteJournal(snapshot))
+    {
+        logAndSend("Heating journal: compaction failed");
+    }
+    if (flushDue)
+    {
+        lastJournalFlush = now;
+    }
+    if (pendingCount == 0)
+    {
+        return;
+    }
+
+    File file = SPIFFS.open(HEATING_JOURNAL_PATH, FILE_APPEND);
+    if (!file)
+    {
+        logAndSend("Heating journal: failed to open " HEATING_JOURNAL_PATH);
+        return;
+    }
+    size_t size = pendingCount * sizeof(HeatingJournalRecord);
+    if (file.write((const uint8_t *)pending, size) == size)
+    {
+        recordPersistWrite(size);
+    }
+    else
+    {
+        logAndSend("Heating journal: write failed");
+    }
+    if (file.size() > HEATING_JOURNAL_MAX_SIZE)
+    {
+        compactionRequested = true;
+    }
+    file.close();
+}
@@ -0,0 +1,52 @@
+#ifndef HEATING_JOURNAL_H
+#define HEATING_JOURNAL_H
+
+#include <Arduino.h>
+#include <variables_info.h>
+
+#define HEATING_JOURNAL_PATH "/heating.jnl"          // Файл журнала на SPIFFS
+#define HEATING_JOURNAL_TMP_PATH "/heating.tmp"      // Временный файл при сжатии журнала
+#define HEATING_JOURNAL_VERSION 1                    // Версия формата (значение записи BOOT)
+#define HEATING_JOURNAL_BUFFER_RECORDS 32            // Записей в буфере RAM до сброса на SPIFFS
+#define HEATING_JOURNAL_FLUSH_INTERVAL 60000         // Максимальное время записи в буфере RAM (мс)
+#define HEATING_JOURNAL_MAX_SIZE 32768               // Размер файла, после которого журнал сжимается до контрольной точки (байт)
+
+// Типы записей журнала
+#define HEATING_JOURNAL_ON 1         // Обогрев включен, value - температура (сотые °C)
+#define HEATING_JOURNAL_OFF 2        // Обогрев выключен, value - температура (сотые °C)
+#define HEATING_JOURNAL_HEARTBEAT 3  // Система работает (последнее известное время загрузки)
+#define HEATING_JOURNAL_BOOT 4       // Начало новой загрузки, value - версия формата
+#define HEATING_JOURNAL_CHECKPOINT 5 // Накопленное время устройства, value - мс
+#define HEATING_JOURNAL_ACTIVE_FLAG 0x80 // В CHECKPOINT: обогрев активен на момент контрольной точки
+
+// Запись журнала, 16 байт little-endian:
+//   0  uint32 time  millis() текущей загрузки
+//   4  uint8  mac[6]
+//   10 uint8  type  HEATING_JOURNAL_*
+//   11 uint8  crc8  по остальным 15 байтам (недописанная запись в конце файла отбрасывается)
+//   12 uint32 value
+struct HeatingJournalRecord
+{
+    uint32_t time;
+    uint8_t mac[6];
+    uint8_t type;
+    uint8_t crc;
+    uint32_t value;
+};
+static_assert(sizeof(HeatingJournalRecord) == 16, "HeatingJournalRecord must be 16 bytes");
+
+// Восстановление времени работы обогрева из журнала и начало новой загрузки.
+// Вызывать после loadClientsFromFile(); устройства из журнала получают точное накопленное время,
+// остальные (журнал стерт перепрошивкой SPIFFS) сохраняют время из NVS, которое пишется раз в PERSIST_STATS_INTERVAL
+void initHeatingJournal();
+
+// События устройств (вызывать при захваченном devicesLock)
+void heatingJournalStateChanged(const DeviceData &device);
+void heatingJournalCheckpoint(const DeviceData &device);
+// Конец полного обхода задачи управления (heating_control.h): отметка о работе и, при необходимости, снимок для сжатия журнала
+void heatingJournalControlCycle(const DeviceRegistry &registry);
+
+// Сброс буфера на SPIFFS и сжатие журнала (основной цикл, без блокировок)
+void heatingJournalTick();
+
+#endif
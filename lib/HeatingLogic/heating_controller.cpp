@@ -0,0 +1,248 @@
+#include "heating_controller.h"
+#include <string.h>
+
+#define MS_PER_HOUR 3600000.0f
+
+static float clampFloat(float value, float low, float high)
+{
+    return value < low ? low : (value > high ? high : value);
+}
+
+// Скользящее среднее; первая оценка принимается как есть
+static float smooth(float average, float value, uint8_t samples)
+{
+    return samples == 0 ? value : average + PREDICT_RATE_ALPHA * (value - average);
+}
+
+static void restartSample(const HeatingControllerInput &input, HeatingControllerState &state)
+{
+    state.sampleTemperature = input.temperature;
+    state.sampleTime = input.now;
+    state.sampleHeating = input.heating;
+    state.hasSample = true;
+}
+
+// Поиск экстремума после переключения: после включения температура еще падает, после выключения -
+// растет. Экстремум пройден, когда температура отошла от него на PREDICT_TURN_DELTA в обратную сторону
+static void trackLag(const HeatingControllerInput &input, HeatingControllerState &state)
+{
+    bool beyond = state.lagHeating ? input.temperature < state.lagExtreme : input.temperature > state.lagExtreme;
+    bool turned = state.lagHeating ? input.temperature >= state.lagExtreme + PREDICT_TURN_DELTA
+                                   : input.temperature <= state.lagExtreme - PREDICT_TURN_DELTA;
+    if (beyond)
+    {
+        state.lagExtreme = input.temperature;
+        state.lagExtremeTime = input.now;
+    }
+    else if (turned)
+    {
+        state.lag = smooth(state.lag, (float)(state.lagExtremeTime - state.lagStart), state.lagSamples);
+        if (state.lagSamples < UINT8_MAX)
+        {
+            state.lagSamples++;
+        }
+        state.lagTracking = false;
+        restartSample(input, state);
+    }
+    else if (input.now - state.lagStart > PREDICT_LAG_MAX)
+    {
+        // Экстремума нет (медленный дрейф) - оценку запаздывания пропускаем
+        state.lagTracking = false;
+        restartSample(input, state);
+    }
+}
+
+void heatingControllerObserve(const HeatingControllerInput &input, HeatingControllerState &state)
+{
+    if (!state.hasSample || input.heating != state.sampleHeating)
+    {
+        if (state.hasSample)
+        {
+            state.lagTracking = true;
+            state.lagHeating = input.heating;
+            state.lagStart = input.now;
+            state.lagExtreme = input.temperature;
+            state.lagExtremeTime = input.now;
+        }
+        restartSample(input, state);
+        return;
+    }
+    // Скорости оцениваются только после прохождения экстремума, иначе их искажает выбег
+    if (state.lagTracking)
+    {
+        trackLag(input, state);
+        return;
+    }
+
+    unsigned long elapsed = input.now - state.sampleTime;
+    if (elapsed < PREDICT_RATE_INTERVAL)
+    {
+        return;
+    }
+    float rate = (input.temperature - state.sampleTemperature) * MS_PER_HOUR / elapsed;
+    if (input.heating)
+    {
+        state.heatRate = smooth(state.heatRate, rate, state.heatSamples);
+        if (state.heatSamples < UINT8_MAX)
+        {
+            state.heatSamples++;
+        }
+    }
+    else
+    {
+        state.coolRate = smooth(state.coolRate, -rate, state.coolSamples);
+        if (state.coolSamples < UINT8_MAX)
+        {
+            state.coolSamples++;
+        }
+    }
+    restartSample(input, state);
+}
+
+// Алгоритмы ++++++++++++++++++++++++++++++++++++++++++
+class HysteresisController : public HeatingController
+{
+public:
+    bool decide(const HeatingControllerInput &input, HeatingControllerState &state) const override
+    {
+        if (!input.heating && input.temperature + input.hysteresis < input.target)
+        {
+            return true;
+        }
+        if (input.heating && input.temperature >= input.target)
+        {
+            return false;
+        }
+        return input.heating;
+    }
+};
+
+// Доля окна пересчитывается в начале каждого окна; обогрев включен с начала окна до этой доли.
+// Интеграл ограничен диапазоном, дающим долю 0..1, и не растет, пока окно уже полностью включено.
+// Производная - по собственным точкам ПИД на каждом вызове, сглаженная с постоянной PID_RATE_FILTER:
+// тренд модели прогноза обновляется раз в PREDICT_RATE_INTERVAL и не ведется во время выбега
+class PidController : public HeatingController
+{
+public:
+    bool decide(const HeatingControllerInput &input, HeatingControllerState &state) const override
+    {
+        updateRate(input, state);
+        float error = input.target - input.temperature;
+        if (state.windowStarted)
+        {
+            float hours = (input.now - state.integralTime) / MS_PER_HOUR;
+            if (state.windowDuty < 1.0f || error < 0)
+            {
+                state.integral = clampFloat(state.integral + error * hours, 0, 1.0f / PID_KI);
+            }
+        }
+        state.integralTime = input.now;
+
+        if (!state.windowStarted || input.now - state.windowStart >= PID_WINDOW_TIME)
+        {
+            state.windowDuty = clampFloat(PID_KP * error + PID_KI * state.integral - PID_KD * state.pidRate, 0, 1);
+            state.windowStart = input.now;
+            state.windowStarted = true;
+        }
+        return input.now - state.windowStart < (unsigned long)(state.windowDuty * PID_WINDOW_TIME);
+    }
+
+private:
+    static void updateRate(const HeatingControllerInput &input, HeatingControllerState &state)
+    {
+        if (!state.pidSampled)
+        {
+            state.pidRate = 0;
+            state.pidSampled = true;
+        }
+        else
+        {
+            unsigned long elapsed = input.now - state.pidTime;
+            if (elapsed == 0)
+            {
+                return;
+            }
+            float rate = (input.temperature - state.pidTemperature) * MS_PER_HOUR / elapsed;
+            state.pidRate += (rate - state.pidRate) * elapsed / (elapsed + (float)PID_RATE_FILTER);
+        }
+        state.pidTemperature = input.temperature;
+        state.pidTime = input.now;
+    }
+};
+
+// Гистерезис по прогнозу: выключение, когда рост по инерции доведет температуру до целевой,
+// включение, когда остывание по инерции опустит ее ниже target - гистерезис.
+// Скорость за время запаздывания спадает примерно линейно до нуля, отсюда половина запаздывания.
+// Пока модель не набрала оценок - обычный гистерезис
+class PredictiveController : public HeatingController
+{
+public:
+    bool decide(const HeatingControllerInput &input, HeatingControllerState &state) const override
+    {
+        if (state.heatSamples < PREDICT_MIN_SAMPLES || state.coolSamples < PREDICT_MIN_SAMPLES || state.lagSamples == 0)
+        {
+            return hysteresis.decide(input, state);
+        }
+        float coastHours = state.lag / 2 / MS_PER_HOUR;
+        if (input.heating)
+        {
+            float peak = input.temperature + (state.heatRate > 0 ? state.heatRate : 0) * coastHours;
+            return peak < input.target;
+        }
+        float trough = input.temperature - (state.coolRate > 0 ? state.coolRate : 0) * coastHours;
+        return trough + input.hysteresis < input.target;
+    }
+
+private:
+    HysteresisController hysteresis;
+};
+
+static const HysteresisController hysteresisController;
+static const PidController pidController;
+static const PredictiveController predictiveController;
+
+static const char *const controllerNames[CONTROLLER_TYPE_COUNT] = {"hysteresis", "pid", "predictive"};
+
+const HeatingController &heatingController(uint8_t type)
+{
+    switch (type)
+    {
+    case CONTROLLER_PID:
+        return pidController;
+    case CONTROLLER_PREDICTIVE:
+        return predictiveController;
+    default:
+        return hysteresisController;
+    }
+}
+
+bool heatingControllerDecide(uint8_t type, const HeatingControllerInput &input, HeatingControllerState &state)
+{
+    heatingControllerObserve(input, state);
+    if (state.activeType != type)
+    {
+        state.activeType = type;
+        state.integral = 0;
+        state.windowStarted = false;
+        state.pidSampled = false;
+    }
+    return heatingController(type).decide(input, state);
+}
+
+const char *heatingControllerName(uint8_t type)
+{
+    return controllerNames[type < CONTROLLER_TYPE_COUNT ? type : CONTROLLER_HYSTERESIS];
+}
+
+bool parseHeatingController(const char *name, uint8_t &type)
+{
+    for (uint8_t i = 0; i < CONTROLLER_TYPE_COUNT; i++)
+    {
+        if (strcmp(name, controllerNames[i]) == 0)
+        {
+            type = i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,92 @@
+#ifndef HEATING_CONTROLLER_H
+#define HEATING_CONTROLLER_H
+
+#include <stdint.h>
+
+// Время-пропорциональный ПИД: доля окна, в течение которой обогрев включен
+#define PID_WINDOW_TIME 1200000    // Длина окна (мс)
+#define PID_KP 0.5f                // Доля окна на 1 °C отклонения
+#define PID_KI 0.25f               // Доля окна на 1 °C·ч накопленного отклонения
+#define PID_KD 0.5f                // Доля окна на 1 °C/ч скорости изменения температуры
+#define PID_RATE_FILTER 1200000    // Постоянная времени сглаживания скорости для производной (мс), порядка окна
+
+// Оценка тепловой модели помещения по показаниям датчика
+#define PREDICT_RATE_INTERVAL 600000 // Минимальный интервал между точками оценки скорости (мс)
+#define PREDICT_RATE_ALPHA 0.25f     // Вес новой оценки скорости / запаздывания в скользящем среднем
+#define PREDICT_MIN_SAMPLES 3        // Оценок нагрева и остывания, после которых прогноз используется
+#define PREDICT_LAG_MAX 3600000      // Наибольшее учитываемое запаздывание (мс)
+#define PREDICT_TURN_DELTA 0.1f      // Отход от экстремума, после которого он считается пройденным (°C)
+
+// Алгоритм управления обогревом устройства
+enum HeatingControllerType : uint8_t
+{
+    CONTROLLER_HYSTERESIS = 0, // Включение ниже target - гистерезис, выключение на target
+    CONTROLLER_PID = 1,        // Время-пропорциональный ПИД
+    CONTROLLER_PREDICTIVE = 2, // Гистерезис с прогнозом выбега по изученной модели помещения
+    CONTROLLER_TYPE_COUNT
+};
+
+// Состояние регулятора устройства. Хранится в DeviceData, без динамической памяти;
+// изученная модель (скорости, запаздывание) ведется при любом алгоритме
+struct HeatingControllerState
+{
+    uint8_t activeType;          // Алгоритм, для которого ведутся integral и окно ПИД
+    // ПИД
+    float integral;              // Накопленное отклонение (°C·ч)
+    float windowDuty;            // Доля текущего окна (0..1)
+    unsigned long windowStart;   // Начало текущего окна
+    unsigned long integralTime;  // Время последнего накопления
+    bool windowStarted;
+    float pidTemperature;        // Температура на предыдущем шаге ПИД
+    unsigned long pidTime;       // Время предыдущего шага ПИД
+    float pidRate;               // Сглаженная скорость изменения температуры (°C/ч) для производной
+    bool pidSampled;             // pidTemperature и pidTime заданы
+    // Скорости нагрева и остывания (°C/ч)
+    float heatRate;
+    float coolRate;
+    uint8_t heatSamples;
+    uint8_t coolSamples;
+    float sampleTemperature;     // Начальная точка текущего интервала оценки
+    unsigned long sampleTime;
+    bool sampleHeating;
+    bool hasSample;
+    // Запаздывание: время от переключения до экстремума температуры
+    float lag;                   // Скользящее среднее (мс)
+    uint8_t lagSamples;
+    bool lagTracking;
+    bool lagHeating;             // Состояние обогрева после переключения
+    float lagExtreme;            // Экстремум температуры после переключения
+    unsigned long lagStart;
+    unsigned long lagExtremeTime;
+};
+
+// Данные для решения на момент now
+struct HeatingControllerInput
+{
+    float temperature;
+    float target;
+    float hysteresis;
+    bool heating;                // Текущее решение (до этого шага)
+    unsigned long now;
+};
+
+// Алгоритм управления. Не хранит состояния - все в HeatingControllerState устройства
+class HeatingController
+{
+public:
+    virtual ~HeatingController() {}
+    virtual bool decide(const HeatingControllerInput &input, HeatingControllerState &state) const = 0;
+};
+
+// Обучение модели по новому показанию (вызывается и для выключенных устройств)
+void heatingControllerObserve(const HeatingControllerInput &input, HeatingControllerState &state);
+// Обучение и решение выбранного алгоритма: true - обогрев нужен.
+// При смене алгоритма его собственное состояние (интеграл, окно) сбрасывается, модель сохраняется
+bool heatingControllerDecide(uint8_t type, const HeatingControllerInput &input, HeatingControllerState &state);
+
+const HeatingController &heatingController(uint8_t type);
+// Имена для HTTP: "hysteresis", "pid", "predictive"
+const char *heatingControllerName(uint8_t type);
+bool parseHeatingController(const char *name, uint8_t &type);
+
+#endif
@@ -0,0 +1,28 @@
+#include "relay_output.h"
+
+void RelayOutputStage::configure(RelayOutputDriver &driver, uint64_t pins)
+{
+    driver.configure(pins);
+    preparedMask |= pins;
+    outputMask &= ~pins;
+}
+
+uint64_t RelayOutputStage::apply(RelayOutputDriver &driver, uint64_t demand, uint64_t configured, uint64_t autoMask,
+                                 uint64_t onMask, unsigned long now)
+{
+    // Пины, добавленные в настройки после запуска, переводятся в режим выхода
+    uint64_t fresh = configured & ~preparedMask;
+    if (fresh)
+    {
+        configure(driver, fresh);
+    }
+
+    uint64_t desired = relayScheduler.apply((demand & autoMask) | onMask, configured, now);
+    uint64_t changed = (desired ^ outputMask) & configured;
+    if (changed)
+    {
+        driver.write(desired & changed, ~desired & changed);
+    }
+    outputMask = (outputMask & ~configured) | (desired & configured);
+    return desired;
+}
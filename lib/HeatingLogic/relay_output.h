@@ -0,0 +1,44 @@
+#ifndef RELAY_OUTPUT_H
+#define RELAY_OUTPUT_H
+
+#include <stdint.h>
+#include "relay_scheduler.h"
+
+// Драйвер выходов реле: маски пинов вместо вызовов digitalWrite по одному пину.
+// Реализация для ESP32 - relay_output_esp32.h, в тестах на хосте - заглушка
+class RelayOutputDriver
+{
+public:
+    virtual ~RelayOutputDriver() {}
+    // Перевод пинов маски в режим выхода с низким уровнем
+    virtual void configure(uint64_t pins) = 0;
+    // Установка уровней: setMask -> HIGH, clearMask -> LOW, остальные пины не трогаются
+    virtual void write(uint64_t setMask, uint64_t clearMask) = 0;
+};
+
+// Ступень выходов между решением управления и драйвером: планировщик реле,
+// установленные уровни и пины, уже переведенные в режим выхода.
+// Настройки GPIO и устройства сюда не попадают - только маски
+class RelayOutputStage
+{
+public:
+    RelayOutputStage() : outputMask(0), preparedMask(0) {}
+
+    // Перевод пинов в режим выхода (уровень сбрасывается)
+    void configure(RelayOutputDriver &driver, uint64_t pins);
+    // Спрос demand для пинов в авто-режиме autoMask и принудительно включенные onMask - через
+    // планировщик; в драйвер уходят только пины configured, уровень которых изменился.
+    // Пины configured, еще не переведенные в режим выхода, настраиваются. Результат - уровни выходов
+    uint64_t apply(RelayOutputDriver &driver, uint64_t demand, uint64_t configured, uint64_t autoMask, uint64_t onMask,
+                   unsigned long now);
+
+    uint64_t outputs() const { return outputMask; }
+    const RelayScheduler &scheduler() const { return relayScheduler; }
+
+private:
+    RelayScheduler relayScheduler;
+    uint64_t outputMask;   // Уровни выходов, установленные последним apply
+    uint64_t preparedMask; // Пины, уже переведенные драйвером в режим выхода
+};
+
+#endif
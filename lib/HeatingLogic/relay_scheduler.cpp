@@ -0,0 +1,126 @@
+#include "relay_scheduler.h"
+
+RelayScheduler::RelayScheduler() : current(0),
+                                   switched(0),
+                                   queued(0),
+                                   lastSwitch(),
+                                   queuedSince(),
+                                   lastStart(0),
+                                   started(false),
+                                   nextChange(0),
+                                   starts(0),
+                                   stops(0),
+                                   peak(0)
+{
+}
+
+void RelayScheduler::waitFor(uint32_t ms)
+{
+    if (nextChange == 0 || ms < nextChange)
+    {
+        nextChange = ms;
+    }
+}
+
+uint64_t RelayScheduler::apply(uint64_t desired, uint64_t configured, unsigned long now)
+{
+    nextChange = 0;
+    desired &= configured;
+    current &= configured;
+
+    // Выключение: после минимального времени работы
+    uint64_t wantOff = current & ~desired;
+    while (wantOff)
+    {
+        int pin = __builtin_ctzll(wantOff);
+        wantOff &= wantOff - 1;
+        unsigned long onFor = now - lastSwitch[pin];
+        if (onFor >= RELAY_MIN_ON_TIME)
+        {
+            current &= ~(1ULL << pin);
+            lastSwitch[pin] = now;
+            switched |= 1ULL << pin;
+            stops++;
+        }
+        else
+        {
+            waitFor(RELAY_MIN_ON_TIME - onFor);
+        }
+    }
+
+    // Очередь на включение: новые запросы встают в конец, отмененные уходят
+    uint64_t wantOn = desired & ~current;
+    uint64_t added = wantOn & ~queued;
+    while (added)
+    {
+        int pin = __builtin_ctzll(added);
+        added &= added - 1;
+        queuedSince[pin] = now;
+    }
+    queued = wantOn;
+
+    // Готовые к включению: пауза после выключения выдержана
+    uint64_t ready = 0;
+    uint64_t pending = queued;
+    while (pending)
+    {
+        int pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        unsigned long offFor = now - lastSwitch[pin];
+        if (!(switched & (1ULL << pin)) || offFor >= RELAY_MIN_OFF_TIME)
+        {
+            ready |= 1ULL << pin;
+        }
+        else
+        {
+            waitFor(RELAY_MIN_OFF_TIME - offFor);
+        }
+    }
+    if (!ready)
+    {
+        return current;
+    }
+
+    unsigned long sinceStart = now - lastStart;
+    if (started && sinceStart < RELAY_STAGGER_DELAY)
+    {
+        waitFor(RELAY_STAGGER_DELAY - sinceStart);
+        return current;
+    }
+
+    // Группа включения: дольше всех ждущие, при равенстве - младший пин
+    uint8_t count = 0;
+    while (ready && count < RELAY_MAX_STARTS)
+    {
+        int oldest = -1;
+        uint64_t scan = ready;
+        while (scan)
+        {
+            int pin = __builtin_ctzll(scan);
+            scan &= scan - 1;
+            if (oldest < 0 || (long)(queuedSince[pin] - queuedSince[oldest]) < 0)
+            {
+                oldest = pin;
+            }
+        }
+        uint64_t bit = 1ULL << oldest;
+        ready &= ~bit;
+        queued &= ~bit;
+        current |= bit;
+        lastSwitch[oldest] = now;
+        switched |= bit;
+        count++;
+    }
+    starts += count;
+    if (count > peak)
+    {
+        peak = count;
+    }
+    lastStart = now;
+    started = true;
+    if (ready)
+    {
+        waitFor(RELAY_STAGGER_DELAY);
+    }
+    return current;
+}
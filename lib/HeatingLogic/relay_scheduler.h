@@ -0,0 +1,50 @@
+#ifndef RELAY_SCHEDULER_H
+#define RELAY_SCHEDULER_H
+
+#include <stdint.h>
+
+#define RELAY_MIN_ON_TIME 60000   // Минимальное время во включенном состоянии (мс)
+#define RELAY_MIN_OFF_TIME 60000  // Минимальная пауза между выключением и повторным включением (мс)
+#define RELAY_MAX_STARTS 2        // Сколько реле можно включить одновременно
+#define RELAY_STAGGER_DELAY 2000  // Пауза между группами включений (мс)
+#define RELAY_SCHEDULER_PINS 64   // Номера пинов 0..63, как в масках выходов
+
+// Планировщик переключения реле между решением управления и выходами.
+// Выключение ждет истечения минимального времени работы, включение - минимальной паузы;
+// готовые к включению пины встают в очередь и включаются группами не больше RELAY_MAX_STARTS
+// с интервалом RELAY_STAGGER_DELAY, раньше всех - дольше всех ждущие.
+// Без зависимостей от железа: время передается параметром
+class RelayScheduler
+{
+public:
+    RelayScheduler();
+
+    // Фактическое состояние выходов для желаемой маски desired на момент now.
+    // Пины вне configured не планируются и в результате сброшены
+    uint64_t apply(uint64_t desired, uint64_t configured, unsigned long now);
+    // Через сколько мс состояние может измениться без нового решения (0 - ожидающих изменений нет)
+    uint32_t nextChangeIn() const { return nextChange; }
+    uint64_t state() const { return current; }
+
+    // Статистика: включения, выключения, наибольшее число реле, включенных за один шаг
+    uint32_t startCount() const { return starts; }
+    uint32_t stopCount() const { return stops; }
+    uint8_t peakStarts() const { return peak; }
+
+private:
+    void waitFor(uint32_t ms);
+
+    uint64_t current;
+    uint64_t switched;                               // Пины, уже переключавшиеся (для них действуют минимальные времена)
+    uint64_t queued;                                 // Пины в очереди на включение
+    unsigned long lastSwitch[RELAY_SCHEDULER_PINS];  // Время последнего переключения пина
+    unsigned long queuedSince[RELAY_SCHEDULER_PINS]; // Время постановки в очередь
+    unsigned long lastStart;
+    bool started;
+    uint32_t nextChange;
+    uint32_t starts;
+    uint32_t stops;
+    uint8_t peak;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "history_format.h"
+#include <device_model.h>
+#include <stdio.h>
+#include <string.h>
+
+static void putLe16(uint8_t *out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void putLe32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+void formatHistoryBinaryHeader(uint8_t tier, uint16_t interval, uint32_t now, uint32_t from, uint32_t to,
+                               uint16_t deviceCount, uint8_t *out)
+{
+    memcpy(out, "HIST", 4);
+    out[4] = HISTORY_BINARY_VERSION;
+    out[5] = tier;
+    putLe16(out + 6, interval);
+    putLe32(out + 8, now);
+    putLe32(out + 12, from);
+    putLe32(out + 16, to);
+    putLe16(out + 20, deviceCount);
+    putLe16(out + 22, 0);
+}
+
+void formatHistoryBinaryDevice(uint64_t mac, bool hasPoints, uint8_t *out)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        out[i] = (mac >> (8 * (5 - i))) & 0xFF;
+    }
+    out[6] = hasPoints ? 1 : 0;
+}
+
+// Длина записанного snprintf, 0 - ошибка или не поместилось
+static size_t fittedLength(int written, size_t size)
+{
+    return written > 0 && (size_t)written < size ? (size_t)written : 0;
+}
+
+size_t formatHistoryJsonOpen(uint64_t mac, uint32_t interval, uint32_t now, uint32_t from, uint32_t to,
+                             char *buffer, size_t size)
+{
+    char text[MAC_ADDRESS_TEXT_SIZE];
+    formatMacAddress(mac, text);
+    return fittedLength(snprintf(buffer, size, "{\"mac\":\"%s\",\"res\":%lu,\"now\":%lu,\"from\":%lu,\"to\":%lu,\"points\":[",
+                                 text, (unsigned long)interval, (unsigned long)now, (unsigned long)from, (unsigned long)to),
+                        size);
+}
+
+size_t formatHistoryJsonPoint(const HistoryPoint &point, bool first, char *buffer, size_t size)
+{
+    return fittedLength(snprintf(buffer, size, "%s[%lu,%.2f,%.2f]", first ? "" : ",",
+                                 (unsigned long)point.time, point.sample.temperature / 100.0f, point.sample.humidity / 100.0f),
+                        size);
+}
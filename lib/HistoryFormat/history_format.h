@@ -0,0 +1,65 @@
+#ifndef HISTORY_FORMAT_H
+#define HISTORY_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sample_codec.h>
+
+// Форматы выгрузки истории /history (JSON) и /history.bin без зависимостей от железа
+
+// Значения слота: температура в сотых °C, влажность в сотых %
+struct HistorySample
+{
+    int16_t temperature;
+    int16_t humidity;
+};
+
+// Точка истории для чтения: время начала слота (с от загрузки) и значения
+struct HistoryPoint
+{
+    uint32_t time;
+    HistorySample sample;
+};
+
+// Двоичная выгрузка /history.bin. Все числа little-endian.
+// Заголовок, 24 байта:
+//   0  char[4] "HIST"
+//   4  uint8   версия HISTORY_BINARY_VERSION
+//   5  uint8   уровень истории
+//   6  uint16  интервал слота (с)
+//   8  uint32  now  - текущее время (с от загрузки)
+//   12 uint32  from
+//   16 uint32  to
+//   20 uint16  число устройств
+//   22 uint16  резерв (0)
+// Далее для каждого устройства:
+//   uint8[6] MAC (старший байт первый)
+//   uint8    1 - далее идет поток отсчетов, 0 - точек в диапазоне нет
+//   поток sample_codec.h (time - начало слота в с от загрузки, temperature/humidity - сотые,
+//   batteryV = 0), завершенный маркером конца и дополненный до байта
+#define HISTORY_BINARY_VERSION 2 // 2 - классы разностей значений 4/7/10/17 бит
+#define HISTORY_BINARY_HEADER_SIZE 24
+#define HISTORY_BINARY_DEVICE_SIZE 7
+
+void formatHistoryBinaryHeader(uint8_t tier, uint16_t interval, uint32_t now, uint32_t from, uint32_t to,
+                               uint16_t deviceCount, uint8_t *out);
+void formatHistoryBinaryDevice(uint64_t mac, bool hasPoints, uint8_t *out);
+
+// Отсчет потока sample_codec.h для точки истории
+inline CodecSample historyCodecSample(const HistoryPoint &point)
+{
+    return {point.time, point.sample.temperature, point.sample.humidity, 0};
+}
+
+// Ответ /history для одного устройства:
+// {"mac":"..","res":60,"now":N,"from":N,"to":N,"points":[[time,temperature,humidity],...]}
+// time - секунды от загрузки (начало слота), now - текущее время в тех же единицах
+#define HISTORY_JSON_RECORD_MAX 128 // Буфер одного фрагмента ответа
+#define HISTORY_JSON_CLOSE "]}"
+
+// Фрагменты ответа в буфер размером size, возвращают длину (0 - не поместилось)
+size_t formatHistoryJsonOpen(uint64_t mac, uint32_t interval, uint32_t now, uint32_t from, uint32_t to,
+                             char *buffer, size_t size);
+size_t formatHistoryJsonPoint(const HistoryPoint &point, bool first, char *buffer, size_t size);
+
+#endif
@@ -1,5 +1,7 @@
 #include <lcd_setting.h>
 #include <spiffs_setting.h>
+#include <persist_scheduler.h>
+#include <heating_control.h>
 #include <variables_info.h>
 #include <WiFi.h>
 #include <xiaomi_scanner.h>
@@ -47,6 +49,39 @@ const int gpioMenuOptionsCount = 3;
 
 float editHysteresisTemp = 1.5;
 
+// Снимок таблицы устройств, из которого рисуется текущий экран
+static const DeviceSnapshot *lcdSnapshot = nullptr;
+
+// Число GPIO и копия выбранного (если out задан). Список GPIO меняют веб-интерфейс и задача управления
+// под devicesLock, поэтому экран работает с копией; индекс за пределами списка сбрасывается
+static size_t selectedGpioCopy(GpioPin *out)
+{
+  size_t count = 0;
+  if (devicesLock.lock())
+  {
+    count = availableGpio.size();
+    if (gpioSelectionIndex >= count)
+    {
+      gpioSelectionIndex = 0;
+    }
+    if (out != nullptr && count > 0)
+    {
+      *out = availableGpio[gpioSelectionIndex];
+    }
+    devicesLock.unlock();
+  }
+  return count;
+}
+
+// Количество устройств в опубликованном снимке
+static size_t snapshotDeviceCount()
+{
+  const DeviceSnapshot *snapshot = deviceSnapshots.acquire();
+  size_t count = snapshot != nullptr ? snapshot->count : 0;
+  deviceSnapshots.release(snapshot);
+  return count;
+}
+
 // Функция для определения нажатой кнопки
 int readKeypad()
 {
@@ -160,17 +195,18 @@ void showDeviceList()
     displayText("WiFi: Disabled");
   }
 
-  if (devices.size() > 0)
+  if (lcdSnapshot != nullptr && lcdSnapshot->count > 0)
   {
     // Проверяем, не выходит ли индекс за пределы
-    if (deviceListIndex >= devices.size())
+    if (deviceListIndex >= lcdSnapshot->count)
     {
       deviceListIndex = 0;
     }
+    const DeviceSnapshotEntry &device = lcdSnapshot->entries[deviceListIndex];
     // Отображаем имя устройства
-    std::string deviceName = devices[deviceListIndex].name;
+    std::string deviceName = device.name;
 
-    if (!devices[deviceListIndex].isDataValid())
+    if (!device.isDataValid(millis()))
     {
       deviceName = "?" + deviceName;
     }
@@ -182,7 +218,7 @@ void showDeviceList()
     }
 
     deviceName += "-";
-    deviceName += String(devices[deviceListIndex].currentTemperature, 1).c_str();
+    deviceName += String(device.currentTemperature, 1).c_str();
     deviceName += "C";
     displayText(deviceName.c_str(), 0, 1);
   }
@@ -195,15 +231,15 @@ void showDeviceList()
 // Функция для отображения меню устройства
 void showDeviceMenu()
 {
-  if (devices.size() > 0)
+  if (lcdSnapshot != nullptr && lcdSnapshot->count > 0)
   {
     // Проверяем, не выходит ли индекс за пределы
-    if (deviceListIndex >= devices.size())
+    if (deviceListIndex >= lcdSnapshot->count)
     {
       return;
     }
     // Показываем имя устройства
-    std::string deviceName = devices[deviceListIndex].name;
+    std::string deviceName = lcdSnapshot->entries[deviceListIndex].name;
     if (deviceName.length() > 16)
     {
       deviceName = deviceName.substr(0, 16);
@@ -217,19 +253,20 @@ void showDeviceMenu()
 void showInfoDevice()
 {
   displayText("Info:");
-  if (devices.size() > 0)
+  if (lcdSnapshot != nullptr && lcdSnapshot->count > 0)
   {
     // Проверяем, не выходит ли индекс за пределы
-    if (deviceListIndex >= devices.size())
+    if (deviceListIndex >= lcdSnapshot->count)
     {
       return;
     }
+    const DeviceSnapshotEntry &device = lcdSnapshot->entries[deviceListIndex];
     // Отображаем имя устройства
-    std::string deviceInfo = String(devices[deviceListIndex].currentTemperature, 1).c_str(); // 4 symbols
+    std::string deviceInfo = String(device.currentTemperature, 1).c_str(); // 4 symbols
     deviceInfo += "C/";
-    deviceInfo += String(devices[deviceListIndex].targetTemperature, 1).c_str();
+    deviceInfo += String(device.targetTemperature, 1).c_str();
     deviceInfo += "C  ";
-    deviceInfo += String(devices[deviceListIndex].humidity).c_str();
+    deviceInfo += String(device.humidity).c_str();
     deviceInfo += "%";
     // Ограничиваем длину имени, чтобы оно поместилось на экране
     if (deviceInfo.length() > 10)
@@ -243,36 +280,41 @@ void showInfoDevice()
 // Функция для редактирования температуры
 void showDeviceTemperatureEdit()
 {
+  if (lcdSnapshot == nullptr || deviceListIndex >= lcdSnapshot->count)
+  {
+    return;
+  }
   displayText("Target temp:");
-  displayText(String(devices[deviceListIndex].targetTemperature) + " C  [+/-]", 0, 1);
+  displayText(String(lcdSnapshot->entries[deviceListIndex].targetTemperature) + " C  [+/-]", 0, 1);
 }
 
 // Функция для редактирования GPIO
 void showDeviceGpioEdit()
 {
   // Проверяем, есть ли доступные GPIO
-  if (availableGpio.size() == 0)
+  GpioPin gpio;
+  if (selectedGpioCopy(&gpio) == 0)
   {
     displayText("There are no available");
     displayText("GPIO pins", 0, 1);
     return;
   }
 
-  // Проверяем индекс
-  if (gpioSelectionIndex >= availableGpio.size())
+  if (lcdSnapshot == nullptr || deviceListIndex >= lcdSnapshot->count)
   {
-    gpioSelectionIndex = 0;
+    return;
   }
+  const DeviceSnapshotEntry &device = lcdSnapshot->entries[deviceListIndex];
 
   displayText("GPIO pins:");
 
-  displayText("PIN " + String(availableGpio[gpioSelectionIndex].pin), 0, 1);
+  displayText("PIN " + String(gpio.pin), 0, 1);
 
   // Проверяем, выбран ли этот GPIO для устройства
   bool isSelected = false;
-  for (uint8_t gpio : devices[deviceListIndex].gpioPins)
+  for (uint8_t i = 0; i < device.gpioCount; i++)
   {
-    if (gpio == availableGpio[gpioSelectionIndex].pin)
+    if (device.gpioPins[i] == gpio.pin)
     {
       isSelected = true;
       break;
@@ -284,14 +326,9 @@ void showDeviceGpioEdit()
 void showViewEdit()
 {
   displayText("Select GPIO");
-  if (availableGpio.size() > 0)
+  GpioPin gpio;
+  if (selectedGpioCopy(&gpio) > 0)
   {
-    // Проверяем, не выходит ли индекс за пределы
-    if (gpioSelectionIndex >= availableGpio.size())
-    {
-      return;
-    }
-    auto &gpio = availableGpio[gpioSelectionIndex];
     gpioMenuIndex = gpio.state;
     std::string gpioName = gpio.name;
     if (gpioName.length() > 16)
@@ -309,15 +346,11 @@ void showViewEdit()
 
 void showGpioEdit()
 {
-  if (availableGpio.size() > 0)
+  GpioPin gpio;
+  if (selectedGpioCopy(&gpio) > 0)
   {
-    // Проверяем, не выходит ли индекс за пределы
-    if (gpioSelectionIndex >= availableGpio.size())
-    {
-      return;
-    }
     // Показываем имя устройства
-    std::string gpioName = availableGpio[gpioSelectionIndex].name;
+    std::string gpioName = gpio.name;
     if (gpioName.length() > 16)
     {
       gpioName = gpioName.substr(0, 16);
@@ -337,13 +370,19 @@ void showEditHysteresis()
 // Функция для включения/выключения устройства
 void showDeviceEnabledEdit()
 {
+  if (lcdSnapshot == nullptr || deviceListIndex >= lcdSnapshot->count)
+  {
+    return;
+  }
   displayText("Device:");
-  displayText((devices[deviceListIndex].enabled ? "Enabled" : "Disabled") + String(" [+/-]"), 0, 1);
+  displayText((lcdSnapshot->entries[deviceListIndex].enabled ? "Enabled" : "Disabled") + String(" [+/-]"), 0, 1);
 }
 
 // Обновление LCD дисплея в зависимости от текущего состояния меню
 void updateMainScreenLCD()
 {
+  // Экраны рисуются из опубликованного снимка, таблица устройств не блокируется
+  lcdSnapshot = deviceSnapshots.acquire();
   switch (currentMenu)
   {
   case OTA_UPDATE:
@@ -376,6 +415,8 @@ void updateMainScreenLCD()
     showDeviceEnabledEdit();
     break;
   }
+  deviceSnapshots.release(lcdSnapshot);
+  lcdSnapshot = nullptr;
 }
 
 void disabledButtonForOta(bool isUpdate)
@@ -391,6 +432,20 @@ void disabledButtonForOta(bool isUpdate)
   updateMainScreenLCD();
 }
 
+// Пометка редактируемого устройства для записи во flash
+static void markSelectedDeviceDirty()
+{
+  if (devicesLock.lock())
+  {
+    if (deviceListIndex < devices.size())
+    {
+      markDeviceConfigDirty(devices[deviceListIndex]);
+      requestDeviceControl(devices[deviceListIndex]);
+    }
+    devicesLock.unlock();
+  }
+}
+
 // Обработка нажатий кнопок
 void handleButtons()
 {
@@ -424,6 +479,8 @@ void handleButtons()
   lastButtonTime = currentTime;
   lastButton = pressedButton;
 
+  size_t deviceCount = snapshotDeviceCount();
+
   // Обработка нажатий в зависимости от текущего состояния меню
   switch (currentMenu)
   {
@@ -431,17 +488,17 @@ void handleButtons()
     break;
   case DEVICE_LIST:
     // В списке устройств
-    if (devices.size() > 0)
+    if (deviceCount > 0)
     {
       if (pressedButton == BUTTON_UP)
       {
         // Предыдущее устройство
-        deviceListIndex = (deviceListIndex + devices.size() - 1) % devices.size();
+        deviceListIndex = (deviceListIndex + deviceCount - 1) % deviceCount;
       }
       else if (pressedButton == BUTTON_DOWN)
       {
         // Следующее устройство
-        deviceListIndex = (deviceListIndex + 1) % devices.size();
+        deviceListIndex = (deviceListIndex + 1) % deviceCount;
       }
       else if (pressedButton == BUTTON_RIGHT)
       {
@@ -507,25 +564,37 @@ void handleButtons()
 
   case DEVICE_EDIT_TEMPERATURE:
     // Редактирование температуры
-    if (pressedButton == BUTTON_UP)
+    if (pressedButton == BUTTON_UP && devicesLock.lock())
     {
       // Увеличение температуры
-      devices[deviceListIndex].targetTemperature += 0.5;
+      if (deviceListIndex < devices.size())
+      {
+        devices[deviceListIndex].targetTemperature += 0.5;
+        devices.touch(devices[deviceListIndex]);
+        deviceSnapshots.publish(devices);
+      }
+      devicesLock.unlock();
     }
-    else if (pressedButton == BUTTON_DOWN)
+    else if (pressedButton == BUTTON_DOWN && devicesLock.lock())
     {
       // Уменьшение температуры
-      devices[deviceListIndex].targetTemperature -= 0.5;
-      if (devices[deviceListIndex].targetTemperature < 0)
+      if (deviceListIndex < devices.size())
       {
-        devices[deviceListIndex].targetTemperature = 0;
+        devices[deviceListIndex].targetTemperature -= 0.5;
+        if (devices[deviceListIndex].targetTemperature < 0)
+        {
+          devices[deviceListIndex].targetTemperature = 0;
+        }
+        devices.touch(devices[deviceListIndex]);
+        deviceSnapshots.publish(devices);
       }
+      devicesLock.unlock();
     }
     else if (pressedButton == BUTTON_RIGHT)
     {
       logAndSend("Нажата кнопка SELECT, сохраняем изменения температуры");
       // Сохранение и возврат в меню устройства
-      saveClientsToFile();
+      markSelectedDeviceDirty();
       currentMenu = DEVICE_MENU;
     }
     else if (pressedButton == BUTTON_LEFT)
@@ -537,43 +606,42 @@ void handleButtons()
 
   case DEVICE_EDIT_GPIO:
     // Редактирование GPIO
-    if (availableGpio.size() > 0)
+    if (size_t gpioCount = selectedGpioCopy(nullptr))
     {
       if (pressedButton == BUTTON_UP)
       {
         // Предыдущий GPIO
-        gpioSelectionIndex = (gpioSelectionIndex + availableGpio.size() - 1) % availableGpio.size();
+        gpioSelectionIndex = (gpioSelectionIndex + gpioCount - 1) % gpioCount;
       }
       else if (pressedButton == BUTTON_DOWN)
       {
         // Следующий GPIO
-        gpioSelectionIndex = (gpioSelectionIndex + 1) % availableGpio.size();
+        gpioSelectionIndex = (gpioSelectionIndex + 1) % gpioCount;
       }
-      else if (pressedButton == BUTTON_RIGHT)
+      else if (pressedButton == BUTTON_RIGHT && devicesLock.lock())
       {
-        // Выбор/отмена выбора текущего GPIO
-        uint8_t selectedGpio = availableGpio[gpioSelectionIndex].pin;
-        bool isSelected = false;
-
-        // Проверяем, выбран ли уже этот GPIO
-        for (size_t i = 0; i < devices[deviceListIndex].gpioPins.size(); i++)
+        if (deviceListIndex < devices.size() && gpioSelectionIndex < availableGpio.size())
         {
-          if (devices[deviceListIndex].gpioPins[i] == selectedGpio)
+          // Выбор/отмена выбора текущего GPIO
+          std::vector<uint8_t> &gpioPins = devices[deviceListIndex].gpioPins;
+          uint8_t selectedGpio = availableGpio[gpioSelectionIndex].pin;
+          auto it = std::find(gpioPins.begin(), gpioPins.end(), selectedGpio);
+          // Если выбран, удаляем его, иначе добавляем
+          if (it != gpioPins.end())
           {
-            // Если выбран, удаляем его
-            devices[deviceListIndex].gpioPins.erase(devices[deviceListIndex].gpioPins.begin() + i);
-            isSelected = true;
-            break;
+            gpioPins.erase(it);
           }
+          else
+          {
+            gpioPins.push_back(selectedGpio);
+          }
+          devices.touch(devices[deviceListIndex]);
+          // Серия переключений GPIO объединяется планировщиком в одну запись
+          markDeviceConfigDirty(devices[deviceListIndex]);
+          deviceSnapshots.publish(devices);
         }
-        // Если не был выбран, добавляем
-        if (!isSelected)
-        {
-          devices[deviceListIndex].gpioPins.push_back(selectedGpio);
-        }
+        devicesLock.unlock();
         logAndSend("Нажата кнопка SELECT при редактироании GPIO, сохраняем результаты");
-        // Сохраняем изменения
-        saveClientsToFile();
       }
       else if (pressedButton == BUTTON_LEFT)
       {
@@ -590,16 +658,22 @@ void handleButtons()
 
   case DEVICE_EDIT_ENABLED:
     // Включение/выключение устройства
-    if (pressedButton == BUTTON_UP || pressedButton == BUTTON_DOWN)
+    if ((pressedButton == BUTTON_UP || pressedButton == BUTTON_DOWN) && devicesLock.lock())
     {
       // Переключение состояния
-      devices[deviceListIndex].enabled = !devices[deviceListIndex].enabled;
+      if (deviceListIndex < devices.size())
+      {
+        devices[deviceListIndex].enabled = !devices[deviceListIndex].enabled;
+        devices.touch(devices[deviceListIndex]);
+        deviceSnapshots.publish(devices);
+      }
+      devicesLock.unlock();
     }
     else if (pressedButton == BUTTON_RIGHT)
     {
       logAndSend("Нажата кнопка BUTTON_RIGHT при изменении доступности устройства, сохраняем результаты");
       // Сохраняем изменения
-      saveClientsToFile();
+      markSelectedDeviceDirty();
       currentMenu = DEVICE_MENU;
     }
     else if (pressedButton == BUTTON_LEFT)
@@ -610,17 +684,17 @@ void handleButtons()
     break;
 
   case VIEW_GPIO:
-    if (availableGpio.size() > 0)
+    if (size_t gpioCount = selectedGpioCopy(nullptr))
     {
       if (pressedButton == BUTTON_UP)
       {
         // Предыдущий GPIO
-        gpioSelectionIndex = (gpioSelectionIndex + availableGpio.size() - 1) % availableGpio.size();
+        gpioSelectionIndex = (gpioSelectionIndex + gpioCount - 1) % gpioCount;
       }
       else if (pressedButton == BUTTON_DOWN)
       {
         // Следующий GPIO
-        gpioSelectionIndex = (gpioSelectionIndex + 1) % availableGpio.size();
+        gpioSelectionIndex = (gpioSelectionIndex + 1) % gpioCount;
       }
       else if (pressedButton == BUTTON_RIGHT)
       {
@@ -653,10 +727,20 @@ void handleButtons()
     }
     else if (pressedButton == BUTTON_RIGHT)
     {
-      if (availableGpio[gpioSelectionIndex].state != gpioMenuIndex)
+      bool changed = false;
+      if (devicesLock.lock())
+      {
+        if (gpioSelectionIndex < availableGpio.size() && availableGpio[gpioSelectionIndex].state != gpioMenuIndex)
+        {
+          availableGpio[gpioSelectionIndex].state = gpioMenuIndex;
+          changed = true;
+        }
+        devicesLock.unlock();
+      }
+      if (changed)
       {
-        availableGpio[gpioSelectionIndex].state = gpioMenuIndex;
-        saveGpioToFile();
+        markGpioConfigDirty();
+        requestControlSweep();
       }
       currentMenu = VIEW_GPIO;
     }
@@ -687,7 +771,8 @@ void handleButtons()
     {
       logAndSend("Нажата кнопка SELECT, сохраняем гестерезис температуры");
       hysteresisTemp = editHysteresisTemp;
-      saveServerSetting();
+      markServerSettingDirty();
+      requestControlSweep();
     }
     else if (pressedButton == BUTTON_LEFT)
     {
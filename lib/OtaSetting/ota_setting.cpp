@@ -5,6 +5,8 @@
 #include "variables_info.h"
 #include "lcd_setting.h"
 #include "web_server_setting.h"
+#include "persist_scheduler.h"
+#include "heating_control.h"
 
 // Инициализация переменных состояния
 OtaState otaState = OTA_STATE_IDLE;
@@ -34,6 +36,10 @@ bool initOTA()
     ArduinoOTA.onStart([]()
                        {
                         otaActive = true;
+        // Записываем накопленные изменения до начала перезаписи flash
+        flushPersistence();
+        // Задача управления спит до события, будим ее, чтобы она перешла в режим OTA
+        wakeHeatingControl();
         String type;
         if (ArduinoOTA.getCommand() == U_FLASH) {
             type = "sketch";
@@ -0,0 +1,320 @@
+#include <persist_codec.h>
+#include <string.h>
+#include <algorithm>
+
+uint32_t persistCrc32(const uint8_t *data, size_t length, uint32_t crc)
+{
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// Запись/чтение little-endian полей ++++++++++++++++++
+static void putU8(std::vector<uint8_t> &out, uint8_t value)
+{
+  out.push_back(value);
+}
+
+static void putU16(std::vector<uint8_t> &out, uint16_t value)
+{
+  out.push_back(value & 0xFF);
+  out.push_back(value >> 8);
+}
+
+static void putU32(std::vector<uint8_t> &out, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    out.push_back((value >> (8 * i)) & 0xFF);
+  }
+}
+
+static void putF32(std::vector<uint8_t> &out, float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  putU32(out, bits);
+}
+
+// Имя длиннее DEVICE_NAME_MAX (только из старого JSON) обрезается по границе символа UTF-8
+static void putName(std::vector<uint8_t> &out, const std::string &name)
+{
+  size_t length = std::min(name.size(), (size_t)DEVICE_NAME_MAX);
+  while (length > 0 && length < name.size() && (name[length] & 0xC0) == 0x80)
+  {
+    length--;
+  }
+  putU8(out, (uint8_t)length);
+  out.insert(out.end(), name.begin(), name.begin() + length);
+}
+
+// Последовательное чтение с контролем границ: после выхода за конец ok() возвращает false
+class PersistReader
+{
+public:
+  PersistReader(const uint8_t *data, size_t length) : data(data), length(length), pos(0), valid(true) {}
+
+  bool ok() const { return valid; }
+  bool atEnd() const { return pos == length; }
+
+  const uint8_t *take(size_t count)
+  {
+    if (!valid || length - pos < count)
+    {
+      valid = false;
+      return nullptr;
+    }
+    const uint8_t *p = data + pos;
+    pos += count;
+    return p;
+  }
+
+  uint8_t u8()
+  {
+    const uint8_t *p = take(1);
+    return p ? p[0] : 0;
+  }
+
+  uint16_t u16()
+  {
+    const uint8_t *p = take(2);
+    return p ? (uint16_t)(p[0] | (p[1] << 8)) : 0;
+  }
+
+  uint32_t u32()
+  {
+    const uint8_t *p = take(4);
+    return p ? (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24) : 0;
+  }
+
+  float f32()
+  {
+    uint32_t bits = u32();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  std::string name()
+  {
+    uint8_t count = u8();
+    const uint8_t *p = take(count);
+    return p ? std::string((const char *)p, count) : std::string();
+  }
+
+private:
+  const uint8_t *data;
+  size_t length;
+  size_t pos;
+  bool valid;
+};
+
+// Заголовок ++++++++++++++++++++++++++++++++++++++++++
+static void beginBlob(std::vector<uint8_t> &out, uint8_t kind)
+{
+  out.clear();
+  out.resize(PERSIST_HEADER_SIZE);
+  out[2] = kind;
+  out[3] = PERSIST_VERSION;
+}
+
+static void finishBlob(std::vector<uint8_t> &out, uint16_t count)
+{
+  uint16_t length = (uint16_t)(out.size() - PERSIST_HEADER_SIZE);
+  uint8_t header[PERSIST_HEADER_SIZE] = {
+      PERSIST_MAGIC & 0xFF, PERSIST_MAGIC >> 8, out[2], out[3],
+      (uint8_t)(count & 0xFF), (uint8_t)(count >> 8),
+      (uint8_t)(length & 0xFF), (uint8_t)(length >> 8)};
+  uint32_t crc = persistCrc32(header, PERSIST_HEADER_CRC_SIZE);
+  crc = persistCrc32(out.data() + PERSIST_HEADER_SIZE, length, crc);
+  header[8] = crc & 0xFF;
+  header[9] = (crc >> 8) & 0xFF;
+  header[10] = (crc >> 16) & 0xFF;
+  header[11] = crc >> 24;
+  memcpy(out.data(), header, sizeof(header));
+}
+
+bool isPersistBlob(const uint8_t *data, size_t length, uint8_t kind)
+{
+  return length >= PERSIST_HEADER_SIZE &&
+         (data[0] | (data[1] << 8)) == PERSIST_MAGIC &&
+         data[2] == kind;
+}
+
+// Проверка заголовка и CRC, возвращает число записей через count.
+// В v1 count не защищен CRC, поэтому он проверяется по длине данных до того, как под него выделяется память
+static bool openBlob(const uint8_t *data, size_t length, uint8_t kind, size_t minRecordSize, uint16_t &count)
+{
+  if (!isPersistBlob(data, length, kind))
+  {
+    return false;
+  }
+  PersistReader header(data + 3, PERSIST_HEADER_SIZE - 3);
+  uint8_t version = header.u8();
+  count = header.u16();
+  uint16_t payloadLength = header.u16();
+  uint32_t crc = header.u32();
+  if ((version != PERSIST_VERSION && version != PERSIST_VERSION_V1) || payloadLength != length - PERSIST_HEADER_SIZE ||
+      (size_t)count * minRecordSize > payloadLength)
+  {
+    return false;
+  }
+  uint32_t expected = version == PERSIST_VERSION ? persistCrc32(data, PERSIST_HEADER_CRC_SIZE) : 0;
+  return persistCrc32(data + PERSIST_HEADER_SIZE, payloadLength, expected) == crc;
+}
+
+// Устройства +++++++++++++++++++++++++++++++++++++++++
+static void putMac(std::vector<uint8_t> &out, uint64_t mac)
+{
+  for (int i = 5; i >= 0; i--)
+  {
+    putU8(out, (mac >> (8 * i)) & 0xFF);
+  }
+}
+
+static void putDevice(std::vector<uint8_t> &out, const DeviceData &device)
+{
+  putMac(out, device.mac);
+  putU8(out, (device.enabled ? 1 : 0) | ((device.controllerType & 0x03) << 1));
+  putF32(out, device.targetTemperature);
+  putU32(out, device.totalHeatingTime);
+  putF32(out, device.humidity);
+  putU8(out, device.battery);
+  putU16(out, device.batteryV);
+  uint8_t gpioCount = (uint8_t)std::min(device.gpioPins.size(), (size_t)255);
+  putU8(out, gpioCount);
+  out.insert(out.end(), device.gpioPins.begin(), device.gpioPins.begin() + gpioCount);
+  putName(out, device.name);
+}
+
+void encodeDevicesBlob(const DeviceRegistry &registry, std::vector<uint8_t> &out)
+{
+  beginBlob(out, PERSIST_KIND_DEVICES);
+  for (const auto &device : registry)
+  {
+    putDevice(out, device);
+  }
+  finishBlob(out, (uint16_t)registry.size());
+}
+
+void encodeDeviceBlob(const DeviceData &device, std::vector<uint8_t> &out)
+{
+  beginBlob(out, PERSIST_KIND_DEVICES);
+  putDevice(out, device);
+  finishBlob(out, 1);
+}
+
+void encodeDeviceIndexBlob(const DeviceRegistry &registry, std::vector<uint8_t> &out)
+{
+  beginBlob(out, PERSIST_KIND_DEVICE_INDEX);
+  for (const auto &device : registry)
+  {
+    putMac(out, device.mac);
+  }
+  finishBlob(out, (uint16_t)registry.size());
+}
+
+bool decodeDeviceIndexBlob(const uint8_t *data, size_t length, std::vector<uint64_t> &out)
+{
+  uint16_t count;
+  if (!openBlob(data, length, PERSIST_KIND_DEVICE_INDEX, PERSIST_INDEX_RECORD_SIZE, count))
+  {
+    return false;
+  }
+  PersistReader reader(data + PERSIST_HEADER_SIZE, length - PERSIST_HEADER_SIZE);
+  out.clear();
+  out.reserve(count);
+  for (uint16_t i = 0; i < count && reader.ok(); i++)
+  {
+    const uint8_t *mac = reader.take(6);
+    if (mac)
+    {
+      out.push_back(macFromBytes(mac));
+    }
+  }
+  return reader.ok() && reader.atEnd();
+}
+
+bool decodeDevicesBlob(const uint8_t *data, size_t length, std::vector<DeviceData> &out)
+{
+  uint16_t count;
+  if (!openBlob(data, length, PERSIST_KIND_DEVICES, PERSIST_DEVICE_RECORD_MIN, count))
+  {
+    return false;
+  }
+  PersistReader reader(data + PERSIST_HEADER_SIZE, length - PERSIST_HEADER_SIZE);
+  out.clear();
+  out.reserve(count);
+  for (uint16_t i = 0; i < count && reader.ok(); i++)
+  {
+    const uint8_t *mac = reader.take(6);
+    DeviceData device("", mac ? macFromBytes(mac) : 0);
+    uint8_t flags = reader.u8();
+    device.enabled = (flags & 1) != 0;
+    device.controllerType = (flags >> 1) & 0x03;
+    if (device.controllerType >= CONTROLLER_TYPE_COUNT)
+    {
+      device.controllerType = CONTROLLER_HYSTERESIS;
+    }
+    device.targetTemperature = reader.f32();
+    device.totalHeatingTime = reader.u32();
+    device.humidity = reader.f32();
+    device.battery = reader.u8();
+    device.batteryV = reader.u16();
+    uint8_t gpioCount = reader.u8();
+    const uint8_t *pins = reader.take(gpioCount);
+    if (pins)
+    {
+      device.gpioPins.assign(pins, pins + gpioCount);
+    }
+    device.name = reader.name();
+    // Показаний после загрузки еще нет: устройство оффлайн до первого пакета датчика
+    device.isOnline = false;
+    device.currentTemperature = device.targetTemperature;
+    out.push_back(device);
+  }
+  return reader.ok() && reader.atEnd();
+}
+
+// GPIO +++++++++++++++++++++++++++++++++++++++++++++++
+void encodeGpioBlob(const std::vector<GpioPin> &gpios, std::vector<uint8_t> &out)
+{
+  beginBlob(out, PERSIST_KIND_GPIO);
+  for (const auto &gpio : gpios)
+  {
+    putU8(out, gpio.pin);
+    putU8(out, gpio.state);
+    putU32(out, gpio.totalHeatingTime);
+    putName(out, gpio.name);
+  }
+  finishBlob(out, (uint16_t)gpios.size());
+}
+
+bool decodeGpioBlob(const uint8_t *data, size_t length, std::vector<GpioPin> &out)
+{
+  uint16_t count;
+  if (!openBlob(data, length, PERSIST_KIND_GPIO, PERSIST_GPIO_RECORD_MIN, count))
+  {
+    return false;
+  }
+  PersistReader reader(data + PERSIST_HEADER_SIZE, length - PERSIST_HEADER_SIZE);
+  out.clear();
+  out.reserve(count);
+  for (uint16_t i = 0; i < count && reader.ok(); i++)
+  {
+    GpioPin gpio;
+    gpio.pin = reader.u8();
+    gpio.state = reader.u8();
+    gpio.totalHeatingTime = reader.u32();
+    gpio.name = reader.name();
+    out.push_back(gpio);
+  }
+  return reader.ok() && reader.atEnd();
+}
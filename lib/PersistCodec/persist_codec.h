@@ -0,0 +1,56 @@
+#ifndef PERSIST_CODEC_H
+#define PERSIST_CODEC_H
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <device_model.h>
+
+// Двоичный формат blob'ов в NVS (devices_blob, gpio_blob).
+// Заголовок, 12 байт, little-endian:
+//   0  uint16 magic   PERSIST_MAGIC
+//   2  uint8  kind    PERSIST_KIND_DEVICES / PERSIST_KIND_GPIO
+//   3  uint8  version PERSIST_VERSION
+//   4  uint16 count   число записей
+//   6  uint16 length  длина данных после заголовка
+//   8  uint32 crc32   CRC-32 (IEEE) байт 0-7 заголовка и данных после него (v1 - только данных)
+// Запись устройства (v1):
+//   mac[6], flags u8 (бит 0 - enabled, биты 1-2 - алгоритм управления), target_temp f32, total_heating u32,
+//   humidity f32, battery u8, batteryV u16, gpio_count u8, gpio[gpio_count] u8,
+//   name_len u8, name[name_len]
+// Индекс устройств (v1): mac[6] на каждое устройство
+// Запись GPIO (v1):
+//   pin u8, state u8, total_heating u32, name_len u8, name[name_len]
+// Имена длиннее 255 байт обрезаются. Blob'ы v1 читаются, записываются всегда v2 (формат записей тот же).
+#define PERSIST_MAGIC 0x4254 // "TB"
+#define PERSIST_VERSION 2
+#define PERSIST_VERSION_V1 1 // CRC без заголовка
+#define PERSIST_KIND_DEVICES 1
+#define PERSIST_KIND_GPIO 2
+#define PERSIST_KIND_DEVICE_INDEX 3
+#define PERSIST_HEADER_SIZE 12
+#define PERSIST_HEADER_CRC_SIZE 8 // Байты заголовка, входящие в CRC
+// Наименьший размер записи: число записей из заголовка не может превышать длину данных / размер
+#define PERSIST_DEVICE_RECORD_MIN 24
+#define PERSIST_GPIO_RECORD_MIN 7
+#define PERSIST_INDEX_RECORD_SIZE 6
+
+// CRC-32 (полином 0xEDB88320), crc - значение предыдущего вызова или 0
+uint32_t persistCrc32(const uint8_t *data, size_t length, uint32_t crc = 0);
+
+// Blob начинается с двоичного заголовка нужного типа (иначе это старый JSON)
+bool isPersistBlob(const uint8_t *data, size_t length, uint8_t kind);
+
+// Кодирование записей в out (out очищается)
+void encodeDevicesBlob(const DeviceRegistry &registry, std::vector<uint8_t> &out);
+void encodeGpioBlob(const std::vector<GpioPin> &gpios, std::vector<uint8_t> &out);
+// Одно устройство - blob типа PERSIST_KIND_DEVICES с одной записью (отдельный ключ NVS на устройство)
+void encodeDeviceBlob(const DeviceData &device, std::vector<uint8_t> &out);
+// Список MAC-адресов устройств реестра
+void encodeDeviceIndexBlob(const DeviceRegistry &registry, std::vector<uint8_t> &out);
+
+// Декодирование с проверкой заголовка, длины и CRC. false - blob поврежден или неизвестной версии
+bool decodeDevicesBlob(const uint8_t *data, size_t length, std::vector<DeviceData> &out);
+bool decodeGpioBlob(const uint8_t *data, size_t length, std::vector<GpioPin> &out);
+bool decodeDeviceIndexBlob(const uint8_t *data, size_t length, std::vector<uint64_t> &out);
+
+#endif
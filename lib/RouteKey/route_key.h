@@ -0,0 +1,47 @@
+#ifndef ROUTE_KEY_H
+#define ROUTE_KEY_H
+
+#include <stdint.h>
+#include <string.h>
+
+// FNV-1a пути; constexpr, чтобы ключи маршрутов были метками case
+constexpr uint32_t routeHash(const char *text, uint32_t hash = 2166136261u)
+{
+    return *text == 0 ? hash : routeHash(text + 1, (hash ^ (uint8_t)*text) * 16777619u);
+}
+
+// Ключ маршрута: метод входит в начальное значение хэша
+constexpr uint32_t routeKey(uint8_t method, const char *path)
+{
+    return routeHash(path, 2166136261u ^ method);
+}
+
+// Описание маршрутов задается списком ROUTE(имя, метод, путь, тип), где имя - функция-обработчик.
+// Из одного списка строятся индексы, таблица и switch по ключам:
+//   enum { WEB_ROUTES(ROUTE_INDEX) ROUTE_COUNT };
+//   static const Route routes[] = {WEB_ROUTES(ROUTE_ENTRY)};
+//   switch (key) { WEB_ROUTES(ROUTE_CASE) }
+// Совпадение ключей двух маршрутов - ошибка компиляции (повтор метки case)
+#define ROUTE_INDEX(name, method, path, response) ROUTE_INDEX_##name,
+#define ROUTE_CASE(name, method, path, response) \
+    case routeKey(method, path):                 \
+        return ROUTE_INDEX_##name;
+
+// Поиск индекса маршрута по ключу, -1 - ключ неизвестен
+typedef int (*RouteLookup)(uint32_t key);
+
+// Маршрут по методу и пути: switch по ключу, затем сверка метода и строки,
+// так как ключ мог совпасть у неизвестного запроса. RouteEntry - запись с полями method и path
+template <typename RouteEntry>
+const RouteEntry *findRoute(const RouteEntry *routes, RouteLookup lookup, uint8_t method, const char *path)
+{
+    int index = lookup(routeKey(method, path));
+    if (index < 0)
+    {
+        return nullptr;
+    }
+    const RouteEntry *route = &routes[index];
+    return route->method == method && strcmp(route->path, path) == 0 ? route : nullptr;
+}
+
+#endif
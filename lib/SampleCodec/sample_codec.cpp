@@ -0,0 +1,324 @@
+#include "sample_codec.h"
+#include <string.h>
+#include <algorithm>
+
+// zigzag: 0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ...
+static uint32_t zigzagEncode(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t zigzagDecode(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Кодировщик ++++++++++++++++++++++++++++++++++++++++
+SampleEncoder::SampleEncoder() : length(0),
+                                 bitAccumulator(0),
+                                 bitCount(0),
+                                 totalBits(0),
+                                 started(false),
+                                 finished(false),
+                                 previous(),
+                                 previousDelta(0)
+{
+}
+
+void SampleEncoder::writeBits(uint64_t value, uint8_t count)
+{
+    totalBits += count;
+    while (count > 0)
+    {
+        uint8_t take = std::min<uint8_t>(count, 8 - bitCount);
+        count -= take;
+        bitAccumulator = (bitAccumulator << take) | ((value >> count) & ((1u << take) - 1));
+        bitCount += take;
+        if (bitCount == 8)
+        {
+            buffer[length++] = (uint8_t)bitAccumulator;
+            bitAccumulator = 0;
+            bitCount = 0;
+        }
+    }
+}
+
+void SampleEncoder::writeTimestamp(int64_t dod)
+{
+    if (dod == 0)
+    {
+        writeBits(0, 1);
+    }
+    else if (dod >= -63 && dod <= 64)
+    {
+        writeBits(0x2, 2);
+        writeBits((uint64_t)(dod + 63), 7);
+    }
+    else if (dod >= -255 && dod <= 256)
+    {
+        writeBits(0x6, 3);
+        writeBits((uint64_t)(dod + 255), 9);
+    }
+    else if (dod >= -2047 && dod <= 2048)
+    {
+        writeBits(0xE, 4);
+        writeBits((uint64_t)(dod + 2047), 12);
+    }
+    else
+    {
+        writeBits(0xF, 4);
+        writeBits((uint32_t)(int32_t)dod, 32);
+    }
+}
+
+void SampleEncoder::writeValue(int32_t delta)
+{
+    uint32_t zigzag = zigzagEncode(delta);
+    if (zigzag == 0)
+    {
+        writeBits(0, 1);
+    }
+    else if (zigzag < 16)
+    {
+        writeBits(0x2, 2);
+        writeBits(zigzag, 4);
+    }
+    else if (zigzag < 128)
+    {
+        writeBits(0x6, 3);
+        writeBits(zigzag, 7);
+    }
+    else if (zigzag < 1024)
+    {
+        writeBits(0xE, 4);
+        writeBits(zigzag, 10);
+    }
+    else
+    {
+        writeBits(0xF, 4);
+        writeBits(zigzag, 17);
+    }
+}
+
+bool SampleEncoder::append(const CodecSample &sample)
+{
+    if (finished || sizeof(buffer) - length < SAMPLE_CODEC_MAX_SAMPLE_BYTES)
+    {
+        return false;
+    }
+    if (!started)
+    {
+        writeBits(sample.time, 32);
+        writeBits((uint16_t)sample.temperature, 16);
+        writeBits((uint16_t)sample.humidity, 16);
+        writeBits(sample.batteryV, 16);
+        started = true;
+    }
+    else
+    {
+        int64_t delta = (int64_t)sample.time - previous.time;
+        int64_t dod = delta - previousDelta;
+        // INT32_MIN зарезервирован под маркер конца; скачки времени больше 2^31 с на практике не встречаются
+        if (dod <= INT32_MIN || dod > INT32_MAX)
+        {
+            dod = dod < 0 ? INT32_MIN + 1 : INT32_MAX;
+            delta = previousDelta + dod;
+        }
+        writeTimestamp(dod);
+        writeValue((int32_t)sample.temperature - previous.temperature);
+        writeValue((int32_t)sample.humidity - previous.humidity);
+        writeValue((int32_t)sample.batteryV - previous.batteryV);
+        previousDelta = delta;
+    }
+    previous = sample;
+    return true;
+}
+
+bool SampleEncoder::finish()
+{
+    if (finished)
+    {
+        return true;
+    }
+    if (sizeof(buffer) - length < SAMPLE_CODEC_MAX_SAMPLE_BYTES)
+    {
+        return false;
+    }
+    if (started)
+    {
+        writeBits(0xF, 4);
+        writeBits(0x80000000u, 32);
+    }
+    if (bitCount > 0)
+    {
+        writeBits(0, 8 - bitCount);
+    }
+    finished = true;
+    return true;
+}
+
+size_t SampleEncoder::read(uint8_t *out, size_t maxLen)
+{
+    size_t count = std::min(length, maxLen);
+    memcpy(out, buffer, count);
+    memmove(buffer, buffer + count, length - count);
+    length -= count;
+    return count;
+}
+
+// Декодер +++++++++++++++++++++++++++++++++++++++++++
+SampleDecoder::SampleDecoder(const uint8_t *data, size_t length) : data(data),
+                                                                   length(length),
+                                                                   bitPosition(0),
+                                                                   started(false),
+                                                                   done(false),
+                                                                   failed(false),
+                                                                   previous(),
+                                                                   previousDelta(0)
+{
+}
+
+bool SampleDecoder::readBits(uint8_t count, uint32_t &value)
+{
+    if (bitPosition + count > length * 8)
+    {
+        return false;
+    }
+    value = 0;
+    for (uint8_t i = 0; i < count; i++, bitPosition++)
+    {
+        value = (value << 1) | ((data[bitPosition >> 3] >> (7 - (bitPosition & 7))) & 1);
+    }
+    return true;
+}
+
+bool SampleDecoder::readTimestamp(int64_t &dod, bool &end)
+{
+    uint32_t bit;
+    uint32_t raw;
+    uint8_t prefix = 0;
+    // Число единиц префикса (не больше 4)
+    while (prefix < 4)
+    {
+        if (!readBits(1, bit))
+        {
+            return false;
+        }
+        if (bit == 0)
+        {
+            break;
+        }
+        prefix++;
+    }
+    end = false;
+    switch (prefix)
+    {
+    case 0:
+        dod = 0;
+        return true;
+    case 1:
+        if (!readBits(7, raw))
+            return false;
+        dod = (int64_t)raw - 63;
+        return true;
+    case 2:
+        if (!readBits(9, raw))
+            return false;
+        dod = (int64_t)raw - 255;
+        return true;
+    case 3:
+        if (!readBits(12, raw))
+            return false;
+        dod = (int64_t)raw - 2047;
+        return true;
+    default:
+        if (!readBits(32, raw))
+            return false;
+        end = raw == 0x80000000u;
+        dod = (int32_t)raw;
+        return true;
+    }
+}
+
+bool SampleDecoder::readValue(int32_t &delta)
+{
+    uint32_t bit;
+    uint32_t raw;
+    uint8_t prefix = 0;
+    while (prefix < 4)
+    {
+        if (!readBits(1, bit))
+        {
+            return false;
+        }
+        if (bit == 0)
+        {
+            break;
+        }
+        prefix++;
+    }
+    static const uint8_t widths[5] = {0, 4, 7, 10, 17};
+    raw = 0;
+    if (prefix > 0 && !readBits(widths[prefix], raw))
+    {
+        return false;
+    }
+    delta = zigzagDecode(raw);
+    return true;
+}
+
+bool SampleDecoder::next(CodecSample &sample)
+{
+    if (done || failed)
+    {
+        return false;
+    }
+    uint32_t raw;
+    if (!started)
+    {
+        uint32_t temperature, humidity, batteryV;
+        if (length == 0)
+        {
+            done = true;
+            return false;
+        }
+        if (!readBits(32, raw) || !readBits(16, temperature) || !readBits(16, humidity) || !readBits(16, batteryV))
+        {
+            failed = true;
+            return false;
+        }
+        previous.time = raw;
+        previous.temperature = (int16_t)temperature;
+        previous.humidity = (int16_t)humidity;
+        previous.batteryV = (uint16_t)batteryV;
+        started = true;
+        sample = previous;
+        return true;
+    }
+
+    int64_t dod;
+    bool end;
+    int32_t temperatureDelta, humidityDelta, batteryDelta;
+    if (!readTimestamp(dod, end))
+    {
+        failed = true;
+        return false;
+    }
+    if (end)
+    {
+        done = true;
+        return false;
+    }
+    if (!readValue(temperatureDelta) || !readValue(humidityDelta) || !readValue(batteryDelta))
+    {
+        failed = true;
+        return false;
+    }
+    previousDelta += dod;
+    previous.time = (uint32_t)(previous.time + previousDelta);
+    previous.temperature = (int16_t)(previous.temperature + temperatureDelta);
+    previous.humidity = (int16_t)(previous.humidity + humidityDelta);
+    previous.batteryV = (uint16_t)(previous.batteryV + batteryDelta);
+    sample = previous;
+    return true;
+}
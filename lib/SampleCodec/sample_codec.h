@@ -0,0 +1,97 @@
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Битовое сжатие рядов показаний в стиле Gorilla (Facebook TSDB).
+// Поток битов, старший бит байта первый. Первый отсчет:
+//   time 32 бита, temperature 16, humidity 16, batteryV 16.
+// Следующие отсчеты:
+//   время - разность разностей (delta-of-delta) с префиксом:
+//     0                    dod = 0
+//     10   + 7 бит         dod в [-63, 64]
+//     110  + 9 бит         dod в [-255, 256]
+//     1110 + 12 бит        dod в [-2047, 2048]
+//     1111 + 32 бита       любой dod (INT32_MIN - конец потока)
+//   каждое значение - разность с предыдущим, zigzag, с префиксом:
+//     0                    без изменений
+//     10   + 4 бита        delta в [-8, 7]
+//     110  + 7 бит         delta в [-64, 63]
+//     1110 + 10 бит        delta в [-512, 511]
+//     1111 + 17 бит        любая разность 16-битного значения
+// Значения - целые (сотые °C, сотые %, мВ), поэтому вместо XOR чисел с плавающей точкой
+// кодируется целая разность: у медленно меняющихся датчиков она почти всегда мала.
+// Минутное среднее меняется на несколько сотых, поэтому самый короткий класс - 4 бита.
+// Поток завершается маркером конца и дополняется нулями до байта.
+#define SAMPLE_CODEC_BUFFER 64 // Внутренний буфер кодировщика (байт)
+#define SAMPLE_CODEC_MAX_SAMPLE_BYTES 13 // Наибольший размер закодированного отсчета с маркером конца (байт)
+
+struct CodecSample
+{
+    uint32_t time;       // Секунды
+    int16_t temperature; // Сотые °C
+    int16_t humidity;    // Сотые %
+    uint16_t batteryV;   // мВ
+};
+
+// Потоковый кодировщик: отсчеты добавляются append(), готовые байты забираются read()
+class SampleEncoder
+{
+public:
+    SampleEncoder();
+
+    // Добавление отсчета, false - во внутреннем буфере нет места (сначала забрать байты read())
+    bool append(const CodecSample &sample);
+    // Запись маркера конца и дополнение до байта; false - нет места
+    bool finish();
+    // Готовые к выдаче байты
+    size_t available() const { return length; }
+    size_t read(uint8_t *out, size_t maxLen);
+    // Всего выдано и ожидающих выдачи бит (для статистики сжатия)
+    uint64_t bitsWritten() const { return totalBits; }
+
+private:
+    void writeBits(uint64_t value, uint8_t count);
+    void writeTimestamp(int64_t dod);
+    void writeValue(int32_t delta);
+
+    uint8_t buffer[SAMPLE_CODEC_BUFFER];
+    size_t length;
+    uint32_t bitAccumulator;
+    uint8_t bitCount;
+    uint64_t totalBits;
+    bool started;
+    bool finished;
+    CodecSample previous;
+    int64_t previousDelta;
+};
+
+// Декодер: последовательный обход отсчетов потока
+class SampleDecoder
+{
+public:
+    SampleDecoder(const uint8_t *data, size_t length);
+
+    // Следующий отсчет, false - конец потока или данные повреждены (см. error())
+    bool next(CodecSample &sample);
+    bool error() const { return failed; }
+    // Байт потока, прочитанных с учетом выравнивания; после конца потока - его полная длина
+    size_t bytesRead() const { return (bitPosition + 7) / 8; }
+
+private:
+    bool readBits(uint8_t count, uint32_t &value);
+    bool readTimestamp(int64_t &dod, bool &end);
+    bool readValue(int32_t &delta);
+
+    const uint8_t *data;
+    size_t length;
+    size_t bitPosition;
+    bool started;
+    bool done;
+    bool failed;
+    CodecSample previous;
+    int64_t previousDelta;
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include "sensor_history.h"
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <math.h>
+#include <algorithm>
+
+static const uint32_t tierIntervals[HISTORY_TIER_COUNT] = {HISTORY_RAW_INTERVAL, HISTORY_MEDIUM_INTERVAL, HISTORY_LONG_INTERVAL};
+static const uint32_t tierSlots[HISTORY_TIER_COUNT] = {HISTORY_RAW_SLOTS, HISTORY_MEDIUM_SLOTS, HISTORY_LONG_SLOTS};
+
+// Уровень истории устройства: кольцо слотов и накопитель текущего (незавершенного) слота
+struct HistoryTier
+{
+    HistorySample *samples;
+    int64_t newestSlot; // Последний записанный в кольцо слот, -1 - нет
+    int64_t openSlot;   // Слот накопителя, -1 - нет
+    int32_t sumTemperature;
+    int32_t sumHumidity;
+    uint16_t count;
+};
+
+struct DeviceHistory
+{
+    uint64_t mac;
+    HistorySample *memory; // Один блок PSRAM на все уровни
+    HistoryTier tiers[HISTORY_TIER_COUNT];
+};
+
+static SemaphoreHandle_t historyMutex = nullptr;
+static DeviceHistory histories[HISTORY_MAX_DEVICES];
+static uint32_t historyCount = 0;
+static uint32_t historyAllocationFailed = 0;
+
+static size_t historyBytesPerDevice()
+{
+    return (HISTORY_RAW_SLOTS + HISTORY_MEDIUM_SLOTS + HISTORY_LONG_SLOTS) * sizeof(HistorySample);
+}
+
+void initSensorHistory()
+{
+    if (historyMutex == nullptr)
+    {
+        historyMutex = xSemaphoreCreateMutex();
+    }
+}
+
+uint32_t sensorHistoryNow()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+uint32_t sensorHistoryInterval(uint8_t tier)
+{
+    return tier < HISTORY_TIER_COUNT ? tierIntervals[tier] : 0;
+}
+
+uint32_t sensorHistoryRetention(uint8_t tier)
+{
+    return tier < HISTORY_TIER_COUNT ? tierIntervals[tier] * tierSlots[tier] : 0;
+}
+
+int sensorHistoryTierFor(uint32_t interval, uint32_t from)
+{
+    if (interval != 0)
+    {
+        for (int tier = 0; tier < HISTORY_TIER_COUNT; tier++)
+        {
+            if (tierIntervals[tier] == interval)
+            {
+                return tier;
+            }
+        }
+        return -1;
+    }
+    uint32_t age = sensorHistoryNow() - std::min(from, sensorHistoryNow());
+    for (int tier = 0; tier < HISTORY_TIER_COUNT; tier++)
+    {
+        if (age <= sensorHistoryRetention(tier))
+        {
+            return tier;
+        }
+    }
+    return HISTORY_TIER_COUNT - 1;
+}
+
+// Поиск истории устройства (вызывать под historyMutex)
+static DeviceHistory *findHistory(uint64_t mac)
+{
+    for (uint32_t i = 0; i < historyCount; i++)
+    {
+        if (histories[i].mac == mac)
+        {
+            return &histories[i];
+        }
+    }
+    return nullptr;
+}
+
+static DeviceHistory *createHistory(uint64_t mac)
+{
+    if (historyCount >= HISTORY_MAX_DEVICES)
+    {
+        historyAllocationFailed++;
+        return nullptr;
+    }
+    size_t total = HISTORY_RAW_SLOTS + HISTORY_MEDIUM_SLOTS + HISTORY_LONG_SLOTS;
+    HistorySample *memory = (HistorySample *)heap_caps_malloc(total * sizeof(HistorySample), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (memory == nullptr)
+    {
+        historyAllocationFailed++;
+        return nullptr;
+    }
+    // Слоты до первого показания устройства читаются как пропуски, а не как прежнее содержимое памяти
+    std::fill(memory, memory + total, HistorySample{HISTORY_MISSING, HISTORY_MISSING});
+    DeviceHistory &history = histories[historyCount++];
+    history.mac = mac;
+    history.memory = memory;
+    HistorySample *next = memory;
+    for (int tier = 0; tier < HISTORY_TIER_COUNT; tier++)
+    {
+        HistoryTier &t = history.tiers[tier];
+        t.samples = next;
+        t.newestSlot = -1;
+        t.openSlot = -1;
+        t.sumTemperature = 0;
+        t.sumHumidity = 0;
+        t.count = 0;
+        next += tierSlots[tier];
+    }
+    return &history;
+}
+
+// Запись завершенного слота накопителя в кольцо, пропущенные слоты помечаются пустыми
+static void commitSlot(HistoryTier &t, uint32_t slots)
+{
+    if (t.openSlot < 0 || t.count == 0)
+    {
+        return;
+    }
+    int64_t gapStart = t.newestSlot < 0 ? t.openSlot : std::max(t.newestSlot + 1, t.openSlot - (int64_t)slots);
+    for (int64_t slot = gapStart; slot < t.openSlot; slot++)
+    {
+        t.samples[slot % slots] = {HISTORY_MISSING, HISTORY_MISSING};
+    }
+    t.samples[t.openSlot % slots] = {(int16_t)(t.sumTemperature / t.count), (int16_t)(t.sumHumidity / t.count)};
+    t.newestSlot = t.openSlot;
+}
+
+void sensorHistoryAdd(uint64_t mac, float temperature, float humidity)
+{
+    if (historyMutex == nullptr)
+    {
+        return;
+    }
+    int16_t centiTemperature = (int16_t)constrain(lroundf(temperature * 100.0f), -32767, 32767);
+    int16_t centiHumidity = (int16_t)constrain(lroundf(humidity * 100.0f), 0, 32767);
+    uint32_t now = sensorHistoryNow();
+
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    DeviceHistory *history = findHistory(mac);
+    if (history == nullptr)
+    {
+        history = createHistory(mac);
+    }
+    if (history != nullptr)
+    {
+        for (int tier = 0; tier < HISTORY_TIER_COUNT; tier++)
+        {
+            HistoryTier &t = history->tiers[tier];
+            int64_t slot = now / tierIntervals[tier];
+            if (slot != t.openSlot)
+            {
+                commitSlot(t, tierSlots[tier]);
+                t.openSlot = slot;
+                t.sumTemperature = 0;
+                t.sumHumidity = 0;
+                t.count = 0;
+            }
+            t.sumTemperature += centiTemperature;
+            t.sumHumidity += centiHumidity;
+            t.count++;
+        }
+    }
+    xSemaphoreGive(historyMutex);
+}
+
+void sensorHistoryRemove(uint64_t mac)
+{
+    if (historyMutex == nullptr)
+    {
+        return;
+    }
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    DeviceHistory *history = findHistory(mac);
+    if (history != nullptr)
+    {
+        heap_caps_free(history->memory);
+        *history = histories[--historyCount];
+    }
+    xSemaphoreGive(historyMutex);
+}
+
+bool sensorHistoryRead(uint64_t mac, uint8_t tier, uint32_t from, uint32_t to,
+                       HistoryPoint *out, size_t maxPoints, size_t &count, uint32_t &next)
+{
+    count = 0;
+    next = to + 1;
+    if (historyMutex == nullptr || tier >= HISTORY_TIER_COUNT)
+    {
+        return false;
+    }
+    uint32_t interval = tierIntervals[tier];
+    uint32_t slots = tierSlots[tier];
+
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    DeviceHistory *history = findHistory(mac);
+    if (history == nullptr)
+    {
+        xSemaphoreGive(historyMutex);
+        return false;
+    }
+    const HistoryTier &t = history->tiers[tier];
+    // Кольцо хранит слоты (newestSlot - slots, newestSlot], последним отдается незавершенный слот
+    int64_t lastSlot = t.openSlot >= 0 ? t.openSlot : t.newestSlot;
+    int64_t firstSlot = std::max((int64_t)(from / interval), t.newestSlot - (int64_t)slots + 1);
+    int64_t endSlot = std::min((int64_t)(to / interval), lastSlot);
+    int64_t slot = std::max(firstSlot, (int64_t)0);
+    for (; slot <= endSlot && count < maxPoints; slot++)
+    {
+        HistorySample sample;
+        if (slot == t.openSlot)
+        {
+            if (t.count == 0)
+            {
+                continue;
+            }
+            sample = {(int16_t)(t.sumTemperature / t.count), (int16_t)(t.sumHumidity / t.count)};
+        }
+        else if (slot <= t.newestSlot)
+        {
+            sample = t.samples[slot % slots];
+        }
+        else
+        {
+            continue;
+        }
+        if (sample.temperature == HISTORY_MISSING)
+        {
+            continue;
+        }
+        out[count].time = (uint32_t)(slot * interval);
+        out[count].sample = sample;
+        count++;
+    }
+    xSemaphoreGive(historyMutex);
+    next = slot > endSlot ? to + 1 : (uint32_t)(slot * interval);
+    return true;
+}
+
+size_t sensorHistoryDevices(uint64_t *out, size_t maxDevices)
+{
+    if (historyMutex == nullptr)
+    {
+        return 0;
+    }
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    size_t count = std::min((size_t)historyCount, maxDevices);
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = histories[i].mac;
+    }
+    xSemaphoreGive(historyMutex);
+    return count;
+}
+
+SensorHistoryStats getSensorHistoryStats()
+{
+    SensorHistoryStats stats;
+    stats.bytesPerDevice = historyBytesPerDevice();
+    stats.devices = historyCount;
+    stats.bytesTotal = stats.devices * stats.bytesPerDevice;
+    stats.allocationFailed = historyAllocationFailed;
+    return stats;
+}
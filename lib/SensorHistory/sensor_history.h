@@ -0,0 +1,53 @@
+#ifndef SENSOR_HISTORY_H
+#define SENSOR_HISTORY_H
+
+#include <Arduino.h>
+#include <history_format.h>
+
+// История температуры и влажности в PSRAM, три уровня детализации.
+// Каждый уровень - кольцевой буфер слотов фиксированной длительности без хранения времени:
+// слот N покрывает [N * interval, (N + 1) * interval) секунд от загрузки, значение - среднее за слот.
+// Время - секунды от загрузки (esp_timer), часы реального времени на плате нет.
+#define HISTORY_TIER_COUNT 3
+#define HISTORY_RAW_INTERVAL 60       // Уровень 0: 1 минута
+#define HISTORY_RAW_SLOTS 1440        // 24 часа
+#define HISTORY_MEDIUM_INTERVAL 300   // Уровень 1: 5 минут
+#define HISTORY_MEDIUM_SLOTS 8640     // 30 дней
+#define HISTORY_LONG_INTERVAL 3600    // Уровень 2: 1 час
+#define HISTORY_LONG_SLOTS 8760       // 365 дней
+#define HISTORY_MAX_DEVICES 64        // Максимальное число устройств с историей
+#define HISTORY_MISSING INT16_MIN     // Нет данных за слот
+
+struct SensorHistoryStats
+{
+    uint32_t devices;         // Устройств с выделенной историей
+    uint32_t bytesPerDevice;  // Память на одно устройство (фиксирована)
+    uint32_t bytesTotal;      // Всего выделено
+    uint32_t allocationFailed; // Устройства без истории из-за нехватки памяти или лимита
+};
+
+// Создание мьютекса (до первого показания датчика)
+void initSensorHistory();
+// Добавление показания (вызывается обработчиком рекламных пакетов BLE при каждом показании устройства из таблицы)
+void sensorHistoryAdd(uint64_t mac, float temperature, float humidity);
+// Освобождение истории удаленного устройства
+void sensorHistoryRemove(uint64_t mac);
+
+// Текущее время истории (с от загрузки)
+uint32_t sensorHistoryNow();
+uint32_t sensorHistoryInterval(uint8_t tier);
+uint32_t sensorHistoryRetention(uint8_t tier);
+// Уровень с заданным интервалом (с), либо самый подробный, покрывающий from. -1 - интервал неизвестен
+int sensorHistoryTierFor(uint32_t interval, uint32_t from);
+
+// Чтение до maxPoints точек с временем в [from, to], пустые слоты пропускаются.
+// next - время, с которого продолжать чтение. false - истории устройства нет
+bool sensorHistoryRead(uint64_t mac, uint8_t tier, uint32_t from, uint32_t to,
+                       HistoryPoint *out, size_t maxPoints, size_t &count, uint32_t &next);
+
+// MAC-адреса устройств с историей, возвращает их число (не больше maxDevices)
+size_t sensorHistoryDevices(uint64_t *out, size_t maxDevices);
+
+SensorHistoryStats getSensorHistoryStats();
+
+#endif
@@ -0,0 +1,360 @@
+#include <persist_scheduler.h>
+#include <persist_codec.h>
+#include <spiffs_setting.h>
+#include <Preferences.h>
+#include <atomic>
+#include <algorithm>
+#include <esp_system.h>
+
+#define PERSIST_PENDING_DEVICES_CONFIG 0x01
+#define PERSIST_PENDING_DEVICES_STATS 0x02
+#define PERSIST_PENDING_DEVICE_INDEX 0x04
+#define PERSIST_PENDING_GPIO_CONFIG 0x08
+#define PERSIST_PENDING_GPIO_STATS 0x10
+#define PERSIST_PENDING_SERVER 0x20
+#define PERSIST_PENDING_CONFIG_MASK (PERSIST_PENDING_DEVICES_CONFIG | PERSIST_PENDING_DEVICE_INDEX | PERSIST_PENDING_GPIO_CONFIG | PERSIST_PENDING_SERVER)
+#define PERSIST_PENDING_ALL 0x3F
+#define PERSIST_HOUR_MS 3600000UL
+
+static Preferences devicePreferences;
+static std::atomic<uint32_t> pendingFlags(0);
+static std::atomic<unsigned long> configDirtySince(0);
+static unsigned long lastStatsFlush = 0;
+static TaskHandle_t persistenceTask = nullptr;
+// Одна запись в NVS одновременно: задача и flushPersistence из других задач
+static SemaphoreHandle_t persistenceMutex = nullptr;
+// MAC-адреса удаленных устройств, чьи ключи нужно стереть (защищено devicesLock)
+static std::vector<uint64_t> removedMacs;
+
+static portMUX_TYPE persistStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static PersistenceStats persistStats = {};
+static unsigned long persistHourStart = 0;
+
+static void setPending(uint32_t flags)
+{
+  uint32_t previous = pendingFlags.fetch_or(flags);
+  // Отсчет задержки от первого изменения в серии: запись не откладывается бесконечно
+  if ((flags & PERSIST_PENDING_CONFIG_MASK) && !(previous & PERSIST_PENDING_CONFIG_MASK))
+  {
+    configDirtySince = millis();
+    // Будим задачу, чтобы она пересчитала время до записи
+    if (persistenceTask != nullptr)
+    {
+      xTaskNotifyGive(persistenceTask);
+    }
+  }
+}
+
+void persistDeviceKey(uint64_t mac, char *key, size_t size)
+{
+  snprintf(key, size, "d%012llx", (unsigned long long)mac);
+}
+
+void markDeviceConfigDirty(DeviceData &device)
+{
+  device.persistDirty |= PERSIST_DIRTY_CONFIG;
+  setPending(PERSIST_PENDING_DEVICES_CONFIG);
+}
+
+void markDeviceStatsDirty(DeviceData &device)
+{
+  device.persistDirty |= PERSIST_DIRTY_STATS;
+  setPending(PERSIST_PENDING_DEVICES_STATS);
+}
+
+void markDeviceAdded(DeviceData &device)
+{
+  markDeviceConfigDirty(device);
+  setPending(PERSIST_PENDING_DEVICE_INDEX);
+}
+
+void markDeviceRemoved(uint64_t mac)
+{
+  removedMacs.push_back(mac);
+  setPending(PERSIST_PENDING_DEVICE_INDEX);
+}
+
+void markDeviceIndexDirty()
+{
+  setPending(PERSIST_PENDING_DEVICE_INDEX);
+}
+
+void markGpioConfigDirty()
+{
+  setPending(PERSIST_PENDING_GPIO_CONFIG);
+}
+
+void markGpioStatsDirty()
+{
+  setPending(PERSIST_PENDING_GPIO_STATS);
+}
+
+void markServerSettingDirty()
+{
+  setPending(PERSIST_PENDING_SERVER);
+}
+
+// Статистика записей +++++++++++++++++++++++++++++++++
+// Перенос счетчиков текущего часа в предыдущий (вызывать под persistStatsMux)
+static void rotatePersistHour(unsigned long now)
+{
+  unsigned long elapsed = now - persistHourStart;
+  if (elapsed < PERSIST_HOUR_MS)
+  {
+    return;
+  }
+  // Если прошло больше двух часов, в предыдущем часе записей не было
+  bool previousHourIsCurrent = elapsed < 2 * PERSIST_HOUR_MS;
+  persistStats.writesLastHour = previousHourIsCurrent ? persistStats.writesThisHour : 0;
+  persistStats.bytesLastHour = previousHourIsCurrent ? persistStats.bytesThisHour : 0;
+  persistStats.writesThisHour = 0;
+  persistStats.bytesThisHour = 0;
+  persistHourStart += (elapsed / PERSIST_HOUR_MS) * PERSIST_HOUR_MS;
+}
+
+void recordPersistWrite(size_t bytes)
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&persistStatsMux);
+  rotatePersistHour(now);
+  persistStats.writesTotal++;
+  persistStats.bytesTotal += bytes;
+  persistStats.writesThisHour++;
+  persistStats.bytesThisHour += bytes;
+  portEXIT_CRITICAL(&persistStatsMux);
+}
+
+PersistenceStats getPersistenceStats()
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&persistStatsMux);
+  rotatePersistHour(now);
+  PersistenceStats stats = persistStats;
+  portEXIT_CRITICAL(&persistStatsMux);
+  return stats;
+}
+
+// Запись устройств +++++++++++++++++++++++++++++++++++
+struct PendingDeviceRecord
+{
+  uint64_t mac;
+  std::vector<uint8_t> data;
+};
+
+// Время ожидания блокировки до момента deadline (тики), portMAX_DELAY - без ограничения
+static TickType_t ticksUntil(TickType_t deadline)
+{
+  if (deadline == portMAX_DELAY)
+  {
+    return portMAX_DELAY;
+  }
+  int32_t left = (int32_t)(deadline - xTaskGetTickCount());
+  return left > 0 ? (TickType_t)left : 0;
+}
+
+// Запись устройств с флагами из dirtyMask и, при writeIndex, индекса и удалений
+static void flushDevices(uint8_t dirtyMask, bool writeIndex, TickType_t deadline)
+{
+  std::vector<PendingDeviceRecord> records;
+  std::vector<uint8_t> indexBlob;
+  std::vector<uint64_t> removed;
+
+  // Под блокировкой только кодирование измененных записей, запись во flash - без нее
+  if (!devicesLock.lock(ticksUntil(deadline)))
+  {
+    logAndSend("Failed to take devicesLock");
+    setPending((dirtyMask & PERSIST_DIRTY_CONFIG ? PERSIST_PENDING_DEVICES_CONFIG : 0) |
+               (dirtyMask & PERSIST_DIRTY_STATS ? PERSIST_PENDING_DEVICES_STATS : 0) |
+               (writeIndex ? PERSIST_PENDING_DEVICE_INDEX : 0));
+    return;
+  }
+  for (auto &device : devices)
+  {
+    if (device.persistDirty & dirtyMask)
+    {
+      records.push_back({device.mac, {}});
+      encodeDeviceBlob(device, records.back().data);
+      // Запись содержит все поля устройства, поэтому снимаются все флаги
+      device.persistDirty = 0;
+    }
+  }
+  if (writeIndex)
+  {
+    // Пустой индекс пишется только после удаления устройств: пустой реестр после неудачной загрузки
+    // не должен затирать индекс и оставлять записи устройств без ссылок
+    if (devices.size() == 0 && removedMacs.empty())
+    {
+      logAndSend("Devices index not saved: registry is empty");
+      writeIndex = false;
+    }
+    else
+    {
+      encodeDeviceIndexBlob(devices, indexBlob);
+      removed.swap(removedMacs);
+    }
+  }
+  devicesLock.unlock();
+
+  std::vector<uint64_t> failed;
+  if (devicePreferences.begin("devices", false))
+  {
+    char key[16];
+    for (const auto &record : records)
+    {
+      persistDeviceKey(record.mac, key, sizeof(key));
+      if (devicePreferences.putBytes(key, record.data.data(), record.data.size()) == record.data.size())
+      {
+        recordPersistWrite(record.data.size());
+      }
+      else
+      {
+        failed.push_back(record.mac);
+      }
+    }
+    for (uint64_t mac : removed)
+    {
+      persistDeviceKey(mac, key, sizeof(key));
+      devicePreferences.remove(key);
+    }
+    if (writeIndex)
+    {
+      if (devicePreferences.putBytes("index", indexBlob.data(), indexBlob.size()) == indexBlob.size())
+      {
+        recordPersistWrite(indexBlob.size());
+      }
+      else
+      {
+        logAndSend("Failed to save devices index");
+        setPending(PERSIST_PENDING_DEVICE_INDEX);
+      }
+    }
+    devicePreferences.end();
+  }
+  else
+  {
+    logAndSend("Failed to open 'devices' namespace");
+    for (const auto &record : records)
+    {
+      failed.push_back(record.mac);
+    }
+    if (writeIndex)
+    {
+      setPending(PERSIST_PENDING_DEVICE_INDEX);
+    }
+  }
+
+  if (!records.empty() || writeIndex)
+  {
+    logAndSend("Saved devices: " + String(records.size() - failed.size()) + (writeIndex ? " + index" : ""));
+  }
+
+  // Незаписанные устройства помечаются снова и попадут в следующую запись
+  if (!failed.empty() && devicesLock.lock(ticksUntil(deadline)))
+  {
+    logAndSend("Failed to save devices: " + String(failed.size()));
+    for (uint64_t mac : failed)
+    {
+      DeviceData *device = devices.find(mac);
+      if (device != nullptr)
+      {
+        markDeviceConfigDirty(*device);
+      }
+    }
+    devicesLock.unlock();
+  }
+}
+
+// Запись накопленных изменений из mask; блокировки ждут не дольше deadline (тик)
+static void writePending(uint32_t mask, TickType_t deadline = portMAX_DELAY)
+{
+  uint32_t taken = pendingFlags.fetch_and(~mask) & mask;
+  if (taken & (PERSIST_PENDING_DEVICES_CONFIG | PERSIST_PENDING_DEVICES_STATS | PERSIST_PENDING_DEVICE_INDEX))
+  {
+    uint8_t dirtyMask = (taken & PERSIST_PENDING_DEVICES_CONFIG ? PERSIST_DIRTY_CONFIG : 0) |
+                        (taken & PERSIST_PENDING_DEVICES_STATS ? PERSIST_DIRTY_STATS : 0);
+    flushDevices(dirtyMask, taken & PERSIST_PENDING_DEVICE_INDEX, deadline);
+  }
+  if ((taken & (PERSIST_PENDING_GPIO_CONFIG | PERSIST_PENDING_GPIO_STATS)) && !saveGpioToFile(ticksUntil(deadline)))
+  {
+    setPending(taken & (PERSIST_PENDING_GPIO_CONFIG | PERSIST_PENDING_GPIO_STATS));
+  }
+  if (taken & PERSIST_PENDING_SERVER)
+  {
+    saveServerSetting();
+  }
+}
+
+// Запись по расписанию, возвращает время до следующей проверки (мс)
+static unsigned long persistenceTick()
+{
+  unsigned long now = millis();
+  unsigned long statsElapsed = now - lastStatsFlush;
+  if (statsElapsed >= PERSIST_STATS_INTERVAL)
+  {
+    lastStatsFlush = now;
+    writePending(PERSIST_PENDING_ALL);
+    return PERSIST_STATS_INTERVAL;
+  }
+  unsigned long wait = PERSIST_STATS_INTERVAL - statsElapsed;
+  if (pendingFlags.load() & PERSIST_PENDING_CONFIG_MASK)
+  {
+    unsigned long configElapsed = now - configDirtySince.load();
+    if (configElapsed >= PERSIST_CONFIG_DELAY)
+    {
+      writePending(PERSIST_PENDING_CONFIG_MASK);
+    }
+    else
+    {
+      wait = std::min(wait, PERSIST_CONFIG_DELAY - configElapsed);
+    }
+  }
+  return wait;
+}
+
+static void persistenceTaskFunction(void *parameter)
+{
+  unsigned long wait = PERSIST_CONFIG_DELAY;
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+    xSemaphoreTake(persistenceMutex, portMAX_DELAY);
+    wait = persistenceTick();
+    xSemaphoreGive(persistenceMutex);
+  }
+}
+
+// Вызывается из esp_restart() перед перезагрузкой
+static void persistenceShutdownHandler()
+{
+  flushPersistence(PERSIST_FLUSH_TIMEOUT);
+}
+
+void startPersistenceTask()
+{
+  if (persistenceMutex != nullptr)
+  {
+    return;
+  }
+  persistenceMutex = xSemaphoreCreateMutex();
+  lastStatsFlush = millis();
+  xTaskCreate(persistenceTaskFunction, "persistence", PERSIST_TASK_STACK_SIZE, NULL, PERSIST_TASK_PRIORITY, &persistenceTask);
+  esp_register_shutdown_handler(persistenceShutdownHandler);
+}
+
+bool flushPersistence(uint32_t timeoutMs)
+{
+  // Один срок на ожидание задачи записи и devicesLock: перезагрузка не зависает на занятой таблице
+  TickType_t deadline = timeoutMs == portMAX_DELAY ? portMAX_DELAY : xTaskGetTickCount() + pdMS_TO_TICKS(timeoutMs);
+  if (persistenceMutex != nullptr && xSemaphoreTake(persistenceMutex, ticksUntil(deadline)) != pdTRUE)
+  {
+    logAndSend("Persistence flush timed out");
+    return false;
+  }
+  lastStatsFlush = millis();
+  writePending(PERSIST_PENDING_ALL, deadline);
+  if (persistenceMutex != nullptr)
+  {
+    xSemaphoreGive(persistenceMutex);
+  }
+  return pendingFlags.load() == 0;
+}
@@ -0,0 +1,53 @@
+#ifndef PERSIST_SCHEDULER_H
+#define PERSIST_SCHEDULER_H
+#include <Arduino.h>
+#include <variables_info.h>
+
+#define PERSIST_TASK_STACK_SIZE 4096                  // Стек задачи записи (байт)
+#define PERSIST_TASK_PRIORITY (tskIDLE_PRIORITY + 1)   // Не выше остальных задач
+#define PERSIST_FLUSH_TIMEOUT 2000                     // Ожидание записи и devicesLock при flush перед перезагрузкой (мс)
+
+// Планировщик записи во flash.
+// Изменения только помечаются (без ожидания, повторные пометки объединяются),
+// запись выполняет отдельная задача "persistence":
+// настройки - через PERSIST_CONFIG_DELAY после первого изменения (серия правок пишется один раз),
+// статистика - не чаще PERSIST_STATS_INTERVAL. Каждое устройство хранится под своим ключом NVS
+// ("d" + 12 hex-символов MAC), поэтому пишутся только измененные устройства.
+
+// Счетчики записей в NVS для контроля износа flash
+struct PersistenceStats
+{
+  uint32_t writesTotal;
+  uint32_t bytesTotal;
+  uint32_t writesThisHour;
+  uint32_t bytesThisHour;
+  uint32_t writesLastHour; // За предыдущий полный час
+  uint32_t bytesLastHour;
+};
+
+// Пометки изменений устройств (вызывать при захваченном devicesLock)
+void markDeviceConfigDirty(DeviceData &device);
+void markDeviceStatsDirty(DeviceData &device);
+void markDeviceAdded(DeviceData &device);
+void markDeviceRemoved(uint64_t mac);
+// Перезапись индекса без записей устройств (после восстановления поврежденного индекса)
+void markDeviceIndexDirty();
+// Пометки изменений GPIO и настроек сервера
+void markGpioConfigDirty();
+void markGpioStatsDirty();
+void markServerSettingDirty();
+
+// Запуск задачи записи и обработчика перезагрузки (до первой загрузки/сохранения данных)
+void startPersistenceTask();
+// Немедленная запись всех накопленных изменений в вызывающей задаче.
+// Вызывать перед OTA и перезагрузкой; esp_restart() выполняет ее автоматически
+bool flushPersistence(uint32_t timeoutMs = portMAX_DELAY);
+
+// Учет записи в NVS (все функции сохранения)
+void recordPersistWrite(size_t bytes);
+PersistenceStats getPersistenceStats();
+
+// Ключ NVS устройства: "d" + 12 hex-символов MAC
+void persistDeviceKey(uint64_t mac, char *key, size_t size);
+
+#endif
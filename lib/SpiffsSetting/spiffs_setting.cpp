@@ -1,4 +1,9 @@
 #include <spiffs_setting.h>
+#include <xiaomi_scanner.h>
+#include <persist_codec.h>
+#include <persist_scheduler.h>
+#include <nvs.h>
+#include <esp_idf_version.h>
 
 Preferences preferences;
 
@@ -6,8 +11,8 @@ void saveServerSetting()
 {
   if (preferences.begin("server_setting", false))
   {
-    preferences.putLong64("server_time", serverWorkTime);
-    preferences.putFloat("hysteresis_temp", hysteresisTemp);
+    recordPersistWrite(preferences.putLong64("server_time", serverWorkTime));
+    recordPersistWrite(preferences.putFloat("hysteresis_temp", hysteresisTemp));
     preferences.end();
   }
 }
@@ -21,197 +26,257 @@ void loadServerWorkTime()
     preferences.end();
   }
 }
-// Загружаем клиентов из Preferences как единый Blob
-void loadClientsFromFile()
+// Чтение blob'а из открытого пространства имен в buffer, false - blob отсутствует или не прочитан
+static bool readBlob(const char *key, std::vector<uint8_t> &buffer)
 {
-  logAndSend("Loading clients from Preferences...");
+  size_t blobSize = preferences.getBytesLength(key);
+  if (blobSize == 0)
+  {
+    return false;
+  }
+  buffer.resize(blobSize);
+  if (preferences.getBytes(key, buffer.data(), blobSize) != blobSize)
+  {
+    logAndSend("Failed to read complete blob data");
+    return false;
+  }
+  return true;
+}
 
-  // Открываем пространство имен "devices" в режиме только для чтения
-  if (preferences.begin("devices", true))
+// Разбор старого JSON-формата devices_blob (для миграции)
+static bool parseDevicesJson(const std::vector<uint8_t> &buffer, std::vector<DeviceData> &loaded)
+{
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, buffer.data(), buffer.size());
+  if (error)
   {
-    if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE)
-    {
-      devices.clear();
+    logAndSend("deserializeJson() failed: " + String(error.c_str()));
+    return false;
+  }
 
-      // Получаем размер сохраненного Blob
-      size_t blobSize = preferences.getBytesLength("devices_blob");
+  // Преобразуем JSON в объекты DeviceData
+  JsonArray devicesArray = doc.as<JsonArray>();
+  for (JsonObject deviceObj : devicesArray)
+  {
+    DeviceData device;
 
-      if (blobSize > 0)
-      {
-        // Выделяем буфер для данных
-        uint8_t *buffer = new uint8_t[blobSize];
+    // Заполняем поля устройства
+    if (!parseMacAddress(deviceObj["mac"].as<const char *>(), device.mac))
+    {
+      continue;
+    }
+    device.name = deviceObj["name"].as<const char *>();
+    device.macAddress = formatMacAddress(device.mac);
+    device.targetTemperature = deviceObj["target_temp"].as<float>();
+    device.enabled = deviceObj["enabled"].as<bool>();
 
-        if (buffer)
-        {
-          // Читаем данные в буфер
-          size_t readSize = preferences.getBytes("devices_blob", buffer, blobSize);
-
-          if (readSize == blobSize)
-          {
-            // Десериализуем JSON из буфера
-            JsonDocument doc;
-            DeserializationError error = deserializeJson(doc, buffer, blobSize);
-
-            if (!error)
-            {
-              // Преобразуем JSON в объекты DeviceData
-              JsonArray devicesArray = doc.as<JsonArray>();
-
-              for (JsonObject deviceObj : devicesArray)
-              {
-                DeviceData device;
-
-                // Заполняем поля устройства
-                device.name = deviceObj["name"].as<const char *>();
-                device.macAddress = deviceObj["mac"].as<const char *>();
-                device.targetTemperature = deviceObj["target_temp"].as<float>();
-                device.enabled = deviceObj["enabled"].as<bool>();
-
-                // Парсим массив GPIO пинов
-                if (!deviceObj["gpio_pins"].isNull())
-                {
-                  JsonArray pinsArray = deviceObj["gpio_pins"].as<JsonArray>();
-                  for (uint8_t pin : pinsArray)
-                  {
-                    device.gpioPins.push_back(pin);
-                  }
-                }
-
-                // Инициализируем дополнительные поля
-                device.heatingStartTime = 0;
-                device.totalHeatingTime = deviceObj["total_heating"].as<long>();
-                device.isOnline = false;
-                device.currentTemperature = device.targetTemperature;
-                device.heatingActive = false;
-                device.humidity = deviceObj["humidity"].as<float>();
-                device.battery = deviceObj["battery"].as<uint8_t>();
-                device.batteryV = deviceObj["batteryV"].as<uint16_t>();
-                // Добавляем устройство в вектор
-                devices.push_back(device);
-              }
-            }
-            else
-            {
-              logAndSend("deserializeJson() failed: " + String(error.c_str()));
-            }
-          }
-          else
-          {
-            logAndSend("Failed to read complete blob data");
-          }
-
-          // Освобождаем память
-          delete[] buffer;
-        }
-        else
-        {
-          logAndSend("Failed to allocate memory for blob data");
-        }
-      }
-      else
+    // Парсим массив GPIO пинов
+    if (!deviceObj["gpio_pins"].isNull())
+    {
+      JsonArray pinsArray = deviceObj["gpio_pins"].as<JsonArray>();
+      for (uint8_t pin : pinsArray)
       {
-        logAndSend("No devices data found in Preferences");
+        device.gpioPins.push_back(pin);
       }
-
-      xSemaphoreGive(devicesMutex);
-    }
-    else
-    {
-      logAndSend("Failed to take devicesMutex");
     }
 
-    preferences.end();
+    device.totalHeatingTime = deviceObj["total_heating"].as<long>();
+    device.currentTemperature = device.targetTemperature;
+    device.humidity = deviceObj["humidity"].as<float>();
+    device.battery = deviceObj["battery"].as<uint8_t>();
+    device.batteryV = deviceObj["batteryV"].as<uint16_t>();
+    loaded.push_back(device);
   }
-  else
+  return true;
+}
+
+// Чтение записи одного устройства по ключу NVS
+static bool readDeviceRecord(const char *key, std::vector<uint8_t> &buffer, std::vector<DeviceData> &loaded)
+{
+  std::vector<DeviceData> record;
+  if (readBlob(key, buffer) && decodeDevicesBlob(buffer.data(), buffer.size(), record) && record.size() == 1)
   {
-    logAndSend("Failed to open 'devices' namespace");
+    loaded.push_back(record[0]);
+    return true;
   }
+  logAndSend("Device record " + String(key) + " is missing or corrupted");
+  return false;
 }
 
-// Сохраняем клиентов в Preferences как единый Blob
-void saveClientsToFile()
+// Ключ записи устройства: "d" + 12 hex-символов MAC (см. persistDeviceKey)
+static bool isDeviceKey(const char *key)
 {
-  logAndSend("Начинаем сохранение устройств в файл");
+  if (key[0] != 'd' || strlen(key) != 13)
+  {
+    return false;
+  }
+  char *end;
+  strtoull(key + 1, &end, 16);
+  return *end == '\0';
+}
 
-  // Открываем пространство имен "devices" в режиме чтения-записи
-  if (preferences.begin("devices", false))
+// Перебор ключей устройств в пространстве имен "devices" (когда индекс поврежден)
+static void findDeviceKeys(std::vector<std::string> &keys)
+{
+  nvs_entry_info_t info;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+  nvs_iterator_t it = nullptr;
+  esp_err_t result = nvs_entry_find(NVS_DEFAULT_PART_NAME, "devices", NVS_TYPE_BLOB, &it);
+  while (result == ESP_OK)
   {
-    if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE)
+    nvs_entry_info(it, &info);
+    if (isDeviceKey(info.key))
     {
-      // Создаем JSON-документ для сериализации
-      JsonDocument doc;
-      JsonArray devicesArray = doc.to<JsonArray>();
+      keys.push_back(info.key);
+    }
+    result = nvs_entry_next(&it);
+  }
+#else
+  nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, "devices", NVS_TYPE_BLOB);
+  while (it != nullptr)
+  {
+    nvs_entry_info(it, &info);
+    if (isDeviceKey(info.key))
+    {
+      keys.push_back(info.key);
+    }
+    it = nvs_entry_next(it);
+  }
+#endif
+  nvs_release_iterator(it);
+}
 
-      // Добавляем каждое устройство в массив
-      for (const auto &device : devices)
-      {
-        JsonObject deviceObj = devicesArray.add<JsonObject>();
-
-        // Сохраняем основные поля
-        deviceObj["name"] = device.name;
-        deviceObj["mac"] = device.macAddress;
-        deviceObj["target_temp"] = device.targetTemperature;
-        deviceObj["enabled"] = device.enabled;
-        deviceObj["total_heating"] = device.totalHeatingTime;
-        deviceObj["humidity"] = device.humidity;
-        deviceObj["battery"] = device.battery;
-        deviceObj["batteryV"] = device.batteryV;
-        // Сохраняем массив GPIO пинов
-        for (uint8_t pin : device.gpioPins)
-        {
-          deviceObj["gpio_pins"].add(pin);
-        }
-      }
+// Загрузка устройств по индексу из отдельных ключей, false - индекса нет.
+// Поврежденный индекс восстанавливается перебором ключей устройств (rebuildIndex = true);
+// если ключей нет, возвращается false и используется старый devices_blob
+static bool loadDeviceRecords(std::vector<DeviceData> &loaded, bool &rebuildIndex)
+{
+  std::vector<uint8_t> buffer;
+  std::vector<uint64_t> index;
+  if (!readBlob("index", buffer))
+  {
+    return false;
+  }
+  char key[16];
+  if (decodeDeviceIndexBlob(buffer.data(), buffer.size(), index))
+  {
+    for (uint64_t mac : index)
+    {
+      persistDeviceKey(mac, key, sizeof(key));
+      readDeviceRecord(key, buffer, loaded);
+    }
+    return true;
+  }
 
-      // Определяем размер буфера для сериализации
-      size_t bufferSize = measureJson(doc);
+  logAndSend("Devices index is corrupted or has unknown version, searching device records");
+  std::vector<std::string> keys;
+  findDeviceKeys(keys);
+  for (const auto &deviceKey : keys)
+  {
+    readDeviceRecord(deviceKey.c_str(), buffer, loaded);
+  }
+  logAndSend("Recovered device records: " + String(loaded.size()) + " of " + String(keys.size()));
+  rebuildIndex = !loaded.empty();
+  return rebuildIndex;
+}
 
-      if (bufferSize > 0)
-      {
-        // Выделяем буфер
-        uint8_t *buffer = new uint8_t[bufferSize];
+// Загружаем клиентов из Preferences: индекс и по ключу на устройство (см. persist_scheduler.h).
+// Старый единый devices_blob (JSON или двоичный) переносится в новый формат и удаляется
+void loadClientsFromFile()
+{
+  logAndSend("Loading clients from Preferences...");
 
-        if (buffer)
-        {
-          // Сериализуем JSON в буфер
-          size_t serializedSize = serializeJson(doc, buffer, bufferSize);
-
-          // Сохраняем буфер в Preferences
-          if (preferences.putBytes("devices_blob", buffer, serializedSize))
-          {
-            logAndSend("Saved clients to Preferences blob");
-          }
-          else
-          {
-            logAndSend("Failed to save devices blob to Preferences");
-          }
-
-          // Освобождаем память
-          delete[] buffer;
-        }
-        else
-        {
-          logAndSend("Failed to allocate memory for serialization");
-        }
-      }
-      else
+  std::vector<uint8_t> buffer;
+  std::vector<DeviceData> loaded;
+  bool migrate = false;
+  bool rebuildIndex = false;
+
+  // Открываем пространство имен "devices" в режиме только для чтения
+  if (!preferences.begin("devices", true))
+  {
+    logAndSend("Failed to open 'devices' namespace");
+    return;
+  }
+  if (loadDeviceRecords(loaded, rebuildIndex))
+  {
+    // Устройства уже хранятся по отдельным ключам
+  }
+  else if (readBlob("devices_blob", buffer))
+  {
+    if (isPersistBlob(buffer.data(), buffer.size(), PERSIST_KIND_DEVICES))
+    {
+      migrate = decodeDevicesBlob(buffer.data(), buffer.size(), loaded);
+      if (!migrate)
       {
-        logAndSend("Empty devices collection, nothing to save");
+        logAndSend("Devices blob is corrupted or has unknown version");
+        loaded.clear();
       }
-
-      xSemaphoreGive(devicesMutex);
     }
     else
     {
-      logAndSend("Failed to take devicesMutex");
+      migrate = parseDevicesJson(buffer, loaded);
     }
-
-    preferences.end();
   }
   else
   {
-    logAndSend("Failed to open 'devices' namespace");
+    logAndSend("No devices data found in Preferences");
+  }
+  preferences.end();
+
+  // Разбор выполнен без блокировки, под ней только заполнение реестра
+  if (!devicesLock.lock())
+  {
+    logAndSend("Failed to take devicesLock");
+    return;
   }
+  devices.clear();
+  for (const auto &device : loaded)
+  {
+    // Добавляем устройство в реестр
+    devices.add(device);
+  }
+  if (rebuildIndex)
+  {
+    // Индекс перезаписывается по восстановленным устройствам, сами записи не меняются
+    markDeviceIndexDirty();
+  }
+  updateBleMacAllowlist();
+  deviceSnapshots.publish(devices);
+  devicesLock.unlock();
+  logAndSend("Loaded devices: " + String(loaded.size()));
+
+  if (migrate)
+  {
+    logAndSend("Migrating devices blob to per-device records");
+    saveClientsToFile();
+    // Старый blob удаляется только после успешной записи индекса
+    if (preferences.begin("devices", false))
+    {
+      if (preferences.getBytesLength("index") > 0)
+      {
+        preferences.remove("devices_blob");
+      }
+      preferences.end();
+    }
+  }
+}
+
+// Полная перезапись всех устройств и индекса (обычные изменения пишет планировщик)
+void saveClientsToFile()
+{
+  logAndSend("Начинаем сохранение устройств в файл");
+
+  if (!devicesLock.lock())
+  {
+    logAndSend("Failed to take devicesLock");
+    return;
+  }
+  for (auto &device : devices)
+  {
+    markDeviceAdded(device);
+  }
+  devicesLock.unlock();
+  flushPersistence();
 }
 
 // Загружаем настройки Wifi +++++++++++++++++++++++++++
@@ -248,71 +313,67 @@ void saveWifiCredentialsToFile()
     logAndSend("Нет доступа для записи данных wifi");
   }
 }
-// Функция для сохранения GPIO в файл
 // Функция для сохранения GPIO в Preferences как Blob
-void saveGpioToFile()
+bool saveGpioToFile(TickType_t lockTimeout)
 {
   logAndSend("Saving GPIO to Preferences...");
 
-  // Открываем пространство имен "gpio" в режиме чтения-записи
-  if (preferences.begin("gpio", false))
+  std::vector<uint8_t> buffer;
+  if (!devicesLock.lock(lockTimeout))
   {
-    // Создаем JSON-документ для сериализации
-    JsonDocument doc;
-    JsonArray gpioArray = doc.to<JsonArray>();
-
-    // Добавляем каждый GPIO в массив
-    for (const auto &gpio : availableGpio)
-    {
-      JsonObject gpioObj = gpioArray.add<JsonObject>();
-      gpioObj["pin"] = gpio.pin;
-      gpioObj["state"] = gpio.state;
-      gpioObj["name"] = gpio.name;
-      gpioObj["total_heating"] = gpio.totalHeatingTime;
-    }
+    logAndSend("Failed to take devicesLock");
+    return false;
+  }
+  encodeGpioBlob(availableGpio, buffer);
+  devicesLock.unlock();
 
-    // Определяем размер буфера для сериализации
-    size_t bufferSize = measureJson(doc);
+  bool saved = false;
 
-    if (bufferSize > 0)
+  // Открываем пространство имен "gpio" в режиме чтения-записи
+  if (preferences.begin("gpio", false))
+  {
+    if (preferences.putBytes("gpio_blob", buffer.data(), buffer.size()))
     {
-      // Выделяем буфер
-      uint8_t *buffer = new uint8_t[bufferSize];
-
-      if (buffer)
-      {
-        // Сериализуем JSON в буфер
-        size_t serializedSize = serializeJson(doc, buffer, bufferSize);
-
-        // Сохраняем буфер в Preferences
-        if (preferences.putBytes("gpio_blob", buffer, serializedSize))
-        {
-          logAndSend("Saved GPIO pins to Preferences blob");
-        }
-        else
-        {
-          logAndSend("Failed to save GPIO blob to Preferences");
-        }
-
-        // Освобождаем память
-        delete[] buffer;
-      }
-      else
-      {
-        logAndSend("Failed to allocate memory for serialization");
-      }
+      recordPersistWrite(buffer.size());
+      logAndSend("Saved GPIO pins to Preferences blob (" + String(buffer.size()) + " bytes)");
+      saved = true;
     }
     else
     {
-      logAndSend("Empty GPIO collection, nothing to save");
+      logAndSend("Failed to save GPIO blob to Preferences");
     }
-
     preferences.end();
   }
   else
   {
     logAndSend("Failed to open 'gpio' namespace");
   }
+  return saved;
+}
+
+// Разбор старого JSON-формата gpio_blob (для миграции)
+static bool parseGpioJson(const std::vector<uint8_t> &buffer, std::vector<GpioPin> &loaded)
+{
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, buffer.data(), buffer.size());
+  if (error)
+  {
+    logAndSend("deserializeJson() failed: " + String(error.c_str()));
+    return false;
+  }
+
+  // Преобразуем JSON в объекты GpioPin
+  JsonArray gpioArray = doc.as<JsonArray>();
+  for (JsonObject gpioObj : gpioArray)
+  {
+    GpioPin gpio;
+    gpio.pin = gpioObj["pin"].as<uint8_t>();
+    gpio.state = gpioObj["state"].as<uint8_t>();
+    gpio.name = gpioObj["name"].as<const char *>();
+    gpio.totalHeatingTime = gpioObj["total_heating"].as<long>();
+    loaded.push_back(gpio);
+  }
+  return true;
 }
 
 // Функция для загрузки GPIO из Preferences как Blob
@@ -320,65 +381,41 @@ void loadGpioFromFile()
 {
   logAndSend("Loading GPIO from Preferences...");
 
+  std::vector<uint8_t> buffer;
+  std::vector<GpioPin> loaded;
+  bool loadedOk = false;
+  bool migrate = false;
+
   // Открываем пространство имен "gpio" в режиме только для чтения
   if (preferences.begin("gpio", true))
   {
-    // Получаем размер сохраненного Blob
-    size_t blobSize = preferences.getBytesLength("gpio_blob");
-
-    if (blobSize > 0)
+    if (readBlob("gpio_blob", buffer))
     {
-      // Выделяем буфер для данных
-      uint8_t *buffer = new uint8_t[blobSize];
-
-      if (buffer)
+      if (isPersistBlob(buffer.data(), buffer.size(), PERSIST_KIND_GPIO))
       {
-        // Читаем данные в буфер
-        size_t readSize = preferences.getBytes("gpio_blob", buffer, blobSize);
-
-        if (readSize == blobSize)
+        loadedOk = decodeGpioBlob(buffer.data(), buffer.size(), loaded);
+        if (!loadedOk)
         {
-          // Десериализуем JSON из буфера
-          JsonDocument doc;
-          DeserializationError error = deserializeJson(doc, buffer, blobSize);
-
-          if (!error)
-          {
-            // Очищаем текущий вектор GPIO
-            availableGpio.clear();
-
-            // Преобразуем JSON в объекты GpioPin
-            JsonArray gpioArray = doc.as<JsonArray>();
-
-            for (JsonObject gpioObj : gpioArray)
-            {
-              GpioPin gpio;
-              gpio.pin = gpioObj["pin"].as<uint8_t>();
-              gpio.state = gpioObj["state"].as<uint8_t>();
-              gpio.name = gpioObj["name"].as<const char *>();
-              gpio.totalHeatingTime = gpioObj["total_heating"].as<long>();
-              // Добавляем GPIO в вектор
-              availableGpio.push_back(gpio);
-            }
-          }
-          else
-          {
-             logAndSend("deserializeJson() failed: " + String(error.c_str()));
-          }
+          logAndSend("GPIO blob is corrupted or has unknown version");
         }
-        else
-        {
-          logAndSend("Failed to read complete blob data");
-        }
-
-        // Освобождаем память
-        delete[] buffer;
       }
       else
       {
-        logAndSend("Failed to allocate memory for blob data");
+        loadedOk = migrate = parseGpioJson(buffer, loaded);
       }
     }
     preferences.end();
   }
-}
\ No newline at end of file
+
+  // При ошибке оставляем GPIO по умолчанию
+  if (loadedOk && devicesLock.lock())
+  {
+    availableGpio = loaded;
+    devicesLock.unlock();
+  }
+  if (migrate)
+  {
+    logAndSend("Migrating GPIO blob from JSON to binary format");
+    saveGpioToFile();
+  }
+}
@@ -9,7 +9,8 @@ void loadClientsFromFile();
 void saveClientsToFile();
 void loadWifiCredentialsFromFile();
 void saveWifiCredentialsToFile();
-void saveGpioToFile();
+// lockTimeout - ожидание devicesLock (тики), при истечении запись пропускается
+bool saveGpioToFile(TickType_t lockTimeout = portMAX_DELAY);
 void loadGpioFromFile();
 void loadServerWorkTime();
 void saveServerSetting();
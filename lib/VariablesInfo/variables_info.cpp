@@ -1,13 +1,10 @@
 #include <variables_info.h>
+#include <algorithm>
+#include <esp_heap_caps.h>
 String formatHeatingTime(unsigned long timeInMillis)
 {
-    unsigned long totalSeconds = timeInMillis / 1000;
-    unsigned long days = totalSeconds / 86400;
-    unsigned long hours = (totalSeconds % 86400) / 3600;
-    unsigned long minutes = (totalSeconds % 3600) / 60;
-    unsigned long seconds = totalSeconds % 60;
-    char buffer[30];
-    sprintf(buffer, "%lud %02lu:%02lu:%02lu", days, hours, minutes, seconds);
+    char buffer[HEATING_TIME_TEXT_SIZE];
+    formatHeatingTime(timeInMillis, buffer, sizeof(buffer));
     return String(buffer);
 }
 
@@ -38,3 +35,65 @@ void logAndSendf(const char* format, ...)
     }
 }
 
+
+// DeviceTableLock +++++++++++++++++++++++++++
+DeviceTableLock::DeviceTableLock() : stats(), statsMux(portMUX_INITIALIZER_UNLOCKED)
+{
+    mutex = xSemaphoreCreateMutex();
+}
+
+bool DeviceTableLock::lock(TickType_t timeout)
+{
+    unsigned long start = micros();
+    if (xSemaphoreTake(mutex, timeout) != pdTRUE)
+    {
+        return false;
+    }
+    uint32_t waitUs = micros() - start;
+    portENTER_CRITICAL(&statsMux);
+    stats.lockCount++;
+    stats.waitUs += waitUs;
+    stats.maxWaitUs = std::max(stats.maxWaitUs, waitUs);
+    portEXIT_CRITICAL(&statsMux);
+    return true;
+}
+
+void DeviceTableLock::unlock()
+{
+    xSemaphoreGive(mutex);
+}
+
+DeviceTableLockStats DeviceTableLock::getStats()
+{
+    portENTER_CRITICAL(&statsMux);
+    DeviceTableLockStats copy = stats;
+    portEXIT_CRITICAL(&statsMux);
+    return copy;
+}
+
+// DeviceSnapshotStore +++++++++++++++++++++++++++
+static void *allocateSnapshotBuffer(size_t size)
+{
+    void *memory = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return memory != nullptr ? memory : calloc(1, size);
+}
+
+// Повтор пропущенной публикации из release(); если блокировка не получена, флаг остается
+// и публикацию повторит следующий release() или писатель
+static void republishDeviceSnapshot()
+{
+    if (devicesLock.lock(pdMS_TO_TICKS(DEVICE_SNAPSHOT_REPUBLISH_WAIT)))
+    {
+        if (deviceSnapshots.publishPending())
+        {
+            deviceSnapshots.publish(devices);
+        }
+        devicesLock.unlock();
+    }
+}
+
+bool beginDeviceSnapshots()
+{
+    deviceSnapshots.setRetryHandler(republishDeviceSnapshot);
+    return deviceSnapshots.begin(allocateSnapshotBuffer);
+}
@@ -5,15 +5,25 @@
 #include <vector>
 #include <string>
 #include <AsyncEventSource.h>
+#include <atomic>
+#include <sensor_history.h>
+#include <device_model.h>
+#include <device_snapshot.h>
 #define WEB_SERVER_HOSTNAME "home-server"
 
 // Константы
 #define SCROLL_DELAY 300              // Задержка прокрутки текста (мс)
-#define CONTROL_DELAY 30000           // Интервал проверки и управления GPIO (мс)
+#define CONTROL_DELAY 30000           // Интервал полного обхода устройств; в остальное время управление идет по событиям (мс)
 #define WIFI_RECONNECT_DELAY 60000    // Интервал попыток переподключения к WiFi (мс)
-#define XIAOMI_SCAN_INTERVAL 20000    // Интервал сканирования датчиков Xiaomi (мс)
-#define XIAOMI_SCAN_DURATION 10       // Продолжительность сканирования BLE (секунд)
-#define XIAOMI_OFFLINE_TIMEOUT 300000 // 5 минут до перехода в оффлайн
+#define XIAOMI_SCAN_PERIOD 100        // Интервал непрерывного пассивного сканирования BLE (мс)
+#define XIAOMI_SCAN_WINDOW 60         // Окно сканирования BLE внутри интервала, остаток отдается WiFi (мс)
+#define XIAOMI_SCAN_RESTART_DELAY 5000 // Пауза перед перезапуском сканирования после остановки/ошибки (мс)
+#define XIAOMI_SCAN_STALL_TIMEOUT 120000 // Перезапуск сканирования, если пакеты не поступают (мс)
+#define DEVICE_SNAPSHOT_REPUBLISH_WAIT 100 // Ожидание блокировки при повторе пропущенной публикации (мс)
+#define PERSIST_CONFIG_DELAY 5000      // Задержка записи настроек после первого изменения, объединяет серии правок (мс)
+#define PERSIST_STATS_INTERVAL 300000  // Интервал записи накопленной статистики (мс)
+#define PERSIST_DIRTY_CONFIG 0x01      // Изменены настройки устройства (имя, температура, GPIO, включение, алгоритм)
+#define PERSIST_DIRTY_STATS 0x02       // Изменена статистика устройства (время работы обогрева)
 
 // Структура для хранения учетных данных WiFi
 struct WifiCredentials
@@ -29,97 +39,45 @@ void logAndSend(const String& message);
 
 void logAndSendf(const char* format, ...);
 
-// Объединенная структура данных для клиента/датчика
-struct DeviceData
+// Статистика ожидания блокировки таблицы устройств
+struct DeviceTableLockStats
 {
-    std::string name;               // Имя устройства
-    std::string macAddress;         // MAC-адрес датчика
-    float targetTemperature = 25.0; // Целевая температура
-    float currentTemperature = 0.0; // Текущая температура
-    float humidity = 0.0;           // Влажность
-    uint8_t battery = 0;            // Уровень заряда батареи
-    bool enabled = true;            // Включено ли устройство
-    bool isOnline = false;          // Находится ли устройство в сети
-    unsigned long lastUpdate = 0;   // Время последнего обновления данных
-    std::vector<uint8_t> gpioPins;  // Пины GPIO для управления
-    bool heatingActive;             // Добавляем поле для отслеживания текущего состояния обогрева
-    unsigned long heatingStartTime; // Время последнего включения обогрева
-    unsigned long totalHeatingTime; // Общее время работы обогрева в миллисекундах
-    uint16_t batteryV = 0;
-    // Конструктор по умолчанию
-    DeviceData() : name(""),
-                   macAddress(""),
-                   currentTemperature(25.0),
-                   humidity(0.0),
-                   battery(0),
-                   batteryV(0),
-                   lastUpdate(0),
-                   isOnline(false),
-                   targetTemperature(25.0),
-                   enabled(false),
-                   heatingStartTime(0),
-                   totalHeatingTime(0) {}
+    uint32_t lockCount;     // Количество захватов
+    uint64_t waitUs;        // Суммарное ожидание (мкс)
+    uint32_t maxWaitUs;     // Максимальное ожидание (мкс)
+};
 
-    // Конструктор с основными параметрами
-    DeviceData(const std::string &_name, const std::string &_mac) : name(_name),
-                                                                    macAddress(_mac),
-                                                                    currentTemperature(25.0),
-                                                                    humidity(0.0),
-                                                                    battery(0),
-                                                                    batteryV(0),
-                                                                    lastUpdate(0),
-                                                                    isOnline(true),
-                                                                    targetTemperature(25.0),
-                                                                    enabled(false),
-                                                                    heatingStartTime(0),
-                                                                    totalHeatingTime(0) {}
+// Блокировка таблицы устройств. Ее берут только изменяющие таблицу (BLE, управление, HTTP-правки,
+// сохранение); HTTP и LCD читают опубликованный снимок (DeviceSnapshotStore) без блокировки
+class DeviceTableLock
+{
+public:
+    DeviceTableLock();
 
-    // Метод для обновления данных датчика
-    void updateSensorData(float temp, float hum, uint8_t bat, uint16_t batV)
-    {
-        currentTemperature = temp;
-        humidity = hum;
-        battery = bat;
-        lastUpdate = millis();
-        isOnline = true;
-        batteryV = batV;
-    }
+    bool lock(TickType_t timeout = portMAX_DELAY);
+    void unlock();
 
-    // Метод для проверки актуальности данных
-    bool isDataValid(unsigned long timeout = XIAOMI_OFFLINE_TIMEOUT) const
-    {
-        return isOnline && (millis() - lastUpdate < timeout);
-    }
-};
+    DeviceTableLockStats getStats();
 
-enum stateGpioPin : uint8_t
-{
-    STATE_GPIO_AUTO,
-    STATE_GPIO_ON,
-    STATE_GPIO_OFF
+private:
+    SemaphoreHandle_t mutex;
+    DeviceTableLockStats stats;
+    portMUX_TYPE statsMux;
 };
 
-struct GpioPin
-{
-    uint8_t pin;
-    uint8_t state; // 0-авто, 1-вкл 2-выкл
-    std::string name;
-    unsigned long totalHeatingTime; // Общее время работы обогрева в миллисекундах
-    GpioPin() : pin(0),
-                state(STATE_GPIO_AUTO),
-                name(""),
-                totalHeatingTime(0) {}
-    GpioPin(uint8_t p, uint8_t s, const std::string &n) : pin(p), state(s), name(n), totalHeatingTime(0) {}
-};
+// Выделение буферов снимка в PSRAM и подключение повтора пропущенной публикации под devicesLock
+bool beginDeviceSnapshots();
+
 // Глобальные переменные (объявлены как extern)
-extern std::vector<DeviceData> devices;
+extern DeviceRegistry devices;
+extern DeviceSnapshotStore deviceSnapshots;
 extern std::vector<GpioPin> availableGpio;
 extern int gpioSelectionIndex;
 extern WifiCredentials wifiCredentials;
 extern bool wifiConnected;
 extern unsigned long lastWiFiAttemptTime;
-// Мьютекс для защиты доступа к общим данным
-extern SemaphoreHandle_t devicesMutex;
+// Блокировка для изменения таблицы устройств и списка availableGpio
+extern DeviceTableLock devicesLock;
 extern float board_temperature;
 extern unsigned long serverWorkTime;
 extern float hysteresisTemp;
@@ -0,0 +1,27 @@
+#include "device_json.h"
+#include <memory>
+
+void sendDeviceJson(AsyncWebServerRequest *request, DeviceJsonFormatter formatter)
+{
+    bool delta = request->hasParam("since");
+    uint32_t sinceSeq = delta ? (uint32_t)strtoul(request->getParam("since")->value().c_str(), nullptr, 10) : 0;
+
+    std::shared_ptr<DeviceJsonStream> stream = std::make_shared<DeviceJsonStream>(deviceSnapshots, formatter, delta, sinceSeq);
+    uint32_t currentSeq = stream->changeSeq();
+    if (delta && sinceSeq == currentSeq && sinceSeq != 0)
+    {
+        // Изменений нет
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("X-Change-Seq", String(currentSeq));
+        request->send(response);
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+                                                                     [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                     {
+                                                                         return stream->fill(buffer, maxLen);
+                                                                     });
+    response->addHeader("X-Change-Seq", String(currentSeq));
+    request->send(response);
+}
@@ -0,0 +1,14 @@
+#ifndef DEVICE_JSON_H
+#define DEVICE_JSON_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <variables_info.h>
+#include <device_json_stream.h>
+
+// Отправка массива устройств из текущего снимка chunked-ответом.
+// С параметром ?since=N отдается дельта, а если изменений нет - 304 без тела.
+// Текущий номер изменения всегда передается в заголовке X-Change-Seq
+void sendDeviceJson(AsyncWebServerRequest *request, DeviceJsonFormatter formatter);
+
+#endif
@@ -0,0 +1,151 @@
+#include "history_binary.h"
+#include <variables_info.h>
+#include <memory>
+
+HistoryBinaryStream::HistoryBinaryStream(const uint64_t *macList, size_t count, uint8_t tier, uint32_t from, uint32_t to) : deviceCount(std::min(count, (size_t)HISTORY_MAX_DEVICES)),
+                                                                                                                          deviceIndex(0),
+                                                                                                                          tier(tier),
+                                                                                                                          from(from),
+                                                                                                                          to(to),
+                                                                                                                          next(from),
+                                                                                                                          stage(STREAM_HEADER),
+                                                                                                                          pointCount(0),
+                                                                                                                          pointIndex(0),
+                                                                                                                          stagedLength(0),
+                                                                                                                          stagedOffset(0)
+{
+    memcpy(macs, macList, deviceCount * sizeof(uint64_t));
+}
+
+// Переход к следующей порции данных: заголовок, MAC устройства или очередные отсчеты в кодировщике.
+// false - поток завершен
+bool HistoryBinaryStream::advance()
+{
+    switch (stage)
+    {
+    case STREAM_HEADER:
+        formatHistoryBinaryHeader(tier, (uint16_t)sensorHistoryInterval(tier), sensorHistoryNow(), from, to,
+                                  (uint16_t)deviceCount, staged);
+        stagedLength = HISTORY_BINARY_HEADER_SIZE;
+        stagedOffset = 0;
+        stage = STREAM_DEVICE;
+        return true;
+    case STREAM_DEVICE:
+        if (deviceIndex >= deviceCount)
+        {
+            stage = STREAM_DONE;
+            return false;
+        }
+        // Первая порция читается заранее: пустое устройство передается без потока отсчетов
+        pointIndex = 0;
+        if (!sensorHistoryRead(macs[deviceIndex], tier, from, to, points, HISTORY_BINARY_BATCH, pointCount, next))
+        {
+            pointCount = 0;
+        }
+        formatHistoryBinaryDevice(macs[deviceIndex], pointCount > 0, staged);
+        stagedLength = HISTORY_BINARY_DEVICE_SIZE;
+        stagedOffset = 0;
+        if (pointCount > 0)
+        {
+            encoder = SampleEncoder();
+            stage = STREAM_POINTS;
+        }
+        else
+        {
+            deviceIndex++;
+        }
+        return true;
+    case STREAM_POINTS:
+        // Кодировщик принимает отсчеты, пока в его буфере есть место; остальное заберет fill()
+        while (pointIndex < pointCount || next <= to)
+        {
+            if (pointIndex >= pointCount)
+            {
+                pointIndex = 0;
+                if (!sensorHistoryRead(macs[deviceIndex], tier, next, to, points, HISTORY_BINARY_BATCH, pointCount, next))
+                {
+                    pointCount = 0;
+                    next = to + 1;
+                }
+                continue;
+            }
+            if (!encoder.append(historyCodecSample(points[pointIndex])))
+            {
+                return true;
+            }
+            pointIndex++;
+        }
+        if (encoder.finish())
+        {
+            deviceIndex++;
+            stage = STREAM_DEVICE;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t HistoryBinaryStream::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (stagedOffset < stagedLength)
+        {
+            size_t chunk = std::min(stagedLength - stagedOffset, maxLen - written);
+            memcpy(buffer + written, staged + stagedOffset, chunk);
+            stagedOffset += chunk;
+            written += chunk;
+        }
+        else if (encoder.available() > 0)
+        {
+            written += encoder.read(buffer + written, maxLen - written);
+        }
+        else if (!advance())
+        {
+            break;
+        }
+    }
+    return written;
+}
+
+void sendHistoryBinary(AsyncWebServerRequest *request)
+{
+    uint64_t macs[HISTORY_MAX_DEVICES];
+    size_t deviceCount = 0;
+    if (request->hasParam("mac"))
+    {
+        if (!parseMacAddress(request->getParam("mac")->value().c_str(), macs[0]))
+        {
+            request->send(400, "text/plain", "Invalid mac");
+            return;
+        }
+        deviceCount = 1;
+    }
+    else
+    {
+        deviceCount = sensorHistoryDevices(macs, HISTORY_MAX_DEVICES);
+    }
+
+    uint32_t now = sensorHistoryNow();
+    uint32_t to = request->hasParam("to") ? (uint32_t)strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : now;
+    to = std::min(to, now);
+    uint32_t defaultFrom = now > HISTORY_RAW_INTERVAL * HISTORY_RAW_SLOTS ? now - HISTORY_RAW_INTERVAL * HISTORY_RAW_SLOTS : 0;
+    uint32_t from = request->hasParam("from") ? (uint32_t)strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : defaultFrom;
+    uint32_t interval = request->hasParam("res") ? (uint32_t)strtoul(request->getParam("res")->value().c_str(), nullptr, 10) : 0;
+    int tier = sensorHistoryTierFor(interval, from);
+    if (tier < 0 || from > to)
+    {
+        request->send(400, "text/plain", "Invalid range or resolution");
+        return;
+    }
+
+    std::shared_ptr<HistoryBinaryStream> stream = std::make_shared<HistoryBinaryStream>(macs, deviceCount, (uint8_t)tier, from, to);
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/octet-stream",
+                                                                     [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                     {
+                                                                         return stream->fill(buffer, maxLen);
+                                                                     });
+    request->send(response);
+}
@@ -0,0 +1,52 @@
+#ifndef HISTORY_BINARY_H
+#define HISTORY_BINARY_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <sensor_history.h>
+#include <history_format.h>
+
+// Двоичная выгрузка истории /history.bin, формат - history_format.h
+#define HISTORY_BINARY_BATCH 32 // Точек, читаемых из истории за один захват мьютекса
+
+class HistoryBinaryStream
+{
+public:
+    HistoryBinaryStream(const uint64_t *macs, size_t deviceCount, uint8_t tier, uint32_t from, uint32_t to);
+
+    // Заполнение очередного фрагмента chunked-ответа прямо из буферов истории, 0 - ответ завершен
+    size_t fill(uint8_t *buffer, size_t maxLen);
+
+private:
+    bool advance();
+
+    enum Stage
+    {
+        STREAM_HEADER,
+        STREAM_DEVICE,
+        STREAM_POINTS,
+        STREAM_DONE
+    };
+
+    uint64_t macs[HISTORY_MAX_DEVICES];
+    size_t deviceCount;
+    size_t deviceIndex;
+    uint8_t tier;
+    uint32_t from;
+    uint32_t to;
+    uint32_t next;
+    Stage stage;
+    SampleEncoder encoder;
+    HistoryPoint points[HISTORY_BINARY_BATCH];
+    size_t pointCount;
+    size_t pointIndex;
+    uint8_t staged[HISTORY_BINARY_HEADER_SIZE]; // Заголовок потока или MAC устройства
+    size_t stagedLength;
+    size_t stagedOffset;
+};
+
+// GET /history.bin?mac=..&from=..&to=..&res=..
+// Без mac выгружаются все устройства; from/to/res - как у /history
+void sendHistoryBinary(AsyncWebServerRequest *request);
+
+#endif
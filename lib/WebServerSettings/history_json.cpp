@@ -0,0 +1,108 @@
+#include "history_json.h"
+#include <variables_info.h>
+#include <memory>
+
+HistoryJsonStream::HistoryJsonStream(uint64_t mac, uint8_t tier, uint32_t from, uint32_t to) : mac(mac),
+                                                                                                tier(tier),
+                                                                                                from(from),
+                                                                                                to(to),
+                                                                                                next(from),
+                                                                                                stage(STREAM_OPEN),
+                                                                                                firstPoint(true),
+                                                                                                pointCount(0),
+                                                                                                pointIndex(0),
+                                                                                                recordLength(0),
+                                                                                                recordOffset(0)
+{
+}
+
+// Подготовка следующего фрагмента в record, false - данных больше нет
+bool HistoryJsonStream::formatNext()
+{
+    recordOffset = 0;
+    recordLength = 0;
+    switch (stage)
+    {
+    case STREAM_OPEN:
+        recordLength = formatHistoryJsonOpen(mac, sensorHistoryInterval(tier), sensorHistoryNow(), from, to,
+                                             record, sizeof(record));
+        stage = STREAM_POINTS;
+        return true;
+    case STREAM_POINTS:
+        // Точки читаются порциями, мьютекс истории не удерживается во время отправки
+        if (pointIndex >= pointCount && next <= to)
+        {
+            pointIndex = 0;
+            if (!sensorHistoryRead(mac, tier, next, to, points, HISTORY_JSON_BATCH, pointCount, next))
+            {
+                pointCount = 0;
+                next = to + 1;
+            }
+        }
+        if (pointIndex < pointCount)
+        {
+            recordLength = formatHistoryJsonPoint(points[pointIndex++], firstPoint, record, sizeof(record));
+            firstPoint = false;
+            return true;
+        }
+        if (next <= to)
+        {
+            return formatNext();
+        }
+        stage = STREAM_CLOSE;
+        return formatNext();
+    case STREAM_CLOSE:
+        recordLength = snprintf(record, sizeof(record), HISTORY_JSON_CLOSE);
+        stage = STREAM_DONE;
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t HistoryJsonStream::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (recordOffset >= recordLength && !formatNext())
+        {
+            break;
+        }
+        size_t chunk = std::min(recordLength - recordOffset, maxLen - written);
+        memcpy(buffer + written, record + recordOffset, chunk);
+        recordOffset += chunk;
+        written += chunk;
+    }
+    return written;
+}
+
+void sendHistoryJson(AsyncWebServerRequest *request)
+{
+    uint64_t mac = 0;
+    if (!request->hasParam("mac") || !parseMacAddress(request->getParam("mac")->value().c_str(), mac))
+    {
+        request->send(400, "text/plain", "Invalid mac");
+        return;
+    }
+    uint32_t now = sensorHistoryNow();
+    uint32_t to = request->hasParam("to") ? (uint32_t)strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : now;
+    to = std::min(to, now);
+    uint32_t defaultFrom = now > HISTORY_RAW_INTERVAL * HISTORY_RAW_SLOTS ? now - HISTORY_RAW_INTERVAL * HISTORY_RAW_SLOTS : 0;
+    uint32_t from = request->hasParam("from") ? (uint32_t)strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : defaultFrom;
+    uint32_t interval = request->hasParam("res") ? (uint32_t)strtoul(request->getParam("res")->value().c_str(), nullptr, 10) : 0;
+    int tier = sensorHistoryTierFor(interval, from);
+    if (tier < 0 || from > to)
+    {
+        request->send(400, "text/plain", "Invalid range or resolution");
+        return;
+    }
+
+    std::shared_ptr<HistoryJsonStream> stream = std::make_shared<HistoryJsonStream>(mac, (uint8_t)tier, from, to);
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+                                                                     [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                     {
+                                                                         return stream->fill(buffer, maxLen);
+                                                                     });
+    request->send(response);
+}
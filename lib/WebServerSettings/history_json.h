@@ -0,0 +1,51 @@
+#ifndef HISTORY_JSON_H
+#define HISTORY_JSON_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <sensor_history.h>
+#include <history_format.h>
+
+#define HISTORY_JSON_BATCH 32 // Точек, читаемых из истории за один захват мьютекса
+
+// Потоковая выдача диапазона истории устройства, формат - history_format.h
+class HistoryJsonStream
+{
+public:
+    HistoryJsonStream(uint64_t mac, uint8_t tier, uint32_t from, uint32_t to);
+
+    // Заполнение очередного фрагмента chunked-ответа, 0 - ответ завершен
+    size_t fill(uint8_t *buffer, size_t maxLen);
+
+private:
+    bool formatNext();
+
+    enum Stage
+    {
+        STREAM_OPEN,
+        STREAM_POINTS,
+        STREAM_CLOSE,
+        STREAM_DONE
+    };
+
+    uint64_t mac;
+    uint8_t tier;
+    uint32_t from;
+    uint32_t to;
+    uint32_t next;
+    Stage stage;
+    bool firstPoint;
+    HistoryPoint points[HISTORY_JSON_BATCH];
+    size_t pointCount;
+    size_t pointIndex;
+    char record[HISTORY_JSON_RECORD_MAX];
+    size_t recordLength;
+    size_t recordOffset;
+};
+
+// GET /history?mac=..&from=..&to=..&res=..
+// from/to - секунды от загрузки (по умолчанию последние 24 часа), res - интервал уровня в секундах
+// (60, 300, 3600; по умолчанию самый подробный уровень, хранящий from)
+void sendHistoryJson(AsyncWebServerRequest *request);
+
+#endif
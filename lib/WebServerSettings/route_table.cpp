@@ -0,0 +1,36 @@
+#include "route_table.h"
+
+const Route *RouteTableHandler::find(AsyncWebServerRequest *request) const
+{
+    return findRoute(routes, lookup, request->method(), request->url().c_str());
+}
+
+bool RouteTableHandler::canHandle(AsyncWebServerRequest *request)
+{
+    return find(request) != nullptr;
+}
+
+void RouteTableHandler::handleRequest(AsyncWebServerRequest *request)
+{
+    const Route *route = find(request);
+    if (route == nullptr)
+    {
+        request->send(404, "text/plain", "Not found");
+        return;
+    }
+    if (route->response == ROUTE_JSON)
+    {
+        JsonDocument doc;
+        route->json(doc);
+        sendJsonDocument(request, doc);
+        return;
+    }
+    route->handler(request);
+}
+
+void sendJsonDocument(AsyncWebServerRequest *request, const JsonDocument &doc)
+{
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    serializeJson(doc, *response);
+    request->send(response);
+}
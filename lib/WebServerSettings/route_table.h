@@ -0,0 +1,59 @@
+#ifndef ROUTE_TABLE_H
+#define ROUTE_TABLE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include <route_key.h>
+
+// Тип ответа маршрута: JSON собирается в общем документе и отправляется диспетчером,
+// остальные обработчики отвечают сами (TEXT - короткий ответ, STREAM - chunked/поток)
+enum RouteResponse
+{
+    ROUTE_JSON,
+    ROUTE_TEXT,
+    ROUTE_STREAM
+};
+
+typedef void (*RouteHandler)(AsyncWebServerRequest *request);
+typedef void (*RouteJsonBuilder)(JsonDocument &doc);
+
+struct Route
+{
+    uint8_t method;
+    const char *path;
+    RouteResponse response;
+    RouteHandler handler;  // ROUTE_TEXT, ROUTE_STREAM
+    RouteJsonBuilder json; // ROUTE_JSON
+};
+
+// Запись таблицы для списка маршрутов (см. route_key.h)
+#define ROUTE_ENTRY(name, method, path, response) ROUTE_ENTRY_##response(name, method, path),
+
+#define ROUTE_ENTRY_ROUTE_JSON(name, method, path) {method, path, ROUTE_JSON, nullptr, name}
+#define ROUTE_ENTRY_ROUTE_TEXT(name, method, path) {method, path, ROUTE_TEXT, name, nullptr}
+#define ROUTE_ENTRY_ROUTE_STREAM(name, method, path) {method, path, ROUTE_STREAM, name, nullptr}
+
+// Единый обработчик таблицы маршрутов вместо цепочки server.on:
+// один проход по URL для хэша, switch по ключу и одна проверка строки
+class RouteTableHandler : public AsyncWebHandler
+{
+public:
+    RouteTableHandler(const Route *routes, RouteLookup lookup) : routes(routes), lookup(lookup) {}
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+    // Обработчики читают параметры POST, поэтому тело запроса нужно разбирать
+    bool isRequestHandlerTrivial() override { return false; }
+
+private:
+    const Route *find(AsyncWebServerRequest *request) const;
+
+    const Route *routes;
+    RouteLookup lookup;
+};
+
+// Отправка JSON-документа потоком, без промежуточной строки
+void sendJsonDocument(AsyncWebServerRequest *request, const JsonDocument &doc);
+
+#endif
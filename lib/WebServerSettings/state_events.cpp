@@ -0,0 +1,71 @@
+#include "state_events.h"
+#include "device_json.h"
+#include <variables_info.h>
+
+AsyncEventSource stateEvents("/state_events");
+
+static TaskHandle_t stateEventsTask = nullptr;
+
+// Вызывается из DeviceSnapshotStore::publish под devicesLock - только будим задачу
+static void onSnapshotPublished()
+{
+    if (stateEventsTask != nullptr)
+    {
+        xTaskNotifyGive(stateEventsTask);
+    }
+}
+
+static void stateEventsTaskFunction(void *parameter)
+{
+    uint32_t lastSentSeq = 0;
+    // Запись вне стека: с длинным именем она больше половины STATE_EVENTS_STACK_SIZE, а задача одна
+    static char record[DEVICE_JSON_RECORD_MAX];
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Все изменения за окно уходят одним событием на устройство с последним состоянием
+        vTaskDelay(STATE_EVENTS_COALESCE_MS / portTICK_PERIOD_MS);
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        const DeviceSnapshot *snapshot = deviceSnapshots.acquire();
+        if (snapshot == nullptr)
+        {
+            continue;
+        }
+        if (stateEvents.count() > 0)
+        {
+            if (snapshot->removedSeq > lastSentSeq || snapshot->changeSeq < lastSentSeq)
+            {
+                snprintf(record, sizeof(record), "%lu", (unsigned long)snapshot->changeSeq);
+                stateEvents.send(record, "reset", snapshot->changeSeq);
+            }
+            else
+            {
+                for (size_t i = 0; i < snapshot->count; i++)
+                {
+                    const DeviceSnapshotEntry &device = snapshot->entries[i];
+                    if (device.changeSeq > lastSentSeq && formatStateEventJson(device, record, sizeof(record)) > 0)
+                    {
+                        stateEvents.send(record, "device", device.changeSeq);
+                    }
+                }
+            }
+        }
+        lastSentSeq = snapshot->changeSeq;
+        deviceSnapshots.release(snapshot);
+    }
+}
+
+void initStateEvents(AsyncWebServer &server)
+{
+    server.addHandler(&stateEvents);
+    stateEvents.onConnect([](AsyncEventSourceClient *client)
+                          {
+        const DeviceSnapshot *snapshot = deviceSnapshots.acquire();
+        uint32_t seq = snapshot != nullptr ? snapshot->changeSeq : 0;
+        deviceSnapshots.release(snapshot);
+        client->send(String(seq).c_str(), "hello", seq); });
+
+    xTaskCreate(stateEventsTaskFunction, "stateEvents", STATE_EVENTS_STACK_SIZE, NULL, 1, &stateEventsTask);
+    deviceSnapshots.setListener(onSnapshotPublished);
+}
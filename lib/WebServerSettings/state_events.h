@@ -0,0 +1,20 @@
+#ifndef STATE_EVENTS_H
+#define STATE_EVENTS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#define STATE_EVENTS_COALESCE_MS 1000 // Окно объединения изменений: не чаще одного события на устройство (мс)
+#define STATE_EVENTS_STACK_SIZE 4096  // Стек задачи рассылки событий (байт)
+
+// Поток изменений состояния устройств (/state_events).
+// События:
+//   "hello"  - номер текущего изменения при подключении, клиент догружает список через ?since=;
+//   "device" - актуальное состояние одного изменившегося устройства (JSON с полем seq);
+//   "reset"  - устройства удалялись, клиенту нужно перезапросить полный список.
+extern AsyncEventSource stateEvents;
+
+// Регистрация обработчика в веб-сервере и запуск задачи рассылки
+void initStateEvents(AsyncWebServer &server);
+
+#endif
@@ -0,0 +1,143 @@
+#include "static_assets.h"
+#include <SPIFFS.h>
+#include <persist_codec.h>
+
+#ifdef EMBED_WEB_ASSETS
+// Сжатый gzip ресурс в прошивке, ETag рассчитан скриптом сборки
+struct EmbeddedAsset
+{
+    const char *path;
+    const uint8_t *data;
+    size_t length;
+    const char *etag;
+};
+
+#include <web_assets_data.h>
+#endif
+
+struct StaticAsset
+{
+    const char *url;
+    const char *path;
+    const char *contentType;
+    const char *cacheControl;
+};
+
+static const StaticAsset staticAssets[] = {
+    {"/", "/index.html", "text/html", STATIC_CACHE_PAGE},
+    {"/index.html", "/index.html", "text/html", STATIC_CACHE_PAGE},
+    {"/managment_device.html", "/managment_device.html", "text/html", STATIC_CACHE_PAGE},
+    {"/gpio_settings.html", "/gpio_settings.html", "text/html", STATIC_CACHE_PAGE},
+    {"/heating_stats.html", "/heating_stats.html", "text/html", STATIC_CACHE_PAGE},
+    {"/logs.html", "/logs.html", "text/html", STATIC_CACHE_PAGE},
+    {"/setup_device.html", "/setup_device.html", "text/html", STATIC_CACHE_PAGE},
+    {"/app.css", "/app.css", "text/css", STATIC_CACHE_ASSET},
+};
+
+#define STATIC_ASSET_COUNT (sizeof(staticAssets) / sizeof(staticAssets[0]))
+
+// ETag по содержимому отдаваемого файла, считается при первом запросе.
+// Запросы обслуживает одна задача async_tcp, поэтому блокировка не нужна
+static String staticEtags[STATIC_ASSET_COUNT];
+
+#ifdef EMBED_WEB_ASSETS
+static const EmbeddedAsset *findEmbeddedAsset(const char *path)
+{
+    for (const EmbeddedAsset &embedded : embeddedAssets)
+    {
+        if (strcmp(embedded.path, path) == 0)
+        {
+            return &embedded;
+        }
+    }
+    return nullptr;
+}
+
+// Встроенный ресурс для каждой записи staticAssets, nullptr - отдается из SPIFFS
+static const EmbeddedAsset *staticEmbedded[STATIC_ASSET_COUNT];
+#endif
+
+static String computeEtag(const char *path)
+{
+    String gzPath = String(path) + ".gz";
+    File file = SPIFFS.open(SPIFFS.exists(gzPath) ? gzPath : String(path), "r");
+    if (!file)
+    {
+        return String();
+    }
+    uint8_t buffer[STATIC_ETAG_CHUNK];
+    uint32_t crc = 0;
+    size_t size = file.size();
+    size_t length;
+    while ((length = file.read(buffer, sizeof(buffer))) > 0)
+    {
+        crc = persistCrc32(buffer, length, crc);
+    }
+    file.close();
+
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%08lx-%x\"", (unsigned long)crc, (unsigned)size);
+    return String(etag);
+}
+
+static void sendStaticAsset(AsyncWebServerRequest *request, size_t index)
+{
+    const StaticAsset &asset = staticAssets[index];
+#ifdef EMBED_WEB_ASSETS
+    const EmbeddedAsset *embedded = staticEmbedded[index];
+    if (embedded != nullptr)
+    {
+        AsyncWebServerResponse *response;
+        if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == embedded->etag)
+        {
+            response = request->beginResponse(304);
+        }
+        else
+        {
+            // Данные отдаются прямо из flash, без копии в RAM
+            response = request->beginResponse_P(200, asset.contentType, embedded->data, embedded->length);
+            response->addHeader("Content-Encoding", "gzip");
+        }
+        response->addHeader("ETag", embedded->etag);
+        response->addHeader("Cache-Control", asset.cacheControl);
+        request->send(response);
+        return;
+    }
+#endif
+    String &etag = staticEtags[index];
+    if (etag.isEmpty())
+    {
+        etag = computeEtag(asset.path);
+        if (etag.isEmpty())
+        {
+            request->send(404, "text/plain", "Not found");
+            return;
+        }
+    }
+
+    AsyncWebServerResponse *response;
+    if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == etag)
+    {
+        response = request->beginResponse(304);
+    }
+    else
+    {
+        // При отсутствии файла библиотека сама берет <файл>.gz и ставит Content-Encoding: gzip
+        response = request->beginResponse(SPIFFS, asset.path, asset.contentType);
+    }
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", asset.cacheControl);
+    request->send(response);
+}
+
+void registerStaticAssets(AsyncWebServer &server)
+{
+    for (size_t i = 0; i < STATIC_ASSET_COUNT; i++)
+    {
+#ifdef EMBED_WEB_ASSETS
+        staticEmbedded[i] = findEmbeddedAsset(staticAssets[i].path);
+#endif
+        server.on(staticAssets[i].url, HTTP_GET, [i](AsyncWebServerRequest *request)
+                  { sendStaticAsset(request, i); });
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Политика кэширования: страницы перепроверяются по ETag при каждом открытии,
+// остальные ресурсы подключаются со ссылкой ?v=<хэш> (scripts/gzip_data.py) и не меняются
+#define STATIC_CACHE_PAGE "no-cache"
+#define STATIC_CACHE_ASSET "public, max-age=31536000, immutable"
+#define STATIC_ETAG_CHUNK 512 // Размер блока чтения файла при расчете ETag
+
+// С флагом сборки EMBED_WEB_ASSETS сжатые ресурсы встраиваются в прошивку (rodata во flash)
+// генерируемым web_assets_data.h и отдаются без чтения SPIFFS; ресурсы, которых нет
+// в прошивке, и сборки без флага по-прежнему читаются из SPIFFS
+
+// Регистрация страниц и ресурсов. Сжатый вариант <файл>.gz отдается
+// с Content-Encoding: gzip, повторный запрос с If-None-Match получает 304
+void registerStaticAssets(AsyncWebServer &server);
+
+#endif
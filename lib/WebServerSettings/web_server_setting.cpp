@@ -4,6 +4,15 @@
 #include <variables_info.h>
 #include <spiffs_setting.h>
 #include "xiaomi_scanner.h"
+#include "device_json.h"
+#include "state_events.h"
+#include <persist_scheduler.h>
+#include <heating_journal.h>
+#include <heating_control.h>
+#include "history_json.h"
+#include "history_binary.h"
+#include "static_assets.h"
+#include "route_table.h"
 #include <SPIFFS.h>
 
 // Web Server
@@ -37,6 +46,567 @@ void connectWiFi()
     }
 }
 
+// Обработчики маршрутов +++++++++++++++++++++++++++++++++
+
+// Общая сериализация списка GPIO для /availablegpio и /heating_gpio_stats.
+// Список GPIO меняет задача управления (время работы) - читаем под devicesLock
+static void addGpioJson(JsonArray gpioArray, bool withStats)
+{
+    if (!devicesLock.lock())
+    {
+        return;
+    }
+    for (const auto &gpio : availableGpio)
+    {
+        JsonObject gpioObj = gpioArray.add<JsonObject>();
+        gpioObj["pin"] = gpio.pin;
+        gpioObj["state"] = gpio.state;
+        gpioObj["name"] = gpio.name;
+        if (withStats)
+        {
+            gpioObj["totalHeatingTimeFormatted"] = formatHeatingTime(gpio.totalHeatingTime);
+        }
+    }
+    devicesLock.unlock();
+}
+
+// GET /clients (get list of all clients)
+static void handleClients(AsyncWebServerRequest *request)
+{
+    sendDeviceJson(request, formatClientJson);
+}
+
+static void handleAvailableGpio(JsonDocument &doc)
+{
+    addGpioJson(doc.to<JsonArray>(), false);
+}
+
+static void handleSaveAvailableGpio(AsyncWebServerRequest *request)
+{
+    if (!request->hasParam("availablegpio", true))
+    {
+        request->send(400, "text/plain", "availablegpio parameter not found");
+        return;
+    }
+    String jsonStr = request->getParam("availablegpio", true)->value();
+
+    // Используем ArduinoJson 7.x для парсинга
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, jsonStr);
+    if (error)
+    {
+        request->send(400, "text/plain", "Invalid JSON format");
+        return;
+    }
+    // Парсим массив GPIO пинов без блокировки
+    std::vector<GpioPin> updated;
+    JsonArray gpioArray = doc.as<JsonArray>();
+    for (JsonObject gpioObj : gpioArray)
+    {
+        GpioPin gpio;
+        gpio.pin = gpioObj["pin"].as<uint8_t>();
+        gpio.state = gpioObj["state"].as<uint8_t>();
+        gpio.name = gpioObj["name"].as<const char *>();
+        updated.push_back(gpio);
+    }
+
+    // Замена списка - под devicesLock, как и его обход задачей управления.
+    // Оставшиеся пины сохраняют время работы и текущий уровень выхода
+    if (!devicesLock.lock())
+    {
+        request->send(503, "text/plain", "Devices busy");
+        return;
+    }
+    for (auto &gpio : updated)
+    {
+        for (const auto &previous : availableGpio)
+        {
+            if (previous.pin == gpio.pin)
+            {
+                gpio.totalHeatingTime = previous.totalHeatingTime;
+                gpio.outputActive = previous.outputActive;
+                break;
+            }
+        }
+    }
+    availableGpio.swap(updated);
+    devicesLock.unlock();
+
+    markGpioConfigDirty();
+    requestControlSweep();
+    request->send(200, "text/plain", "availablegpio updated");
+}
+
+static void handleServerInfo(JsonDocument &doc)
+{
+    doc["cpu_frequency_mhz"] = ESP.getCpuFreqMHz();                     // Частота CPU
+    doc["chip_revision"] = ESP.getChipRevision();                       // Ревизия чипа
+    doc["processor_cores"] = ESP.getChipCores();                        // Ядер процессора
+    doc["sdk_version"] = ESP.getSdkVersion();                           // Версия SDK
+    doc["sram_size_bytes"] = ESP.getHeapSize();                         // Размер SRAM
+    doc["free_sram_bytes"] = ESP.getFreeHeap();                         // Свободная SRAM
+    doc["flash_size_bytes"] = ESP.getFlashChipSize();                   // Размер Flash
+    doc["flash_frequency_mhz"] = ESP.getFlashChipSpeed() / 1000000;     // Частота Flash
+    doc["psram_size_bytes"] = ESP.getPsramSize();                       // Размер PSRAM
+    doc["free_psram_bytes"] = ESP.getFreePsram();                       // Свободная PSRAM
+    doc["flash_mode"] = ESP.getFlashChipMode() == FM_QIO ? "QIO" : "DIO"; // Flash режим
+    doc["chip_id"] = ESP.getEfuseMac();                                 // Уникальный ID чипа
+    doc["millis"] = formatHeatingTime(serverWorkTime);
+    doc["board_temperature"] = board_temperature;
+    doc["ble_frames_accepted"] = bleFramesAccepted.load(); // Пакеты BLE, прошедшие фильтр
+    doc["ble_frames_dropped"] = bleFramesDropped.load();   // Пакеты BLE, отброшенные фильтром
+    doc["ble_frames_no_data"] = bleFramesNoData.load();    // Пакеты BLE без показаний
+    DeviceTableLockStats lockStats = devicesLock.getStats();
+    doc["devices_lock_count"] = lockStats.lockCount;     // Захваты таблицы устройств
+    doc["devices_lock_wait_us"] = lockStats.waitUs;      // Суммарное ожидание блокировки (мкс)
+    doc["devices_lock_max_wait_us"] = lockStats.maxWaitUs;
+    PersistenceStats persistStats = getPersistenceStats();
+    doc["nvs_writes_total"] = persistStats.writesTotal; // Записи в NVS с момента загрузки
+    doc["nvs_bytes_total"] = persistStats.bytesTotal;
+    doc["nvs_writes_hour"] = persistStats.writesThisHour; // Записи за текущий час
+    doc["nvs_bytes_hour"] = persistStats.bytesThisHour;
+    doc["nvs_writes_last_hour"] = persistStats.writesLastHour; // Записи за предыдущий полный час
+    doc["nvs_bytes_last_hour"] = persistStats.bytesLastHour;
+    SensorHistoryStats historyStats = getSensorHistoryStats();
+    doc["history_devices"] = historyStats.devices; // Устройства с историей показаний
+    doc["history_bytes_per_device"] = historyStats.bytesPerDevice;
+    doc["history_bytes_total"] = historyStats.bytesTotal;
+    doc["history_allocation_failed"] = historyStats.allocationFailed;
+}
+
+// POST /client/{address} (update info about a client)
+static void handleUpdateClient(AsyncWebServerRequest *request)
+{
+    // Имя длиннее DEVICE_NAME_MAX не поместилось бы в NVS целиком - отказываем, а не обрезаем
+    if (request->hasParam("name", true) && request->getParam("name", true)->value().length() > DEVICE_NAME_MAX)
+    {
+        request->send(400, "text/plain", "Name too long");
+        return;
+    }
+
+    uint64_t mac = 0;
+    if (!request->hasParam("address", true) ||
+        !parseMacAddress(request->getParam("address", true)->value().c_str(), mac) ||
+        !devicesLock.lock())
+    {
+        request->send(404, "text/plain", "Client not found");
+        return;
+    }
+
+    bool isSaving = false;
+    // Находим устройство по адресу
+    DeviceData *deviceIt = devices.find(mac);
+    if (deviceIt != nullptr)
+    {
+        // Обновляем имя устройства
+        if (request->hasParam("name", true))
+        {
+            String newName = request->getParam("name", true)->value();
+            deviceIt->name = newName.c_str();
+            isSaving = true;
+        }
+
+        // Обновляем целевую температуру
+        if (request->hasParam("targetTemperature", true))
+        {
+            String tempStr = request->getParam("targetTemperature", true)->value();
+            deviceIt->targetTemperature = tempStr.toFloat();
+            isSaving = true;
+        }
+
+        // Обновляем статус включения
+        if (request->hasParam("enabled", true))
+        {
+            String tempStr = request->getParam("enabled", true)->value();
+            deviceIt->enabled = tempStr == "true";
+            isSaving = true;
+        }
+
+        // Обновляем алгоритм управления (неизвестное имя не меняет текущий)
+        uint8_t controllerType;
+        if (request->hasParam("controller", true) &&
+            parseHeatingController(request->getParam("controller", true)->value().c_str(), controllerType))
+        {
+            deviceIt->controllerType = controllerType;
+            isSaving = true;
+        }
+
+        // Обновляем GPIO пины
+        if (request->hasParam("gpioPins", true))
+        {
+            String gpioStr = request->getParam("gpioPins", true)->value();
+
+            // Парсим JSON с использованием ArduinoJson 7.x
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, gpioStr);
+            if (!error)
+            {
+                // Очищаем текущий вектор GPIO пинов
+                deviceIt->gpioPins.clear();
+                // Если входные данные - массив
+                if (doc.is<JsonArray>())
+                {
+                    for (uint8_t pin : doc.as<JsonArray>())
+                    {
+                        deviceIt->gpioPins.push_back(pin);
+                    }
+                }
+                isSaving = true;
+            }
+        }
+
+        if (isSaving)
+        {
+            devices.touch(*deviceIt);
+            markDeviceConfigDirty(*deviceIt);
+            requestDeviceControl(*deviceIt);
+        }
+    }
+
+    deviceSnapshots.publish(devices);
+    devicesLock.unlock();
+
+    if (isSaving)
+    {
+        logAndSend("Получены изменения по HTTP, сохраняем результаты");
+        request->send(200, "text/plain", "Client updated");
+        return;
+    }
+    request->send(404, "text/plain", "Client not found");
+}
+
+// Проверка частичного обновления устройства из /clients/batch: macAddress и поля нужных типов
+static bool parseDeviceUpdate(JsonObjectConst update, uint64_t &mac)
+{
+    if (!update["macAddress"].is<const char *>() || !parseMacAddress(update["macAddress"].as<const char *>(), mac))
+    {
+        return false;
+    }
+    if (!update["name"].isNull() && !(update["name"].is<const char *>() && strlen(update["name"].as<const char *>()) <= DEVICE_NAME_MAX))
+    {
+        return false;
+    }
+    if (!update["targetTemperature"].isNull() && !update["targetTemperature"].is<float>())
+    {
+        return false;
+    }
+    if (!update["enabled"].isNull() && !update["enabled"].is<bool>())
+    {
+        return false;
+    }
+    uint8_t controllerType;
+    if (!update["controller"].isNull() &&
+        !(update["controller"].is<const char *>() && parseHeatingController(update["controller"].as<const char *>(), controllerType)))
+    {
+        return false;
+    }
+    if (!update["gpioPins"].isNull())
+    {
+        if (!update["gpioPins"].is<JsonArrayConst>())
+        {
+            return false;
+        }
+        for (JsonVariantConst pin : update["gpioPins"].as<JsonArrayConst>())
+        {
+            if (!pin.is<uint8_t>())
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Применение проверенного обновления, true - устройство изменено
+static bool applyDeviceUpdate(DeviceData &device, JsonObjectConst update)
+{
+    bool changed = false;
+    if (update["name"].is<const char *>())
+    {
+        device.name = update["name"].as<const char *>();
+        changed = true;
+    }
+    if (update["targetTemperature"].is<float>())
+    {
+        device.targetTemperature = update["targetTemperature"].as<float>();
+        changed = true;
+    }
+    if (update["enabled"].is<bool>())
+    {
+        device.enabled = update["enabled"].as<bool>();
+        changed = true;
+    }
+    if (update["controller"].is<const char *>())
+    {
+        parseHeatingController(update["controller"].as<const char *>(), device.controllerType);
+        changed = true;
+    }
+    if (update["gpioPins"].is<JsonArrayConst>())
+    {
+        device.gpioPins.clear();
+        for (uint8_t pin : update["gpioPins"].as<JsonArrayConst>())
+        {
+            device.gpioPins.push_back(pin);
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+// POST /clients/batch: updates=[{"macAddress":..., "name", "targetTemperature", "enabled", "controller", "gpioPins"}, ...]
+// Все обновления проверяются до применения и применяются под одной блокировкой;
+// изменения попадают в NVS одним проходом планировщика записи
+static void handleBatchUpdateClients(AsyncWebServerRequest *request)
+{
+    if (!request->hasParam("updates", true))
+    {
+        request->send(400, "text/plain", "updates parameter not found");
+        return;
+    }
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, request->getParam("updates", true)->value());
+    if (error || !doc.is<JsonArray>())
+    {
+        request->send(400, "text/plain", "Invalid JSON format");
+        return;
+    }
+    JsonArrayConst updates = doc.as<JsonArrayConst>();
+    size_t count = updates.size();
+    std::vector<uint64_t> macs(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!parseDeviceUpdate(updates[i], macs[i]))
+        {
+            request->send(400, "text/plain", "Invalid update #" + String(i));
+            return;
+        }
+    }
+
+    if (!devicesLock.lock())
+    {
+        request->send(503, "text/plain", "Devices busy");
+        return;
+    }
+    // Сначала убеждаемся, что все устройства существуют: пакет применяется целиком или никак
+    std::vector<DeviceData *> targets(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        targets[i] = devices.find(macs[i]);
+        if (targets[i] == nullptr)
+        {
+            devicesLock.unlock();
+            request->send(404, "text/plain", "Client not found: " + String(updates[i]["macAddress"].as<const char *>()));
+            return;
+        }
+    }
+    size_t updated = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (applyDeviceUpdate(*targets[i], updates[i]))
+        {
+            devices.touch(*targets[i]);
+            markDeviceConfigDirty(*targets[i]);
+            requestDeviceControl(*targets[i]);
+            updated++;
+        }
+    }
+    deviceSnapshots.publish(devices);
+    devicesLock.unlock();
+
+    logAndSend("Пакетное обновление устройств по HTTP: " + String(updated));
+    JsonDocument result;
+    result["updated"] = updated;
+    sendJsonDocument(request, result);
+}
+
+static void handleDeleteClient(AsyncWebServerRequest *request)
+{
+    if (!request->hasParam("address", true))
+    {
+        request->send(404, "text/plain", "Client not found");
+        return;
+    }
+    String address = request->getParam("address", true)->value();
+    uint64_t mac = 0;
+    if (!parseMacAddress(address.c_str(), mac) || !devicesLock.lock())
+    {
+        request->send(404, "text/plain", "Client not found");
+        return;
+    }
+    // Удаляем устройство по адресу
+    DeviceData *device = devices.find(mac);
+    if (device != nullptr)
+    {
+        // Выходы, которые держало устройство, освобождаются до удаления
+        releaseDeviceControl(*device);
+        devices.remove(mac);
+        markDeviceRemoved(mac);
+        sensorHistoryRemove(mac);
+        requestControlSweep();
+    }
+    updateBleMacAllowlist();
+    deviceSnapshots.publish(devices);
+    devicesLock.unlock();
+
+    logAndSend("Удаляем устройство " + address);
+    request->send(200, "text/plain", "Client remove");
+}
+
+// GET /scan (start BLE scan)
+static void handleScan(AsyncWebServerRequest *request)
+{
+    logAndSend("Получен запрос на запуск сканирования устройств");
+    openBleDiscoveryWindow(BLE_DISCOVERY_WINDOW);
+    startXiaomiScan(); // Сканирование непрерывное, запускаем только если оно остановлено
+    request->send(200, "text/plain", "BLE Scan started");
+}
+
+// Статистика обогрева
+static void handleHeatingStats(AsyncWebServerRequest *request)
+{
+    sendDeviceJson(request, formatHeatingStatsJson);
+}
+
+// История температуры и влажности устройства
+static void handleHistory(AsyncWebServerRequest *request)
+{
+    sendHistoryJson(request);
+}
+
+// Двоичная выгрузка истории (формат описан в history_format.h)
+static void handleHistoryBinary(AsyncWebServerRequest *request)
+{
+    sendHistoryBinary(request);
+}
+
+// Сброс статистики обогрева
+static void handleResetStats(AsyncWebServerRequest *request)
+{
+    bool resetAll = true;
+    uint64_t deviceMac = 0;
+
+    // Проверяем, нужно ли сбросить статистику для конкретного устройства
+    if (request->hasParam("device", true))
+    {
+        if (!parseMacAddress(request->getParam("device", true)->value().c_str(), deviceMac))
+        {
+            request->send(400, "text/plain", "Invalid device address");
+            return;
+        }
+        resetAll = false;
+    }
+    if (devicesLock.lock())
+    {
+        for (auto &device : devices)
+        {
+            if (resetAll || device.mac == deviceMac)
+            {
+                device.totalHeatingTime = 0;
+                if (device.heatingActive)
+                {
+                    // Если обогрев активен, сбрасываем время начала
+                    device.heatingStartTime = millis();
+                }
+                devices.touch(device);
+                markDeviceConfigDirty(device);
+                heatingJournalCheckpoint(device);
+            }
+        }
+        deviceSnapshots.publish(devices);
+        devicesLock.unlock();
+    }
+    logAndSend("Сброшена статистика, сохраняем результаты");
+    request->send(200, "text/plain", "Статистика сброшена");
+}
+
+static void handleHeatingGpioStats(JsonDocument &doc)
+{
+    addGpioJson(doc.to<JsonArray>(), true);
+}
+
+static void handleResetGpioStats(AsyncWebServerRequest *request)
+{
+    if (!devicesLock.lock())
+    {
+        request->send(503, "text/plain", "Devices busy");
+        return;
+    }
+    for (auto &gpio : availableGpio)
+    {
+        gpio.totalHeatingTime = 0;
+    }
+    devicesLock.unlock();
+    logAndSend("Сброшена статистика, сохраняем результаты");
+    markGpioConfigDirty();
+    request->send(200, "text/plain", "Статистика сброшена");
+}
+
+static void handleResetWorkTime(AsyncWebServerRequest *request)
+{
+    logAndSend("Сброшено время работы, сохраняем результаты");
+    serverWorkTime = 0;
+    markServerSettingDirty();
+    request->send(200, "text/plain", "Статистика сброшена");
+}
+
+static void handleSaveHysteresisTemp(AsyncWebServerRequest *request)
+{
+    if (!request->hasParam("hysteresis_temp", true))
+    {
+        request->send(404, "text/plain", "Param not found");
+        return;
+    }
+    hysteresisTemp = request->getParam("hysteresis_temp", true)->value().toFloat();
+    logAndSend("Cохраняем настройки для гистерезиса");
+    markServerSettingDirty();
+    requestControlSweep();
+    request->send(200, "text/plain", "Настройки для гистерезиса сохранены");
+}
+
+static void handleGetHysteresisTemp(AsyncWebServerRequest *request)
+{
+    request->send(200, "application/json", String(hysteresisTemp, 1));
+}
+
+// Таблица маршрутов: ROUTE(обработчик, метод, путь, тип ответа)
+#define WEB_ROUTES(ROUTE)                                                             \
+    ROUTE(handleClients, HTTP_GET, "/clients", ROUTE_STREAM)                          \
+    ROUTE(handleAvailableGpio, HTTP_GET, "/availablegpio", ROUTE_JSON)                \
+    ROUTE(handleSaveAvailableGpio, HTTP_POST, "/availablegpio", ROUTE_TEXT)           \
+    ROUTE(handleServerInfo, HTTP_GET, "/serverinfo", ROUTE_JSON)                      \
+    ROUTE(handleUpdateClient, HTTP_POST, "/client", ROUTE_TEXT)                       \
+    ROUTE(handleDeleteClient, HTTP_DELETE, "/client", ROUTE_TEXT)                     \
+    ROUTE(handleBatchUpdateClients, HTTP_POST, "/clients/batch", ROUTE_TEXT)          \
+    ROUTE(handleScan, HTTP_GET, "/scan", ROUTE_TEXT)                                  \
+    ROUTE(handleHeatingStats, HTTP_GET, "/heating_stats", ROUTE_STREAM)               \
+    ROUTE(handleHistory, HTTP_GET, "/history", ROUTE_STREAM)                          \
+    ROUTE(handleHistoryBinary, HTTP_GET, "/history.bin", ROUTE_STREAM)                \
+    ROUTE(handleResetStats, HTTP_POST, "/reset_stats", ROUTE_TEXT)                    \
+    ROUTE(handleHeatingGpioStats, HTTP_GET, "/heating_gpio_stats", ROUTE_JSON)        \
+    ROUTE(handleResetGpioStats, HTTP_POST, "/reset_gpio_stats", ROUTE_TEXT)           \
+    ROUTE(handleResetWorkTime, HTTP_DELETE, "/reset_work_time", ROUTE_TEXT)           \
+    ROUTE(handleSaveHysteresisTemp, HTTP_POST, "/save_hysteresis_temp", ROUTE_TEXT)   \
+    ROUTE(handleGetHysteresisTemp, HTTP_GET, "/get_hysteresis_temp", ROUTE_TEXT)
+
+enum
+{
+    WEB_ROUTES(ROUTE_INDEX) WEB_ROUTE_COUNT
+};
+
+static const Route webRoutes[WEB_ROUTE_COUNT] = {WEB_ROUTES(ROUTE_ENTRY)};
+
+static int findWebRoute(uint32_t key)
+{
+    switch (key)
+    {
+        WEB_ROUTES(ROUTE_CASE)
+    default:
+        return -1;
+    }
+}
+
+static RouteTableHandler webRouteHandler(webRoutes, findWebRoute);
+
 // web server +++++++++++++++++++++++++++++++++
 void initWebServer()
 {
@@ -49,337 +619,14 @@ void initWebServer()
          logAndSend("Client connected to SSE"); 
          client->send("Connected to ESP32 log stream"); });
 
-    // GET /clients (get list of all clients)
-    server.on("/clients", HTTP_GET, [](AsyncWebServerRequest *request)
-              {
-                JsonDocument doc;
-                JsonArray devicesArray = doc.to<JsonArray>();
-
-                if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE) {
-                    for (const auto& device : devices) {
-                        JsonObject deviceObj = devicesArray.add<JsonObject>();
-                        
-                        // Заполняем основные поля устройства
-                        deviceObj["name"] = device.name;
-                        deviceObj["macAddress"] = device.macAddress;
-                        deviceObj["currentTemperature"] = device.currentTemperature;
-                        deviceObj["targetTemperature"] = device.targetTemperature;
-                        deviceObj["enabled"] = device.enabled;
-                        deviceObj["isOnline"] = device.isOnline;
-                        deviceObj["heatingActive"] = device.heatingActive;
-                        deviceObj["humidity"] = device.humidity;
-                        deviceObj["battery"] = device.battery;
-                        deviceObj["batteryV"] = device.batteryV;
-                        deviceObj["lastUpdate"] = device.lastUpdate;
-                        deviceObj["totalHeatingTime"] = device.totalHeatingTime;
-                        
-                        // Добавляем массив GPIO пинов
-                        JsonArray pinsArray = deviceObj["gpioPins"].to<JsonArray>();
-                        for (uint8_t pin : device.gpioPins) {
-                            pinsArray.add(pin);
-                        }
-                    }
-                    xSemaphoreGive(devicesMutex);
-                }
-                
-                String response;
-                serializeJson(doc, response);
-                request->send(200, "application/json", response.c_str()); });
-
-    server.on("/availablegpio", HTTP_GET, [](AsyncWebServerRequest *request)
-              {
-                  JsonDocument doc;
-                  JsonArray gpioArray = doc.to<JsonArray>();
-                  
-                  for (const auto& gpio : availableGpio) {
-                      JsonObject gpioObj = gpioArray.add<JsonObject>();
-                      gpioObj["pin"] = gpio.pin;
-                      gpioObj["state"] = gpio.state;
-                      gpioObj["name"] = gpio.name;
-                  }
-                  
-                  String response;
-                  serializeJson(doc, response);
-                  request->send(200, "application/json", response.c_str()); });
-    server.on("/availablegpio", HTTP_POST, [](AsyncWebServerRequest *request)
-              {
-                    if (request->hasParam("availablegpio", true))
-                    {
-                        String jsonStr = request->getParam("availablegpio", true)->value();
-                        
-                        // Используем ArduinoJson 7.x для парсинга
-                        JsonDocument doc;
-                        DeserializationError error = deserializeJson(doc, jsonStr);
-                        
-                        if (!error) {
-                            // Очищаем текущий вектор GPIO
-                            availableGpio.clear();                            
-                            // Парсим массив GPIO пинов
-                            JsonArray gpioArray = doc.as<JsonArray>();
-                            for (JsonObject gpioObj : gpioArray) {
-                                GpioPin gpio;
-                                gpio.pin = gpioObj["pin"].as<uint8_t>();
-                                gpio.state = gpioObj["state"].as<uint8_t>();
-                                gpio.name = gpioObj["name"].as<const char*>();
-                                availableGpio.push_back(gpio);
-                            }
-                            
-                            saveGpioToFile();
-                            request->send(200, "text/plain", "availablegpio updated");
-                        } else {
-                            request->send(400, "text/plain", "Invalid JSON format");
-                        }
-                    } else {
-                        request->send(400, "text/plain", "availablegpio parameter not found");
-                    } });
-    server.on("/serverinfo", HTTP_GET, [](AsyncWebServerRequest *request)
-              {
-                JsonDocument doc;
-                doc["cpu_frequency_mhz"] = ESP.getCpuFreqMHz();//Частота CPU
-                doc["chip_revision"] = ESP.getChipRevision();//Ревизия чипа
-                doc["processor_cores"] = ESP.getChipCores();//Ядер процессора
-                doc["sdk_version"] = ESP.getSdkVersion();//Версия SDK
-                doc["sram_size_bytes"] = ESP.getHeapSize();//Размер SRAM
-                doc["free_sram_bytes"] = ESP.getFreeHeap();//Свободная SRAM
-                doc["flash_size_bytes"] = ESP.getFlashChipSize();//Размер Flash
-                doc["flash_frequency_mhz"] = ESP.getFlashChipSpeed() / 1000000;//Частота Flash
-                doc["psram_size_bytes"] = ESP.getPsramSize();//Размер PSRAM
-                doc["free_psram_bytes"] = ESP.getFreePsram();//Свободная PSRAM
-                doc["flash_mode"] = ESP.getFlashChipMode() == FM_QIO ? "QIO" : "DIO";//Flash режим
-                doc["chip_id"] = ESP.getEfuseMac();//Уникальный ID чипа
-                doc["millis"] = formatHeatingTime(serverWorkTime);
-                doc["board_temperature"] = board_temperature;
-                // Сериализуем JSON
-                String payload;
-                serializeJson(doc, payload);
-                request->send(200, "application/json", payload.c_str()); });
-    // POST /client/{address} (update info about a client)
-    server.on("/client", HTTP_POST, [](AsyncWebServerRequest *request)
-              {
-                if (request->hasParam("address", true))
-                {
-                    String address = request->getParam("address", true)->value();
-                    bool isSaving = false;
-                    
-                    if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE) {
-                        // Находим устройство по адресу
-                        auto deviceIt = std::find_if(devices.begin(), devices.end(),
-                                                [&address](const DeviceData &device) {
-                                                    return device.macAddress == address.c_str();
-                                                });
-                        
-                        if (deviceIt != devices.end()) {
-                            // Обновляем имя устройства
-                            if (request->hasParam("name", true)) {
-                                String newName = request->getParam("name", true)->value();
-                                deviceIt->name = newName.c_str();
-                                isSaving = true;
-                            }
-                            
-                            // Обновляем целевую температуру
-                            if (request->hasParam("targetTemperature", true)) {
-                                String tempStr = request->getParam("targetTemperature", true)->value();
-                                float newTargetTemperature = tempStr.toFloat();
-                                deviceIt->targetTemperature = newTargetTemperature;
-                                isSaving = true;
-                            }
-                            
-                            // Обновляем статус включения
-                            if (request->hasParam("enabled", true)) {
-                                String tempStr = request->getParam("enabled", true)->value();
-                                bool enabled = tempStr == "true";
-                                deviceIt->enabled = enabled;
-                                isSaving = true;
-                            }
-                            
-                            // Обновляем GPIO пины
-                            if (request->hasParam("gpioPins", true)) {
-                                String gpioStr = request->getParam("gpioPins", true)->value();
-                                
-                                // Парсим JSON с использованием ArduinoJson 7.x
-                                JsonDocument doc;
-                                DeserializationError error = deserializeJson(doc, gpioStr);
-                                
-                                if (!error) {
-                                    // Очищаем текущий вектор GPIO пинов
-                                    deviceIt->gpioPins.clear();
-                                    
-                                    // Если входные данные - массив
-                                    if (doc.is<JsonArray>()) {
-                                        JsonArray pinsArray = doc.as<JsonArray>();
-                                        for (uint8_t pin : pinsArray) {
-                                            deviceIt->gpioPins.push_back(pin);
-                                        }
-                                    }                                     
-                                    
-                                    isSaving = true;
-                                }
-                            }
-                            
-                        }
-                        
-                        xSemaphoreGive(devicesMutex);
-                        
-                        if (isSaving) {
-                            logAndSend("Получены изменения по HTTP, сохраняем результаты");
-                            saveClientsToFile(); // Save changes to file
-                            request->send(200, "text/plain", "Client updated");
-                            return;
-                        }
-                    }
-                }                
-                request->send(404, "text/plain", "Client not found"); });
-    server.on("/client", HTTP_DELETE, [](AsyncWebServerRequest *request)
-              {
-                if (request->hasParam("address", true))
-                {
-                    String address = request->getParam("address", true)->value();
-                   
-                    if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE) {
-                        // Находим устройство по адресу
-                        devices.erase(
-                                std::remove_if(devices.begin(), devices.end(),
-                                [&](const DeviceData& d) {
-                                    return d.macAddress == address.c_str();
-                                }),
-                                devices.end()
-                            );                                                                      
-                        xSemaphoreGive(devicesMutex);
-                        
-                        logAndSend("Удаляем устройство "+ address);
-                            saveClientsToFile(); // Save changes to file
-                            request->send(200, "text/plain", "Client remove");
-                            return;
-                    }
-                }                
-                request->send(404, "text/plain", "Client not found"); });
-    // GET /scan (start BLE scan)
-    server.on("/scan", HTTP_GET, [](AsyncWebServerRequest *request)
-              {
-                logAndSend("Получен запрос на запуск сканирования устройств");
-                startXiaomiScan();
-            request->send(200, "text/plain", "BLE Scan started"); });
-    // Добавляем обработчик для получения статистики обогрева
-    server.on("/heating_stats", HTTP_GET, [](AsyncWebServerRequest *request)
-              {
-    JsonDocument doc;
-    JsonArray statsArray = doc.to<JsonArray>();
-    if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE) {
-        for (const auto& device : devices) {
-            JsonObject deviceObj = statsArray.add<JsonObject>();
-            deviceObj["name"] = device.name;
-            deviceObj["macAddress"] = device.macAddress;
-            deviceObj["currentTemperature"] = device.currentTemperature;
-            deviceObj["targetTemperature"] = device.targetTemperature;
-            deviceObj["heatingActive"] = device.heatingActive;            
-            deviceObj["totalHeatingTimeMs"] =  device.totalHeatingTime;
-            deviceObj["totalHeatingTimeFormatted"] = formatHeatingTime(device.totalHeatingTime);
-        }
-        xSemaphoreGive(devicesMutex);
-    }
-    
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response); });
-
-    // Добавляем обработчик для сброса статистики обогрева
-    server.on("/reset_stats", HTTP_POST, [](AsyncWebServerRequest *request)
-              {
-        bool resetAll = true;
-        String deviceMac = "";
-        
-        // Проверяем, нужно ли сбросить статистику для конкретного устройства
-        if (request->hasParam("device", true)) {
-            deviceMac = request->getParam("device", true)->value();
-            resetAll = false;
-        }        
-        if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE) {
-            for (auto& device : devices) {
-                if (resetAll || device.macAddress == deviceMac.c_str()) {
-                    device.totalHeatingTime = 0;
-                    if (device.heatingActive) {
-                        // Если обогрев активен, сбрасываем время начала
-                        device.heatingStartTime = millis();
-                    }
-                }
-            }
-            xSemaphoreGive(devicesMutex);
-        }        
-        logAndSend("Сброшена статистика, сохраняем результаты");
-        // Сохраняем изменения
-        saveClientsToFile();
-        request->send(200, "text/plain", "Статистика сброшена"); });
-
-    server.on("/heating_gpio_stats", HTTP_GET, [](AsyncWebServerRequest *request)
-              {
-    JsonDocument doc;
-    JsonArray statsArray = doc.to<JsonArray>();
-    for (const auto& gpio : availableGpio) {
-            JsonObject gpioObj = statsArray.add<JsonObject>();
-            gpioObj["pin"] = gpio.pin;  
-            gpioObj["state"] = gpio.state;  
-            gpioObj["name"] = gpio.name;            
-            gpioObj["totalHeatingTimeFormatted"] = formatHeatingTime(gpio.totalHeatingTime);
-        }
-    
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response); });
-
-    server.on("/reset_gpio_stats", HTTP_POST, [](AsyncWebServerRequest *request)
-              {                
-                for (auto &gpio : availableGpio)
-                    {
-                    gpio.totalHeatingTime = 0;
-                    }
-        logAndSend("Сброшена статистика, сохраняем результаты");
-        // Сохраняем изменения
-        saveGpioToFile();
-        request->send(200, "text/plain", "Статистика сброшена"); });
-
-    server.on("/reset_work_time", HTTP_DELETE, [](AsyncWebServerRequest *request)
-              {       
-        logAndSend("Сброшено время работы, сохраняем результаты");        
-        serverWorkTime = 0;
-        saveServerSetting();
-        request->send(200, "text/plain", "Статистика сброшена"); });
-
-    server.on("/save_hysteresis_temp", HTTP_POST, [](AsyncWebServerRequest *request)
-              {       
-                if (request->hasParam("hysteresis_temp", true)) {
-                    hysteresisTemp = request->getParam("hysteresis_temp", true)->value().toFloat();
-                    logAndSend("Cохраняем настройки для гистерезиса");  
-                    saveServerSetting();
-                    request->send(200, "text/plain", "Настройки для гистерезиса сохранены"); 
-                }
-     request->send(404, "text/plain", "Param not found"); });
-
-    server.on("/get_hysteresis_temp", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(200, "application/json", String(hysteresisTemp, 1)); });
-    
-    // Обработчик для корневого пути и /index
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/index.html", "text/html"); });
-
-    server.on("/index.html", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/index.html", "text/html"); });
-    server.on("/managment_device.html", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/managment_device.html", "text/html"); });
-    server.on("/app.css", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/app.css", "text/css"); });
-    server.on("/gpio_settings.html", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/gpio_settings.html", "text/html"); });
-    // Добавляем обработчик для страницы статистики обогрева
-    server.on("/heating_stats.html", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/heating_stats.html", "text/html"); });
-
-    // Добавляем обработчик для получения логов в реальном времени через SSE
-    server.on("/logs.html", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/logs.html", "text/html"); });
-              
-    // Добавляем обработчик для страницы настройки устройств
-    server.on("/setup_device.html", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/setup_device.html", "text/html"); });
+    // Поток изменений состояния устройств
+    initStateEvents(server);
+
+    // API: все маршруты WEB_ROUTES одним обработчиком
+    server.addHandler(&webRouteHandler);
+
+    // Страницы и стили из SPIFFS (сжатые, с ETag и Cache-Control)
+    registerStaticAssets(server);
 
     server.begin();
     logAndSend("Web server started");
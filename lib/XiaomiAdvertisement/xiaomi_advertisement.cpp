@@ -0,0 +1,67 @@
+#include "xiaomi_advertisement.h"
+#include <string.h>
+
+bool extractServiceData16(const uint8_t *payload, size_t length, BLEAdvRecord &record)
+{
+    size_t pos = 0;
+    while (pos + 1 < length)
+    {
+        uint8_t fieldLength = payload[pos];
+        if (fieldLength == 0 || pos + 1 + fieldLength > length)
+        {
+            break;
+        }
+        uint8_t fieldType = payload[pos + 1];
+        // Поле: тип (1 байт) + UUID16 (2 байта) + данные
+        if (fieldType == 0x16 && fieldLength >= 3)
+        {
+            size_t dataLength = fieldLength - 3;
+            uint16_t uuid16 = (uint16_t)(payload[pos + 2] | (payload[pos + 3] << 8));
+            if (isXiaomiServiceUuid(uuid16) && dataLength <= BLE_ADV_PAYLOAD_MAX)
+            {
+                record.uuid16 = uuid16;
+                record.payloadLength = (uint8_t)dataLength;
+                memcpy(record.payload, &payload[pos + 4], dataLength);
+                return true;
+            }
+        }
+        pos += fieldLength + 1;
+    }
+    return false;
+}
+
+XiaomiParseResult parseXiaomiAdvertisement(const BLEAdvRecord &record, XiaomiReading &reading)
+{
+    if (record.payloadLength < XIAOMI_ATC_PAYLOAD_LENGTH)
+    {
+        return XIAOMI_PARSE_NO_DATA;
+    }
+
+    // Проверка MAC-адреса в данных (для ATC MAC передается в обратном порядке)
+    for (int j = 0; j < 6; j++)
+    {
+        if (record.payload[5 - j] != record.mac[j])
+        {
+            return XIAOMI_PARSE_MAC_MISMATCH;
+        }
+    }
+
+    reading.temperature = 0;
+    reading.humidity = 0;
+    reading.battery = 0;
+    reading.batteryV = 0;
+
+    // Формат ATC: байты 6-7 - температура, 8-9 - влажность, 10-11 - напряжение, байт 12 - батарея
+    if (record.payloadLength == XIAOMI_ATC_PAYLOAD_LENGTH)
+    {
+        int16_t temperatureRaw = (int16_t)(record.payload[7] << 8 | record.payload[6]);
+        reading.temperature = temperatureRaw / 100.0f;
+
+        int16_t humidityRaw = (int16_t)(record.payload[9] << 8 | record.payload[8]);
+        reading.humidity = humidityRaw / 100.0f;
+
+        reading.batteryV = (uint16_t)(record.payload[11] << 8 | record.payload[10]);
+        reading.battery = record.payload[12];
+    }
+    return XIAOMI_PARSE_OK;
+}
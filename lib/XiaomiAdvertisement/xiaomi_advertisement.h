@@ -0,0 +1,51 @@
+#ifndef XIAOMI_ADVERTISEMENT_H
+#define XIAOMI_ADVERTISEMENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+#define XIAOMI_UUID_ATC 0x181A          // UUID сервисных данных кастомной прошивки ATC/pvvx
+#define XIAOMI_UUID_MIBEACON 0xFE95     // UUID сервисных данных Xiaomi MiBeacon
+#define BLE_ADV_PAYLOAD_MAX 24          // Максимальный размер сервисных данных в записи (байт)
+#define XIAOMI_ATC_PAYLOAD_LENGTH 15    // Длина сервисных данных в формате ATC
+
+// Запись рекламного пакета фиксированного размера.
+// Передается через статическую очередь по значению, поэтому колбэк сканера не обращается к куче
+struct BLEAdvRecord
+{
+    uint8_t mac[6];                       // MAC-адрес отправителя (в порядке отображения)
+    uint16_t uuid16;                      // 16-битный UUID сервисных данных
+    uint8_t payloadLength;                // Длина сервисных данных
+    uint8_t payload[BLE_ADV_PAYLOAD_MAX]; // Сервисные данные без UUID
+};
+static_assert(std::is_trivially_copyable<BLEAdvRecord>::value, "BLEAdvRecord копируется в очередь по значению");
+
+// Показания датчика из рекламного пакета
+struct XiaomiReading
+{
+    float temperature;
+    float humidity;
+    uint8_t battery;
+    uint16_t batteryV;
+};
+
+enum XiaomiParseResult : uint8_t
+{
+    XIAOMI_PARSE_OK = 0,
+    XIAOMI_PARSE_NO_DATA,      // Сервисные данные слишком короткие
+    XIAOMI_PARSE_MAC_MISMATCH  // MAC в данных не совпадает с адресом отправителя
+};
+
+static inline bool isXiaomiServiceUuid(uint16_t uuid16)
+{
+    return uuid16 == XIAOMI_UUID_ATC || uuid16 == XIAOMI_UUID_MIBEACON;
+}
+
+// Поиск сервисных данных Xiaomi/ATC (AD type 0x16, UUID 0x181A/0xFE95) в сыром рекламном пакете.
+// Заполняет uuid16 и payload записи, MAC заполняет вызывающий
+bool extractServiceData16(const uint8_t *payload, size_t length, BLEAdvRecord &record);
+// Разбор сервисных данных записи. Показания заполняются только для формата ATC, иначе нули
+XiaomiParseResult parseXiaomiAdvertisement(const BLEAdvRecord &record, XiaomiReading &reading);
+
+#endif
@@ -2,49 +2,101 @@
 #include "variables_info.h"
 #include <algorithm>
 #include <spiffs_setting.h>
+#include <persist_scheduler.h>
+#include <heating_control.h>
 
 // Глобальные переменные
 BLEScan *pBLEScan = nullptr;
-bool scanningActive = false;
+volatile bool scanningActive = false;
+static volatile unsigned long scanStoppedTime = 0; // Время последней остановки сканирования
 BLEServer *pServer = nullptr;
 QueueHandle_t bleDataQueue = nullptr; // Очередь для передачи данных BLE
+
+// Статическое хранилище очереди рекламных пакетов
+static uint8_t bleDataQueueStorage[BLE_ADV_QUEUE_LENGTH * sizeof(BLEAdvRecord)];
+static StaticQueue_t bleDataQueueBuffer;
+
+// Счетчики предварительного фильтра рекламных пакетов
+std::atomic<uint32_t> bleFramesAccepted(0);
+std::atomic<uint32_t> bleFramesDropped(0);
+std::atomic<uint32_t> bleFramesNoData(0);
+
+// Список разрешенных MAC-адресов, собирается из devices
+static uint64_t bleMacAllowlist[BLE_MAC_ALLOWLIST_MAX];
+static size_t bleMacAllowlistCount = 0;
+static portMUX_TYPE bleMacAllowlistMux = portMUX_INITIALIZER_UNLOCKED;
+// До этого момента (millis) фильтр по MAC отключен, чтобы можно было найти новые датчики
+static volatile unsigned long bleDiscoveryUntil = 0;
+
+// Проверка MAC-адреса по списку известных устройств
+static bool isMacAllowed(const uint8_t *mac)
+{
+    if (!XIAOMI_MAC_ALLOWLIST || (long)(millis() - bleDiscoveryUntil) < 0)
+    {
+        return true;
+    }
+    uint64_t key = macFromBytes(mac);
+    bool allowed = false;
+    portENTER_CRITICAL(&bleMacAllowlistMux);
+    // Пустой список означает, что известных устройств еще нет - пропускаем все
+    allowed = bleMacAllowlistCount == 0;
+    for (size_t i = 0; i < bleMacAllowlistCount && !allowed; i++)
+    {
+        allowed = bleMacAllowlist[i] == key;
+    }
+    portEXIT_CRITICAL(&bleMacAllowlistMux);
+    return allowed;
+}
+
+// Временное отключение фильтра по MAC для поиска новых датчиков
+void openBleDiscoveryWindow(unsigned long durationMs)
+{
+    bleDiscoveryUntil = millis() + durationMs;
+}
+
+// Пересборка списка разрешенных MAC-адресов (вызывать при захваченном devicesLock)
+void updateBleMacAllowlist()
+{
+    uint64_t keys[BLE_MAC_ALLOWLIST_MAX];
+    size_t count = 0;
+    for (const auto &device : devices)
+    {
+        if (count < BLE_MAC_ALLOWLIST_MAX)
+        {
+            keys[count++] = device.mac;
+        }
+    }
+    portENTER_CRITICAL(&bleMacAllowlistMux);
+    memcpy(bleMacAllowlist, keys, count * sizeof(uint64_t));
+    bleMacAllowlistCount = count;
+    portEXIT_CRITICAL(&bleMacAllowlistMux);
+}
+
 //  Класс для обработки результатов сканирования
 class XiaomiAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks
 {
     void onResult(BLEAdvertisedDevice advertisedDevice)
     {
-        // Создаем структуру данных для передачи в очередь
-        BLEDeviceData *deviceData = new BLEDeviceData();
-        deviceData->address = advertisedDevice.getAddress().toString().c_str();
-        logAndSend("Обнаружено устройство: " + String(deviceData->address.c_str()));
-
-        deviceData->name = advertisedDevice.getName().c_str();
-
-        if (advertisedDevice.haveServiceData() && advertisedDevice.getServiceDataCount() <= 5)
+        // Предварительный фильтр: без форматирования строк и логирования
+        // Запись собирается на стеке и копируется в очередь по значению
+        BLEAdvRecord record;
+        if (!extractServiceData16(advertisedDevice.getPayload(), advertisedDevice.getPayloadLength(), record))
         {
-            deviceData->hasServiceData = true;
-            deviceData->serviceDataCount = advertisedDevice.getServiceDataCount();
-            for (int i = 0; i < deviceData->serviceDataCount; i++)
-            {
-                deviceData->serviceData[i] = advertisedDevice.getServiceData(i);
-                deviceData->serviceUUID[i] = advertisedDevice.getServiceDataUUID(i);
-            }
+            bleFramesDropped++;
+            return;
         }
-        else
+        memcpy(record.mac, *advertisedDevice.getAddress().getNative(), sizeof(record.mac));
+        if (!isMacAllowed(record.mac))
         {
-            logAndSend("Данных нет");
-            delete deviceData;
+            bleFramesDropped++;
             return;
         }
+        bleFramesAccepted++;
 
-        // Отправляем данные в очередь
+        // Отправляем данные в очередь, при переполнении пакет отбрасывается
         if (bleDataQueue != nullptr)
         {
-            if (xQueueSend(bleDataQueue, &deviceData, 0) != pdTRUE)
-            {
-                // Очередь заполнена, удаляем данные
-                delete deviceData;
-            }
+            xQueueSend(bleDataQueue, &record, 0);
         }
     }
 };
@@ -83,16 +135,17 @@ void setupXiaomiScanner()
     // Создаем очередь для передачи данных BLE если она еще не создана
     if (bleDataQueue == nullptr)
     {
-        bleDataQueue = xQueueCreate(10, sizeof(BLEDeviceData *));
+        bleDataQueue = xQueueCreateStatic(BLE_ADV_QUEUE_LENGTH, sizeof(BLEAdvRecord), bleDataQueueStorage, &bleDataQueueBuffer);
     }
 
     BLEDevice::init(SERVER_NAME);
     pBLEScan = BLEDevice::getScan();
-    pBLEScan->setAdvertisedDeviceCallbacks(new XiaomiAdvertisedDeviceCallbacks());
-    pBLEScan->setActiveScan(false); // Пассивное сканирование потребляет меньше ресурсов
-                                    // pBLEScan->setInterval(XIAOMI_SCAN_INTERVAL); // Больше интервал
-    // pBLEScan->setWindow(100);                    // Меньше окно сканирования
-    // pBLEScan->start(0, false);                   // 0 = бесконечное сканирование
+    // wantDuplicates = true: при непрерывном сканировании каждый пакет датчика должен доходить до колбэка,
+    // а результаты не накапливаются в BLEScanResults
+    pBLEScan->setAdvertisedDeviceCallbacks(new XiaomiAdvertisedDeviceCallbacks(), true);
+    pBLEScan->setActiveScan(false);             // Пассивное сканирование потребляет меньше ресурсов
+    pBLEScan->setInterval(XIAOMI_SCAN_PERIOD);  // Интервал сканирования
+    pBLEScan->setWindow(XIAOMI_SCAN_WINDOW);    // Окно меньше интервала, чтобы WiFi получал эфирное время
 
     logAndSend("Сканер датчиков Xiaomi инициализирован");
     logAndSend("Запускаем сервисы редактирования SSID и пароля");
@@ -125,170 +178,142 @@ void setupXiaomiScanner()
     // Создаем задачу для обработки данных BLE из очереди
     xTaskCreate([](void *parameter)
                 {
-                    BLEDeviceData* deviceData;
+                    BLEAdvRecord record;
                     while (true) {
                         // Ждем данные из очереди
-                        if (bleDataQueue != nullptr && xQueueReceive(bleDataQueue, &deviceData, portMAX_DELAY) == pdTRUE) {
-                            // Проверяем, что данные не нулевые
-                            if (deviceData != nullptr) {
-                                // Восстанавливаем данные для обработки
-                                // Примечание: Из-за ограничений API мы не можем полностью восстановить объект
-                                // Поэтому вызываем упрощенную версию обработки
-                                processXiaomiAdvertisement(*deviceData);
-
-                                // Освобождаем память
-                                delete deviceData;
-                            }
+                        if (bleDataQueue != nullptr && xQueueReceive(bleDataQueue, &record, portMAX_DELAY) == pdTRUE) {
+                            processXiaomiAdvertisement(record);
                         }
                     } }, "bleDataProcessor", 8192, nullptr, 1, nullptr);
+
+    startXiaomiScan();
 }
 
-void startScan(uint32_t duration)
+// Колбэк завершения сканирования (вызывается при остановке или ошибке стека BLE)
+static void onScanComplete(BLEScanResults results)
 {
-    BLEScanResults foundDevices = pBLEScan->start(duration, false);
-    logAndSend("Очистка резельтатов сканирования");
-    pBLEScan->clearResults();
     scanningActive = false;
+    scanStoppedTime = millis();
 }
 
-// Запуск сканирования BLE
+// Запуск непрерывного неблокирующего сканирования BLE
 void startXiaomiScan()
 {
-    logAndSend("Начало сканирования датчиков Xiaomi...");
     if (scanningActive)
     {
-        logAndSend("Сканирования датчиков Xiaomi уже запущено, выход");
         return;
     }
+    logAndSend("Запуск непрерывного сканирования датчиков Xiaomi...");
     scanningActive = true;
-    startScan(XIAOMI_SCAN_DURATION);
+    // duration = 0 - бесконечное сканирование, выполняется асинхронно в стеке BLE
+    if (!pBLEScan->start(0, onScanComplete, false))
+    {
+        logAndSend("Ошибка запуска сканирования BLE");
+        scanningActive = false;
+        scanStoppedTime = millis();
+    }
 }
 
-// Обработка рекламного пакета
-void processXiaomiAdvertisement(BLEDeviceData &deviceData)
+// Контроль сканирования: перезапуск после остановки и при отсутствии пакетов (вызывать периодически)
+void checkXiaomiScan()
 {
-    bool isXiaomiDevice = false;
-    std::string deviceAddress = deviceData.address;
-    bool isCustomFirmware = false;
+    static uint32_t lastFrameCount = 0;
+    static unsigned long lastFrameTime = 0;
 
-    // Проверка на кастомную прошивку ATC
-    if (deviceData.hasServiceData && deviceData.serviceDataCount > 0)
+    uint32_t frameCount = bleFramesAccepted.load() + bleFramesDropped.load();
+    if (frameCount != lastFrameCount)
     {
-        logAndSend("Есть сервисные данные");
-        for (int i = 0; i < deviceData.serviceDataCount; i++)
-        {
-            // Проверка на ATC прошивку (UUID: 0x181A или 0xFE95)
-            bool isAtc = deviceData.serviceUUID[i].equals(BLEUUID((uint16_t)0x181A)) ||
-                         deviceData.serviceUUID[i].equals(BLEUUID("fe95"));
-            if (isAtc)
-            {
-                if (deviceData.serviceData[i].length() >= 15)
-                {
-                    // Проверка MAC-адреса в данных (для ATC)
-                    uint8_t mac[6];
-                    for (int j = 0; j < 6; j++)
-                    {
-                        mac[j] = (uint8_t)deviceData.serviceData[i][5 - j];
-                    }
-
-                    // Сравниваем MAC в пакете с MAC устройства
-                    BLEAddress packetAddr(mac);
-                    BLEAddress deviceAddr(deviceAddress.c_str());
-                    bool equalsMac = packetAddr.equals(deviceAddr);
+        lastFrameCount = frameCount;
+        lastFrameTime = millis();
+    }
 
-                    if (equalsMac)
-                    {
-                        isXiaomiDevice = true;
-                        isCustomFirmware = true;
-                    }
-                }
-            }
+    if (!scanningActive)
+    {
+        if (millis() - scanStoppedTime > XIAOMI_SCAN_RESTART_DELAY)
+        {
+            lastFrameTime = millis();
+            startXiaomiScan();
         }
     }
+    else if (millis() - lastFrameTime > XIAOMI_SCAN_STALL_TIMEOUT)
+    {
+        logAndSend("Нет пакетов BLE, перезапускаем сканирование");
+        lastFrameTime = millis();
+        // После остановки onScanComplete сбросит флаг и сканирование будет перезапущено
+        pBLEScan->stop();
+        scanningActive = false;
+        scanStoppedTime = millis();
+    }
+}
 
-    // Если это устройство Xiaomi, обрабатываем его
-    if (isXiaomiDevice)
+// Обработка рекламного пакета
+void processXiaomiAdvertisement(const BLEAdvRecord &record)
+{
+    uint64_t deviceMac = macFromBytes(record.mac);
+
+    XiaomiReading reading;
+    XiaomiParseResult result = parseXiaomiAdvertisement(record, reading);
+    // Короткие пакеты 0xFE95 шлет любое устройство Xiaomi рядом: только считаем, без строк и логирования
+    if (result == XIAOMI_PARSE_NO_DATA)
     {
-        // Парсим данные из рекламного пакета
-        float temperature = 0.0;
-        float humidity = 0;
-        uint8_t battery = 0;
-        uint16_t batteryV = 0;
-        bool dataFound = false;
+        bleFramesNoData++;
+        return;
+    }
+    if (result != XIAOMI_PARSE_OK)
+    {
+        return;
+    }
 
-        // Обработка данных для устройств с кастомной прошивкой ATC
-        if (isCustomFirmware && deviceData.hasServiceData)
+    // Обновляем информацию об устройстве
+    if (devicesLock.lock())
+    {
+        unsigned long now = millis();
+        //   Ищем устройство с таким MAC-адресом
+        DeviceData *device = devices.find(deviceMac);
+        // Повторы пакета с теми же показаниями (wantDuplicates) не логируются и не публикуются:
+        // lastUpdate попадет в снимок при ближайшей публикации, не позже полного обхода CONTROL_DELAY
+        bool changed = false;
+
+        if (device != nullptr)
         {
-            for (int i = 0; i < deviceData.serviceDataCount; i++)
+            // История - только для устройств из таблицы, иначе блоки PSRAM заняли бы чужие датчики
+            sensorHistoryAdd(deviceMac, reading.temperature, reading.humidity);
+            //   Устройство найдено, обновляем данные (номер изменения - только если показания изменились)
+            if (device->updateSensorData(reading.temperature, reading.humidity, reading.battery, reading.batteryV, now))
             {
-                std::string serviceData = deviceData.serviceData[i];
-                BLEUUID serviceUUID = deviceData.serviceUUID[i];
-
-                // Проверка на ATC прошивку (UUID: 0x181A или 0xFE95)
-                if ((serviceUUID.equals(BLEUUID((uint16_t)0x181A)) || serviceUUID.equals(BLEUUID("fe95"))) && serviceData.length() >= 15)
-                {
-                    // Формат ATC: байты 10-11 - температура, байт 12 - влажность, байт 13 - батарея
-
-                    int16_t temperatureRaw = 0;
-                    int16_t humidityRaw = 0;
-                    if (serviceData.size() == 15)
-                    {
-                        temperatureRaw = (int16_t)((uint8_t)serviceData[7] << 8 | (uint8_t)serviceData[6]);
-                        temperature = temperatureRaw / 100.0f;
-
-                        humidityRaw = (int16_t)((uint8_t)serviceData[9] << 8 | (uint8_t)serviceData[8]);
-                        humidity = humidityRaw / 100.0f;
-
-                        batteryV = (int16_t)((uint8_t)serviceData[11] << 8 | (uint8_t)serviceData[10]);
-                        battery = (uint8_t)serviceData[12];
-                    }
-
-                    dataFound = true;
-
-                    break;
-                }
+                logAndSend("Обновляем данные устройства: " + String(device->name.c_str()));
+                changed = true;
+                devices.touch(*device);
+                // Задача управления пересчитает обогрев этого устройства сразу
+                requestDeviceControl(*device);
             }
         }
-
-        // Если данные найдены, обновляем информацию об устройстве
-        if (dataFound)
+        else
         {
-            if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE)
+            // Устройство не найдено, создаем новое
+            DeviceData newDevice("", deviceMac);
+            newDevice.name = "Xiaomi " + newDevice.macAddress.substr(newDevice.macAddress.length() - 5);
+            logAndSend("Найдено новое устройство: " + String(newDevice.name.c_str()));
+
+            newDevice.updateSensorData(reading.temperature, reading.humidity, reading.battery, reading.batteryV, now);
+            DeviceData *added = devices.add(newDevice);
+            if (added != nullptr)
             {
-                //   Ищем устройство с таким MAC-адресом
-                auto it = std::find_if(devices.begin(), devices.end(),
-                                       [&deviceAddress](const DeviceData &device)
-                                       {
-                                           return device.macAddress == deviceAddress;
-                                       });
-
-                if (it != devices.end())
-                {
-                    logAndSend("Обновляем данные устройства: " + String(it->name.c_str()));
-                    //   Устройство найдено, обновляем данные
-                    it->updateSensorData(temperature, humidity, battery, batteryV);
-                }
-                else
-                {
-                    // Устройство не найдено, создаем новое
-                    std::string deviceName = "Xiaomi " + deviceAddress.substr(deviceAddress.length() - 5);
-                    //  Если устройство имеет имя, используем его
-                    if (deviceData.hasName)
-                    {
-                        deviceName = deviceData.name;
-                    }
-                    logAndSend("Найдено новое устройство: " + String(deviceName.c_str()));
-
-                    DeviceData newDevice(deviceName, deviceAddress);
-                    newDevice.updateSensorData(temperature, humidity, battery, batteryV);
-                    devices.push_back(newDevice);
-                }
-                xSemaphoreGive(devicesMutex);
+                sensorHistoryAdd(deviceMac, reading.temperature, reading.humidity);
+                changed = true;
+                markDeviceAdded(*added);
+                requestDeviceControl(*added);
+                updateBleMacAllowlist();
+            }
+            else
+            {
+                logAndSend("Достигнуто максимальное количество устройств");
             }
         }
-        else
+        if (changed)
         {
-            logAndSend("Устройство Xiaomi обнаружено, но данные не найдены: " + String(deviceAddress.c_str()));
+            deviceSnapshots.publish(devices);
         }
+        devicesLock.unlock();
     }
 }
@@ -8,6 +8,8 @@
 #include <BLEAdvertisedDevice.h>
 #include "variables_info.h"
 #include <ArduinoJson.h>
+#include <atomic>
+#include <xiaomi_advertisement.h>
 
 // #define CONFIG_BT_BLE_DYNAMIC_ENV_MEMORY 1
 // #define CONFIG_BT_BTU_TASK_STACK_SIZE 4096
@@ -19,23 +21,27 @@
 #define SSID_CHARACTERISTIC_UUID "93d971b2-4bb8-45d0-9ab3-74d7f881d828"     // New SSID and password Characteristic UUID
 #define PASSWORD_CHARACTERISTIC_UUID "c5481513-22cb-4aae-9fe3-e9db5d06bf6f" // New Password Characteristic UUID
 
-// Структура для передачи данных через очередь
-struct BLEDeviceData {
-    std::string address;
-    std::string name;
-    std::string serviceData[5];  // Максимум 5 сервисных данных
-    BLEUUID serviceUUID[5];
-    int serviceDataCount = 0;
-    bool hasName = false;
-    bool hasServiceData = false;
-};
+#define BLE_ADV_QUEUE_LENGTH 32         // Глубина очереди рекламных пакетов
+#define BLE_MAC_ALLOWLIST_MAX 64        // Максимальный размер списка разрешенных MAC-адресов
+#ifndef XIAOMI_MAC_ALLOWLIST
+#define XIAOMI_MAC_ALLOWLIST 0          // 1 - принимать пакеты только от известных устройств (кроме ручного сканирования)
+#endif
+#define BLE_DISCOVERY_WINDOW 60000      // Время поиска новых датчиков после запроса /scan (мс)
 
 // Глобальные переменные
 extern BLEScan* pBLEScan;
-extern bool scanningActive;
+extern volatile bool scanningActive;
+// Счетчики принятых и отброшенных предварительным фильтром пакетов
+extern std::atomic<uint32_t> bleFramesAccepted;
+extern std::atomic<uint32_t> bleFramesDropped;
+// Пакеты, прошедшие фильтр, но без показаний (MiBeacon без данных температуры)
+extern std::atomic<uint32_t> bleFramesNoData;
 // Функции
 void setupXiaomiScanner();
 void startXiaomiScan();
-void processXiaomiAdvertisement(BLEDeviceData& deviceData);
+void checkXiaomiScan();
+void processXiaomiAdvertisement(const BLEAdvRecord &record);
+void updateBleMacAllowlist();
+void openBleDiscoveryWindow(unsigned long durationMs);
 void printDevicesData();
 #endif // XIAOMI_SCANNER_H
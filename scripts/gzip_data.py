@@ -0,0 +1,119 @@
+# Подготовка образа SPIFFS: веб-ресурсы из data/ сжимаются gzip в $BUILD_DIR/data,
+# ссылки страниц на стили/скрипты получают ?v=<хэш содержимого> для долгого кэширования.
+# Образ файловой системы (buildfs/uploadfs) собирается из этого каталога.
+# С флагом сборки -D EMBED_WEB_ASSETS сжатые ресурсы дополнительно записываются
+# в web_assets_data.h и встраиваются в прошивку (см. lib/WebServerSettings/static_assets.cpp).
+import gzip
+import hashlib
+import io
+import os
+import re
+import shutil
+import zlib
+
+Import("env")
+
+COMPRESSED = (".html", ".css", ".js", ".json", ".svg")
+
+source_dir = os.path.join(env.subst("$PROJECT_DIR"), "data")
+target_dir = os.path.join(env.subst("$BUILD_DIR"), "data")
+embed_dir = os.path.join(env.subst("$BUILD_DIR"), "web_assets")
+
+
+def content_hash(data):
+    return hashlib.sha1(data).hexdigest()[:8]
+
+
+def version_links(html, hashes):
+    # href="app.css" -> href="app.css?v=1a2b3c4d"
+    def replace(match):
+        name = match.group(2)
+        if name not in hashes:
+            return match.group(0)
+        return '%s="%s?v=%s"' % (match.group(1), name, hashes[name])
+
+    return re.sub(r'(href|src)="([^"?#:]+)"', replace, html)
+
+
+def gzip_bytes(data):
+    # mtime=0: одинаковое содержимое дает одинаковый архив и тот же ETag
+    raw = io.BytesIO()
+    with gzip.GzipFile(filename="", mode="wb", fileobj=raw, compresslevel=9, mtime=0) as out:
+        out.write(data)
+    return raw.getvalue()
+
+
+def embed_enabled():
+    return any("EMBED_WEB_ASSETS" in str(flag) for flag in env.get("BUILD_FLAGS", []))
+
+
+def write_embedded(assets):
+    # ETag считается так же, как на устройстве: CRC32 и размер отдаваемых байтов
+    lines = [
+        "// Сгенерировано scripts/gzip_data.py из каталога data/, не редактировать",
+        "#ifndef WEB_ASSETS_DATA_H",
+        "#define WEB_ASSETS_DATA_H",
+        "",
+    ]
+    entries = []
+    for index, (name, data) in enumerate(assets):
+        symbol = "webAsset%d" % index
+        lines.append("// /%s" % name)
+        lines.append("static constexpr uint8_t %s[] = {" % symbol)
+        for offset in range(0, len(data), 16):
+            lines.append("    " + ", ".join("0x%02x" % b for b in data[offset:offset + 16]) + ",")
+        lines.append("};")
+        etag = '\\"%08x-%x\\"' % (zlib.crc32(data) & 0xFFFFFFFF, len(data))
+        entries.append('    {"/%s", %s, sizeof(%s), "%s"},' % (name, symbol, symbol, etag))
+    lines.append("")
+    lines.append("static constexpr EmbeddedAsset embeddedAssets[] = {")
+    lines.extend(entries)
+    lines.append("};")
+    lines.append("")
+    lines.append("#endif")
+
+    os.makedirs(embed_dir, exist_ok=True)
+    with open(os.path.join(embed_dir, "web_assets_data.h"), "w", newline="\n") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def prepare_data():
+    if os.path.isdir(target_dir):
+        shutil.rmtree(target_dir)
+    os.makedirs(target_dir)
+
+    files = {}
+    for name in sorted(os.listdir(source_dir)):
+        path = os.path.join(source_dir, name)
+        if os.path.isfile(path):
+            with open(path, "rb") as f:
+                files[name] = f.read()
+
+    hashes = {name: content_hash(data) for name, data in files.items() if not name.endswith(".html")}
+    source_size = 0
+    target_size = 0
+    embedded = []
+    for name, data in files.items():
+        if name.endswith(".html"):
+            data = version_links(data.decode("utf-8"), hashes).encode("utf-8")
+        source_size += len(data)
+        if name.endswith(COMPRESSED):
+            data = gzip_bytes(data)
+            target = os.path.join(target_dir, name + ".gz")
+            embedded.append((name, data))
+        else:
+            target = os.path.join(target_dir, name)
+        with open(target, "wb") as f:
+            f.write(data)
+        target_size += len(data)
+
+    print("gzip_data: %d files, %d -> %d bytes" % (len(files), source_size, target_size))
+    return embedded
+
+
+embedded_assets = prepare_data()
+env.Replace(PROJECT_DATA_DIR=target_dir)
+if embed_enabled():
+    write_embedded(embedded_assets)
+    env.Append(CPPPATH=[embed_dir])
+    print("gzip_data: %d assets embedded into firmware" % len(embedded_assets))
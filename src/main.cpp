@@ -6,6 +6,10 @@
 #include "lcd_setting.h"
 #include "web_server_setting.h"
 #include "spiffs_setting.h"
+#include "persist_scheduler.h"
+#include "heating_journal.h"
+#include "heating_control.h"
+#include "sensor_history.h"
 #include "xiaomi_scanner.h"
 #include "ota_setting.h"
 #include <atomic>
@@ -16,7 +20,8 @@
 #define KEYPAD_PIN 2 // GPIO2 соответствует A1 на ESP32-S3 UNO
 #define NUM_LEDS 1   // Один светодиод
 // Глобальные переменные
-std::vector<DeviceData> devices;
+DeviceRegistry devices;
+DeviceSnapshotStore deviceSnapshots;
 
 Adafruit_NeoPixel pixels(NUM_LEDS, PIN_NEOPIXEL, NEO_GRB + NEO_KHZ800);
 
@@ -35,9 +40,8 @@ bool wifiConnected = false;
 unsigned long lastWiFiAttemptTime = 0;
 float board_temperature = 0.0;
 
-// Мьютекс для защиты доступа к общим данным
-// Создаем мьютекс для защиты доступа к данным
-SemaphoreHandle_t devicesMutex = xSemaphoreCreateMutex();
+// Мьютекс таблицы устройств: берут только изменяющие ее, читатели работают со снимком deviceSnapshots
+DeviceTableLock devicesLock;
 
 // Функция для создания эффекта радуги
 void rainbow(int wait)
@@ -50,79 +54,6 @@ void rainbow(int wait)
     }
 }
 
-// Управление GPIO
-void controlGPIO()
-{
-    logAndSend("Проверка необходимости включения GPIO");
-    std::vector<uint8_t> gpiosToTurnOn;
-
-    static unsigned long lastcontrolGPIOTime = 0;
-    unsigned long elapsedTime = millis() - lastcontrolGPIOTime;
-
-    // Собираем GPIO для включения
-    for (auto &device : devices)
-    {
-        if (device.isDataValid())
-        {
-            // Включаем обогрев если устройство доступно и температура ниже целевой
-            if (!device.heatingActive && device.enabled && (device.currentTemperature + hysteresisTemp) < device.targetTemperature)
-            {
-                logAndSend("Включаем обогрев для: " + String(device.name.c_str()));
-                device.heatingActive = true;
-            }
-            // Если температура достигла целевой - выключаем обогрев
-            else if (device.heatingActive && device.currentTemperature >= device.targetTemperature)
-            {
-                logAndSend("Выключаем обогрев для:" + String(device.name.c_str()));
-                device.heatingActive = false;
-            }
-            // Если обогрев был активен, обновляем общее время работы перед выключением
-            else if (!device.enabled && device.heatingActive)
-            {
-                logAndSend("Устройство выключено. Выключаем обогрев для: " + String(device.name.c_str()));
-                device.totalHeatingTime += elapsedTime;
-                device.heatingActive = false;
-            }
-
-            // Обновляем общее время работы
-            if (device.heatingActive)
-            {
-                // Обновляем общее время работы
-                device.totalHeatingTime += elapsedTime;
-                gpiosToTurnOn.insert(gpiosToTurnOn.end(), device.gpioPins.begin(), device.gpioPins.end());
-            }
-        }
-        else if (device.isOnline)
-        {
-            logAndSend("Устройство: " + String(device.name.c_str()) + " перешло в оффлайн");
-            device.isOnline = false;
-            device.totalHeatingTime += elapsedTime;
-            device.heatingActive = false;
-        }
-    }
-
-    // Управляем GPIO
-    for (auto &gpio : availableGpio)
-    {
-        bool shouldTurnOn = false;
-        if (gpio.state == STATE_GPIO_AUTO)
-        {
-            shouldTurnOn = std::find(gpiosToTurnOn.begin(), gpiosToTurnOn.end(), gpio.pin) != gpiosToTurnOn.end();
-        }
-        else
-        {
-            shouldTurnOn = gpio.state == STATE_GPIO_ON ? true : false;
-        }
-
-        digitalWrite(gpio.pin, shouldTurnOn ? HIGH : LOW);
-        if (shouldTurnOn)
-        {
-            gpio.totalHeatingTime += elapsedTime;
-        }
-    }
-    lastcontrolGPIOTime = millis();
-}
-
 void networkFunc()
 {
     // Если активен режим OTA, пропускаем обычную обработку
@@ -145,15 +76,8 @@ void networkFunc()
         handleOTA();
     }
 
-    // Сканирование BLE устройств
-    // Периодическое сканирование BLE
-    static unsigned long lastScanTime = 0;
-    if (millis() - lastScanTime > XIAOMI_SCAN_INTERVAL)
-    {
-        // Обновляем время последнего сканирования
-        lastScanTime = millis();
-        startXiaomiScan();
-    }
+    // Сканирование BLE выполняется непрерывно в стеке BLE, здесь только контроль и перезапуск
+    checkXiaomiScan();
     // Даем время другим задачам
     vTaskDelay(3000 / portTICK_PERIOD_MS); // Небольшая задержка для предотвращения перегрузки CPU
 }
@@ -168,39 +92,25 @@ void mainlogicFunc()
         return;
     }
 
-    // Управление GPIO
-    static unsigned long lastGpioControlTime = 0;
-    if (millis() - lastGpioControlTime > CONTROL_DELAY)
-    {
-        lastGpioControlTime = millis();
-        // Обработка логики управления устройствами
-        if (xSemaphoreTake(devicesMutex, portMAX_DELAY) == pdTRUE)
-        {
-            controlGPIO();
-            xSemaphoreGive(devicesMutex);
-        }
-        vTaskDelay(20 / portTICK_PERIOD_MS); // Добавьте задержку
-    }
-    // Добавляем переменную для отслеживания времени последнего сохранения
-    static unsigned long lastStatsSaveTime = 0;
-    // Периодически сохраняем статистику (каждые 5 минут)
+    // Управление GPIO: ожидание изменений от BLE/настроек или срока полного обхода
+    runHeatingControl();
+    // Учет времени работы сервера (каждые 5 минут)
+    static unsigned long lastWorkTimeUpdate = 0;
     unsigned long currentTime = millis();
-    if ((currentTime - lastStatsSaveTime > 300000) || (currentTime < lastStatsSaveTime))
+    if (currentTime - lastWorkTimeUpdate >= PERSIST_STATS_INTERVAL)
     {
-        logAndSend("Сохранение статистики согласно таймаута, сохраняем результаты");
-        saveClientsToFile();
-        saveGpioToFile();
-        serverWorkTime += currentTime - lastStatsSaveTime;
-        lastStatsSaveTime = currentTime;
-        saveServerSetting();
+        serverWorkTime += currentTime - lastWorkTimeUpdate;
+        lastWorkTimeUpdate = currentTime;
+        markServerSettingDirty();
     }
-    //  Даем время другим задачам
-    vTaskDelay(200 / portTICK_PERIOD_MS); // Небольшая задержка для предотвращения перегрузки CPU
+    // Сброс журнала обогрева из RAM на SPIFFS
+    heatingJournalTick();
 }
 
 // Функция задачи для основной логики (ядро 1)
 void mainLogicTaskFunction(void *parameter)
 {
+    initHeatingControl();
     for (;;)
     {
         mainlogicFunc();
@@ -265,8 +175,16 @@ void setup()
         logAndSend("Ошибка инициализации SPIFFS");
         return;
     }
+    // Задача записи во flash нужна уже при загрузке (перенос старого формата)
+    startPersistenceTask();
     loadWifiCredentialsFromFile();
+    if (!beginDeviceSnapshots())
+    {
+        logAndSend("Не удалось выделить память для снимков устройств");
+    }
     loadClientsFromFile();
+    // Точное время работы обогрева из журнала (после загрузки устройств)
+    initHeatingJournal();
     loadServerWorkTime();
     // xTaskCreate([](void *parameter)
     //             {
@@ -275,18 +193,17 @@ void setup()
 
     // Загрузка данных устройств
     loadGpioFromFile();
-    // Инициализация GPIO
-    for (auto &gpio : availableGpio)
-    {
-        pinMode(gpio.pin, OUTPUT);
-        digitalWrite(gpio.pin, LOW);
-    }
+    // Инициализация GPIO: все выходы реле выключены до первого прохода управления
+    initHeatingOutputs();
 
     // Инициализация LCD и кнопок
     initLCD();
 
     connectWiFi();
 
+    // История показаний датчиков в PSRAM
+    initSensorHistory();
+
     // Инициализация BLE сканера
     setupXiaomiScanner();
 
@@ -0,0 +1,265 @@
+// Путь рекламного пакета без кучи: извлечение сервисных данных -> кольцевая очередь по значению -> разбор
+#include <unity.h>
+#include <xiaomi_advertisement.h>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_COUNT 100000
+#define QUEUE_LENGTH 32 // Как BLE_ADV_QUEUE_LENGTH
+
+// Подсчет выделений памяти через глобальный operator new
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// Очередь фиксированного размера с копированием записей, как статическая очередь FreeRTOS
+struct RecordQueue
+{
+    BLEAdvRecord items[QUEUE_LENGTH];
+    size_t head;
+    size_t count;
+
+    bool send(const BLEAdvRecord &record)
+    {
+        if (count == QUEUE_LENGTH)
+        {
+            return false;
+        }
+        items[(head + count) % QUEUE_LENGTH] = record;
+        count++;
+        return true;
+    }
+
+    bool receive(BLEAdvRecord &record)
+    {
+        if (count == 0)
+        {
+            return false;
+        }
+        record = items[head];
+        head = (head + 1) % QUEUE_LENGTH;
+        count--;
+        return true;
+    }
+};
+
+static uint32_t randomState = 12345;
+
+static uint32_t nextRandom()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return randomState >> 8;
+}
+
+static const uint8_t sensorMac[6] = {0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56};
+
+// Сырой пакет: флаги + сервисные данные ATC (MAC в обратном порядке, затем показания)
+static size_t buildAtcFrame(uint8_t *frame, int16_t temperature, int16_t humidity, uint16_t batteryV, uint8_t battery)
+{
+    size_t n = 0;
+    frame[n++] = 2;
+    frame[n++] = 0x01;
+    frame[n++] = 0x06;
+    frame[n++] = 3 + XIAOMI_ATC_PAYLOAD_LENGTH;
+    frame[n++] = 0x16;
+    frame[n++] = XIAOMI_UUID_ATC & 0xFF;
+    frame[n++] = XIAOMI_UUID_ATC >> 8;
+    for (int i = 0; i < 6; i++)
+    {
+        frame[n++] = sensorMac[5 - i];
+    }
+    frame[n++] = temperature & 0xFF;
+    frame[n++] = (uint16_t)temperature >> 8;
+    frame[n++] = humidity & 0xFF;
+    frame[n++] = (uint16_t)humidity >> 8;
+    frame[n++] = batteryV & 0xFF;
+    frame[n++] = batteryV >> 8;
+    frame[n++] = battery;
+    frame[n++] = 0; // Счетчик и флаги
+    frame[n++] = 0;
+    return n;
+}
+
+// Пакет другого устройства: сервисные данные батареи 0x180F и имя
+static size_t buildForeignFrame(uint8_t *frame)
+{
+    size_t n = 0;
+    frame[n++] = 4;
+    frame[n++] = 0x16;
+    frame[n++] = 0x0F;
+    frame[n++] = 0x18;
+    frame[n++] = 77;
+    frame[n++] = 5;
+    frame[n++] = 0x09;
+    memcpy(&frame[n], "Lamp", 4);
+    return n + 4;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_extract_atc_frame()
+{
+    uint8_t frame[31];
+    size_t length = buildAtcFrame(frame, 2150, 4530, 2980, 87);
+    BLEAdvRecord record;
+    TEST_ASSERT_TRUE(extractServiceData16(frame, length, record));
+    TEST_ASSERT_EQUAL_UINT16(XIAOMI_UUID_ATC, record.uuid16);
+    TEST_ASSERT_EQUAL_UINT8(XIAOMI_ATC_PAYLOAD_LENGTH, record.payloadLength);
+
+    memcpy(record.mac, sensorMac, sizeof(record.mac));
+    XiaomiReading reading;
+    TEST_ASSERT_EQUAL(XIAOMI_PARSE_OK, parseXiaomiAdvertisement(record, reading));
+    TEST_ASSERT_EQUAL_FLOAT(21.5f, reading.temperature);
+    TEST_ASSERT_EQUAL_FLOAT(45.3f, reading.humidity);
+    TEST_ASSERT_EQUAL_UINT16(2980, reading.batteryV);
+    TEST_ASSERT_EQUAL_UINT8(87, reading.battery);
+}
+
+void test_negative_temperature()
+{
+    uint8_t frame[31];
+    size_t length = buildAtcFrame(frame, -1234, 9000, 3000, 100);
+    BLEAdvRecord record;
+    TEST_ASSERT_TRUE(extractServiceData16(frame, length, record));
+    memcpy(record.mac, sensorMac, sizeof(record.mac));
+    XiaomiReading reading;
+    TEST_ASSERT_EQUAL(XIAOMI_PARSE_OK, parseXiaomiAdvertisement(record, reading));
+    TEST_ASSERT_EQUAL_FLOAT(-12.34f, reading.temperature);
+}
+
+void test_foreign_and_truncated_frames_dropped()
+{
+    uint8_t frame[31];
+    BLEAdvRecord record;
+    TEST_ASSERT_FALSE(extractServiceData16(frame, buildForeignFrame(frame), record));
+
+    // Длина поля выходит за конец пакета
+    size_t length = buildAtcFrame(frame, 2000, 5000, 3000, 90);
+    TEST_ASSERT_FALSE(extractServiceData16(frame, length - 1, record));
+
+    // Поле нулевой длины завершает разбор
+    frame[0] = 0;
+    TEST_ASSERT_FALSE(extractServiceData16(frame, length, record));
+}
+
+void test_mac_mismatch_and_short_payload()
+{
+    uint8_t frame[31];
+    size_t length = buildAtcFrame(frame, 2000, 5000, 3000, 90);
+    BLEAdvRecord record;
+    TEST_ASSERT_TRUE(extractServiceData16(frame, length, record));
+    XiaomiReading reading;
+
+    memcpy(record.mac, sensorMac, sizeof(record.mac));
+    record.mac[5] ^= 1;
+    TEST_ASSERT_EQUAL(XIAOMI_PARSE_MAC_MISMATCH, parseXiaomiAdvertisement(record, reading));
+
+    record.payloadLength = XIAOMI_ATC_PAYLOAD_LENGTH - 1;
+    TEST_ASSERT_EQUAL(XIAOMI_PARSE_NO_DATA, parseXiaomiAdvertisement(record, reading));
+}
+
+// 100000 пакетов через весь путь: куча не должна использоваться ни разу
+void test_no_heap_growth()
+{
+    static RecordQueue queue;
+    uint8_t frame[31];
+    uint32_t accepted = 0;
+    uint32_t dropped = 0;
+    uint32_t parsed = 0;
+    uint32_t overflow = 0;
+    float temperatureSum = 0;
+
+    // Счетчик действительно видит выделения
+    size_t before = allocations;
+    ::operator delete(::operator new(sizeof(int)));
+    TEST_ASSERT_EQUAL(before + 1, allocations);
+
+    before = allocations;
+    for (uint32_t i = 0; i < FRAME_COUNT; i++)
+    {
+        size_t length;
+        if (nextRandom() % 4 == 0)
+        {
+            length = buildForeignFrame(frame);
+        }
+        else
+        {
+            length = buildAtcFrame(frame, (int16_t)(1500 + nextRandom() % 1500), (int16_t)(nextRandom() % 10000), 3000, 90);
+        }
+
+        BLEAdvRecord record;
+        if (!extractServiceData16(frame, length, record))
+        {
+            dropped++;
+        }
+        else
+        {
+            memcpy(record.mac, sensorMac, sizeof(record.mac));
+            accepted++;
+            if (!queue.send(record))
+            {
+                overflow++;
+            }
+        }
+
+        // Обработчик разбирает очередь пачками, чтобы она заполнялась и переполнялась
+        if (i % 48 == 47)
+        {
+            BLEAdvRecord received;
+            while (queue.receive(received))
+            {
+                XiaomiReading reading;
+                if (parseXiaomiAdvertisement(received, reading) == XIAOMI_PARSE_OK)
+                {
+                    parsed++;
+                    temperatureSum += reading.temperature;
+                }
+            }
+        }
+    }
+    size_t after = allocations;
+
+    TEST_ASSERT_EQUAL_UINT32(FRAME_COUNT, accepted + dropped);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, dropped);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, overflow);
+    TEST_ASSERT_EQUAL_UINT32(accepted - overflow - queue.count, parsed);
+    TEST_ASSERT_GREATER_THAN_FLOAT(0, temperatureSum);
+    TEST_ASSERT_EQUAL(before, after);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_extract_atc_frame);
+    RUN_TEST(test_negative_temperature);
+    RUN_TEST(test_foreign_and_truncated_frames_dropped);
+    RUN_TEST(test_mac_mismatch_and_short_payload);
+    RUN_TEST(test_no_heap_growth);
+    return UNITY_END();
+}
@@ -0,0 +1,270 @@
+// Потоковая выдача /clients из снимка: корректность JSON, дельты и память на запрос при разном числе устройств
+#include <unity.h>
+#include <device_json_stream.h>
+#include <memory>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#define TCP_CHUNK 1436 // Порция, которую AsyncWebServer запрашивает у chunked-ответа
+
+// Учет памяти кучи: число выделений, текущий объем и пик.
+// Размер блока хранится перед ним; noinline - чтобы компилятор не сверял malloc/free с new/delete в местах вызова
+static size_t allocations = 0;
+static size_t heapBytes = 0;
+static size_t heapPeak = 0;
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    size_t *p = (size_t *)malloc(size + sizeof(size_t));
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    *p = size;
+    allocations++;
+    heapBytes += size;
+    heapPeak = heapBytes > heapPeak ? heapBytes : heapPeak;
+    return p + 1;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    if (p != nullptr)
+    {
+        size_t *block = (size_t *)p - 1;
+        heapBytes -= *block;
+        free(block);
+    }
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+static DeviceRegistry registry;
+static DeviceSnapshotStore store;
+
+static void fillRegistry(size_t count)
+{
+    registry.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        DeviceData device("Комната " + std::to_string(i), 0xA4C138000000ULL + i * 0x0101);
+        device.updateSensorData(21.5f + i * 0.1f, 45.0f, 90, 2980, 1000);
+        device.totalHeatingTime = 3723000UL * i;
+        device.gpioPins = {4, (uint8_t)(5 + i % 3)};
+        registry.add(device);
+        registry.touch(registry[i]);
+    }
+    store.publish(registry);
+}
+
+// Полный ответ потока порциями TCP_CHUNK
+static std::string readStream(DeviceJsonStream &stream)
+{
+    std::string body;
+    uint8_t buffer[TCP_CHUNK];
+    size_t n;
+    while ((n = stream.fill(buffer, sizeof(buffer))) > 0)
+    {
+        body.append((const char *)buffer, n);
+    }
+    return body;
+}
+
+static size_t countOf(const std::string &text, const char *pattern)
+{
+    size_t count = 0;
+    for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+    {
+        count++;
+    }
+    return count;
+}
+
+struct RequestMemory
+{
+    size_t responseBytes;
+    size_t allocations;
+    size_t peakBytes; // Пик кучи сверх занятой до запроса
+};
+
+// Запрос как в sendDeviceJson: поток в shared_ptr, ответ отдается порциями прямо в буфер TCP
+static RequestMemory measureStream()
+{
+    uint8_t buffer[TCP_CHUNK];
+    RequestMemory memory = {0, 0, 0};
+    size_t startAllocations = allocations;
+    size_t startBytes = heapBytes;
+    heapPeak = heapBytes;
+    {
+        std::shared_ptr<DeviceJsonStream> stream = std::make_shared<DeviceJsonStream>(store, formatClientJson);
+        size_t n;
+        while ((n = stream->fill(buffer, sizeof(buffer))) > 0)
+        {
+            memory.responseBytes += n;
+        }
+    }
+    memory.allocations = allocations - startAllocations;
+    memory.peakBytes = heapPeak - startBytes;
+    TEST_ASSERT_EQUAL(startBytes, heapBytes);
+    return memory;
+}
+
+// Прежний способ для сравнения: весь ответ собирается в одной строке, затем отдается
+static RequestMemory measureWholeBody()
+{
+    char record[DEVICE_JSON_RECORD_MAX];
+    RequestMemory memory = {0, 0, 0};
+    size_t startAllocations = allocations;
+    size_t startBytes = heapBytes;
+    heapPeak = heapBytes;
+    {
+        const DeviceSnapshot *snapshot = store.acquire();
+        std::string body = "[";
+        for (size_t i = 0; i < snapshot->count; i++)
+        {
+            body += i == 0 ? "" : ",";
+            body.append(record, formatClientJson(snapshot->entries[i], record, sizeof(record)));
+        }
+        body += "]";
+        store.release(snapshot);
+        memory.responseBytes = body.size();
+    }
+    memory.allocations = allocations - startAllocations;
+    memory.peakBytes = heapPeak - startBytes;
+    return memory;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_text_helpers()
+{
+    char mac[MAC_ADDRESS_TEXT_SIZE];
+    formatMacAddress(0xA4C1380A0B0CULL, mac);
+    TEST_ASSERT_EQUAL_STRING("a4:c1:38:0a:0b:0c", mac);
+    char time[HEATING_TIME_TEXT_SIZE];
+    formatHeatingTime(90061000UL, time, sizeof(time));
+    TEST_ASSERT_EQUAL_STRING("1d 01:01:01", time);
+}
+
+void test_record_escaping_and_long_name()
+{
+    fillRegistry(1);
+    registry[0].name = "Кухня \"окно\"\\\n";
+    store.publish(registry);
+    const DeviceSnapshot *snapshot = store.acquire();
+    char record[DEVICE_JSON_RECORD_MAX];
+    size_t length = formatClientJson(snapshot->entries[0], record, sizeof(record));
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_EQUAL(strlen(record), length);
+    TEST_ASSERT_NOT_NULL(strstr(record, "{\"name\":\"Кухня \\\"окно\\\"\\\\\\u000a\",\"macAddress\":\"a4:c1:38:00:00:00\""));
+    TEST_ASSERT_NOT_NULL(strstr(record, "\"gpioPins\":[4,5]}"));
+    store.release(snapshot);
+
+    // Самое длинное имя, где каждый байт экранируется как \u00XX, помещается в запись
+    registry[0].name = std::string(DEVICE_NAME_MAX, '\x01');
+    store.publish(registry);
+    snapshot = store.acquire();
+    TEST_ASSERT_GREATER_THAN(6 * DEVICE_NAME_MAX, formatClientJson(snapshot->entries[0], record, sizeof(record)));
+    TEST_ASSERT_GREATER_THAN(6 * DEVICE_NAME_MAX, formatHeatingStatsJson(snapshot->entries[0], record, sizeof(record)));
+    TEST_ASSERT_GREATER_THAN(6 * DEVICE_NAME_MAX, formatStateEventJson(snapshot->entries[0], record, sizeof(record)));
+    // Не помещается в буфер - 0, а не обрезанная запись
+    TEST_ASSERT_EQUAL(0, formatClientJson(snapshot->entries[0], record, 100));
+    store.release(snapshot);
+}
+
+void test_stream_matches_records()
+{
+    fillRegistry(5);
+    DeviceJsonStream stream(store, formatHeatingStatsJson);
+    std::string body = readStream(stream);
+
+    const DeviceSnapshot *snapshot = store.acquire();
+    char record[DEVICE_JSON_RECORD_MAX];
+    std::string expected = "[";
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        expected += i == 0 ? "" : ",";
+        expected.append(record, formatHeatingStatsJson(snapshot->entries[i], record, sizeof(record)));
+    }
+    expected += "]";
+    store.release(snapshot);
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), body.c_str());
+    TEST_ASSERT_NOT_NULL(strstr(body.c_str(), "\"totalHeatingTimeFormatted\":\"0d 01:02:03\""));
+}
+
+void test_delta_stream()
+{
+    fillRegistry(4);
+    uint32_t since = registry.currentSeq();
+    registry[2].targetTemperature = 23.0f;
+    registry.touch(registry[2]);
+    store.publish(registry);
+
+    DeviceJsonStream delta(store, formatClientJson, true, since);
+    std::string body = readStream(delta);
+    TEST_ASSERT_EQUAL(0, body.find("{\"seq\":" + std::to_string(registry.currentSeq()) + ",\"full\":false,\"devices\":[{"));
+    TEST_ASSERT_EQUAL(1, countOf(body, "\"macAddress\""));
+    TEST_ASSERT_NOT_NULL(strstr(body.c_str(), registry[2].macAddress.c_str()));
+    TEST_ASSERT_EQUAL('}', body.back());
+
+    // После удаления устройства дельта заменяется полным списком
+    registry.remove(registry[0].mac);
+    store.publish(registry);
+    DeviceJsonStream full(store, formatClientJson, true, since);
+    body = readStream(full);
+    TEST_ASSERT_NOT_NULL(strstr(body.c_str(), "\"full\":true"));
+    TEST_ASSERT_EQUAL(3, countOf(body, "\"macAddress\""));
+}
+
+// Память на запрос /clients при 10, 50 и 64 устройствах (64 - DEVICE_REGISTRY_CAPACITY, 200 в реестр не помещаются)
+void test_request_memory_is_flat()
+{
+    static const size_t counts[] = {10, 50, DEVICE_REGISTRY_CAPACITY};
+    RequestMemory first = {0, 0, 0};
+    for (size_t count : counts)
+    {
+        fillRegistry(count);
+        RequestMemory stream = measureStream();
+        RequestMemory whole = measureWholeBody();
+        TEST_ASSERT_EQUAL(stream.responseBytes, whole.responseBytes);
+
+        char message[200];
+        snprintf(message, sizeof(message),
+                 "%2u devices: response %5u bytes; stream %u allocations, peak %u bytes; whole body %u allocations, peak %u bytes",
+                 (unsigned)count, (unsigned)stream.responseBytes, (unsigned)stream.allocations, (unsigned)stream.peakBytes,
+                 (unsigned)whole.allocations, (unsigned)whole.peakBytes);
+        TEST_MESSAGE(message);
+
+        if (first.responseBytes == 0)
+        {
+            first = stream;
+        }
+        // Одно выделение (поток с буфером записи) при любом числе устройств
+        TEST_ASSERT_EQUAL(1, stream.allocations);
+        TEST_ASSERT_EQUAL(first.peakBytes, stream.peakBytes);
+        TEST_ASSERT_LESS_THAN(sizeof(DeviceJsonStream) + 64, stream.peakBytes);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    TEST_ASSERT_TRUE(store.begin());
+    UNITY_BEGIN();
+    RUN_TEST(test_text_helpers);
+    RUN_TEST(test_record_escaping_and_long_name);
+    RUN_TEST(test_stream_matches_records);
+    RUN_TEST(test_delta_stream);
+    RUN_TEST(test_request_memory_is_flat);
+    return UNITY_END();
+}
@@ -0,0 +1,342 @@
+// Снимок таблицы устройств: согласованность при одновременных писателе и читателях,
+// ожидание блокировки таблицы до (читатели под мьютексом) и после (читатели только со снимком)
+#include <unity.h>
+#include <device_snapshot.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+#define STRESS_DEVICES DEVICE_REGISTRY_CAPACITY
+#define STRESS_READERS 3         // HTTP /clients, /heating_stats и LCD
+#define STRESS_WRITES 4000       // Обновлений таблицы писателем (BLE)
+#define STRESS_WRITE_PAUSE_US 20 // Пауза писателя между обновлениями
+
+typedef std::chrono::steady_clock Clock;
+
+// Таблица устройств с мьютексом, как devices + devicesLock
+static DeviceRegistry registry;
+static std::mutex tableMutex;
+static DeviceSnapshotStore store;
+
+static double elapsedUs(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+struct WaitStats
+{
+    uint64_t count = 0;
+    double totalUs = 0;
+    double maxUs = 0;
+
+    void add(double us)
+    {
+        count++;
+        totalUs += us;
+        maxUs = us > maxUs ? us : maxUs;
+    }
+
+    void merge(const WaitStats &other)
+    {
+        count += other.count;
+        totalUs += other.totalUs;
+        maxUs = other.maxUs > maxUs ? other.maxUs : maxUs;
+    }
+
+    double meanUs() const { return count > 0 ? totalUs / count : 0; }
+};
+
+struct StressResult
+{
+    WaitStats writer;  // Ожидание мьютекса писателем
+    WaitStats readers; // Ожидание читателей: мьютекс (до) или acquire + release (после)
+    uint64_t reads = 0;
+    double durationMs = 0;
+    uint64_t tornReads = 0;      // Чтения, увидевшие устройства из разных обновлений
+    uint64_t versionRegress = 0; // Снимок старее ранее прочитанного
+};
+
+// Запись как в /clients: форматирование занимает основное время чтения
+static size_t formatEntry(char *buffer, size_t size, uint64_t mac, const char *name, float temperature, float target,
+                          float humidity, unsigned long lastUpdate)
+{
+    return snprintf(buffer, size,
+                    "{\"name\":\"%s\",\"mac\":\"%012llx\",\"currentTemperature\":%.2f,\"targetTemperature\":%.2f,"
+                    "\"humidity\":%.2f,\"lastUpdate\":%lu}",
+                    name, (unsigned long long)mac, temperature, target, humidity, lastUpdate);
+}
+
+static void resetTable()
+{
+    registry.clear();
+    for (int i = 0; i < STRESS_DEVICES; i++)
+    {
+        DeviceData device("Комната " + std::to_string(i), 0xA4C138000000ULL + i);
+        device.updateSensorData(20.0f, 45.0f, 90, 3000, 0);
+        registry.add(device);
+    }
+    store.publish(registry);
+}
+
+// Повтор пропущенной публикации, как republishDeviceSnapshot в прошивке
+static void republish()
+{
+    std::lock_guard<std::mutex> guard(tableMutex);
+    if (store.publishPending())
+    {
+        store.publish(registry);
+    }
+}
+
+static void writer(bool useSnapshot, std::atomic<bool> &done, WaitStats &stats)
+{
+    for (int round = 1; round <= STRESS_WRITES; round++)
+    {
+        Clock::time_point start = Clock::now();
+        tableMutex.lock();
+        stats.add(elapsedUs(start, Clock::now()));
+        // Все устройства получают значение этого обновления: снимок с разными значениями - разорванное чтение
+        for (auto &device : registry)
+        {
+            device.updateSensorData((float)round, 45.0f, 90, 3000, (unsigned long)round);
+            registry.touch(device);
+        }
+        if (useSnapshot)
+        {
+            store.publish(registry);
+        }
+        tableMutex.unlock();
+        std::this_thread::sleep_for(std::chrono::microseconds(STRESS_WRITE_PAUSE_US));
+    }
+    done = true;
+}
+
+static void reader(bool useSnapshot, const std::atomic<bool> &done, StressResult &result)
+{
+    char record[512];
+    uint32_t lastVersion = 0;
+    size_t checksum = 0;
+    while (!done.load())
+    {
+        bool torn = false;
+        if (useSnapshot)
+        {
+            Clock::time_point start = Clock::now();
+            const DeviceSnapshot *snapshot = store.acquire();
+            double waitUs = elapsedUs(start, Clock::now());
+            if (snapshot->version < lastVersion)
+            {
+                result.versionRegress++;
+            }
+            lastVersion = snapshot->version;
+            for (size_t i = 0; i < snapshot->count; i++)
+            {
+                const DeviceSnapshotEntry &entry = snapshot->entries[i];
+                torn = torn || entry.currentTemperature != snapshot->entries[0].currentTemperature;
+                checksum += formatEntry(record, sizeof(record), entry.mac, entry.name, entry.currentTemperature,
+                                        entry.targetTemperature, entry.humidity, entry.lastUpdate);
+            }
+            start = Clock::now();
+            store.release(snapshot);
+            result.readers.add(waitUs + elapsedUs(start, Clock::now()));
+        }
+        else
+        {
+            // Прежняя схема: ответ формируется под мьютексом таблицы
+            Clock::time_point start = Clock::now();
+            tableMutex.lock();
+            result.readers.add(elapsedUs(start, Clock::now()));
+            for (const auto &device : registry)
+            {
+                torn = torn || device.currentTemperature != registry[0].currentTemperature;
+                checksum += formatEntry(record, sizeof(record), device.mac, device.name.c_str(), device.currentTemperature,
+                                        device.targetTemperature, device.humidity, device.lastUpdate);
+            }
+            tableMutex.unlock();
+        }
+        result.reads++;
+        result.tornReads += torn ? 1 : 0;
+    }
+    TEST_ASSERT_GREATER_THAN(0, checksum);
+}
+
+static StressResult runStress(bool useSnapshot)
+{
+    resetTable();
+    std::atomic<bool> done(false);
+    StressResult result;
+    StressResult readerResults[STRESS_READERS];
+    std::thread readers[STRESS_READERS];
+    for (int i = 0; i < STRESS_READERS; i++)
+    {
+        readers[i] = std::thread(reader, useSnapshot, std::cref(done), std::ref(readerResults[i]));
+    }
+    Clock::time_point start = Clock::now();
+    std::thread writerThread(writer, useSnapshot, std::ref(done), std::ref(result.writer));
+    writerThread.join();
+    result.durationMs = elapsedUs(start, Clock::now()) / 1000;
+    for (int i = 0; i < STRESS_READERS; i++)
+    {
+        readers[i].join();
+        result.readers.merge(readerResults[i].readers);
+        result.reads += readerResults[i].reads;
+        result.tornReads += readerResults[i].tornReads;
+        result.versionRegress += readerResults[i].versionRegress;
+    }
+
+    char message[200];
+    snprintf(message, sizeof(message),
+             "%s: writer wait mean %.2f us, max %.1f us; reader wait mean %.2f us, max %.1f us; %llu reads in %.0f ms",
+             useSnapshot ? "snapshot  " : "table lock", result.writer.meanUs(), result.writer.maxUs,
+             result.readers.meanUs(), result.readers.maxUs, (unsigned long long)result.reads, result.durationMs);
+    TEST_MESSAGE(message);
+    return result;
+}
+
+static unsigned listenerCalls = 0;
+
+static void countListener()
+{
+    listenerCalls++;
+}
+
+void setUp()
+{
+    store.setListener(nullptr);
+    store.setRetryHandler(republish);
+}
+
+void tearDown()
+{
+}
+
+void test_empty_store()
+{
+    DeviceSnapshotStore empty;
+    TEST_ASSERT_TRUE(empty.begin());
+    TEST_ASSERT_NULL(empty.acquire());
+    empty.release(nullptr);
+}
+
+void test_snapshot_copies_registry()
+{
+    resetTable();
+    DeviceData &device = registry[3];
+    device.name = std::string(DEVICE_NAME_MAX, 'x');
+    device.gpioPins = {4, 5, 6};
+    device.targetTemperature = 22.5f;
+    registry.touch(device);
+    store.publish(registry);
+
+    const DeviceSnapshot *snapshot = store.acquire();
+    TEST_ASSERT_NOT_NULL(snapshot);
+    TEST_ASSERT_EQUAL(STRESS_DEVICES, snapshot->count);
+    TEST_ASSERT_EQUAL_UINT32(registry.currentSeq(), snapshot->changeSeq);
+    const DeviceSnapshotEntry &entry = snapshot->entries[3];
+    TEST_ASSERT_EQUAL_HEX64(device.mac, entry.mac);
+    TEST_ASSERT_EQUAL_STRING(device.name.c_str(), entry.name);
+    TEST_ASSERT_EQUAL_FLOAT(22.5f, entry.targetTemperature);
+    TEST_ASSERT_EQUAL_UINT8(3, entry.gpioCount);
+    TEST_ASSERT_EQUAL_UINT8(6, entry.gpioPins[2]);
+    TEST_ASSERT_EQUAL_UINT32(device.changeSeq, entry.changeSeq);
+    TEST_ASSERT_TRUE(entry.isDataValid(1000));
+    TEST_ASSERT_FALSE(entry.isDataValid(XIAOMI_OFFLINE_TIMEOUT));
+    store.release(snapshot);
+}
+
+// Читатель удерживает снимок, пока публикуются новые: его данные не меняются
+void test_held_snapshot_is_immutable()
+{
+    resetTable();
+    const DeviceSnapshot *held = store.acquire();
+    uint32_t heldVersion = held->version;
+    for (int round = 0; round < 10; round++)
+    {
+        registry[0].updateSensorData(30.0f + round, 45.0f, 90, 3000, 0);
+        registry.touch(registry[0]);
+        store.publish(registry);
+    }
+    TEST_ASSERT_EQUAL_UINT32(heldVersion, held->version);
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, held->entries[0].currentTemperature);
+    store.release(held);
+
+    const DeviceSnapshot *latest = store.acquire();
+    TEST_ASSERT_EQUAL_FLOAT(39.0f, latest->entries[0].currentTemperature);
+    store.release(latest);
+}
+
+// Все буферы заняты: публикация откладывается и выполняется при освобождении буфера
+void test_skipped_publish_retried_on_release()
+{
+    resetTable();
+    const DeviceSnapshot *first = store.acquire();
+    registry.touch(registry[0]);
+    store.publish(registry);
+    const DeviceSnapshot *second = store.acquire();
+    registry.touch(registry[0]);
+    store.publish(registry);
+    const DeviceSnapshot *third = store.acquire();
+    TEST_ASSERT_FALSE(store.publishPending());
+
+    registry[0].updateSensorData(25.0f, 45.0f, 90, 3000, 0);
+    registry.touch(registry[0]);
+    store.publish(registry);
+    TEST_ASSERT_TRUE(store.publishPending());
+    TEST_ASSERT_TRUE(store.acquire() == third);
+    store.release(third);
+    TEST_ASSERT_TRUE(store.publishPending());
+
+    store.release(first);
+    TEST_ASSERT_FALSE(store.publishPending());
+    const DeviceSnapshot *latest = store.acquire();
+    TEST_ASSERT_EQUAL_UINT32(registry.currentSeq(), latest->changeSeq);
+    TEST_ASSERT_EQUAL_FLOAT(25.0f, latest->entries[0].currentTemperature);
+    store.release(latest);
+    store.release(second);
+    store.release(third);
+}
+
+void test_listener_only_on_new_changes()
+{
+    resetTable();
+    listenerCalls = 0;
+    store.setListener(countListener);
+    // Первая публикация после подписки сообщает текущий номер, повтор без изменений - нет
+    store.publish(registry);
+    store.publish(registry);
+    TEST_ASSERT_EQUAL(1, listenerCalls);
+    registry.touch(registry[1]);
+    store.publish(registry);
+    store.publish(registry);
+    TEST_ASSERT_EQUAL(2, listenerCalls);
+}
+
+// Нагрузочный тест: писатель и три читателя одновременно, обе схемы
+void test_concurrent_readers_and_writer()
+{
+    StressResult locked = runStress(false);
+    StressResult snapshot = runStress(true);
+
+    TEST_ASSERT_EQUAL_UINT64(0, locked.tornReads);
+    TEST_ASSERT_EQUAL_UINT64(0, snapshot.tornReads);
+    TEST_ASSERT_EQUAL_UINT64(0, snapshot.versionRegress);
+    TEST_ASSERT_GREATER_THAN(0, snapshot.reads);
+    TEST_ASSERT_EQUAL(STRESS_WRITES, snapshot.writer.count);
+    // Писатель больше не ждет, пока читатели форматируют ответ под мьютексом
+    TEST_ASSERT_LESS_THAN(locked.writer.meanUs(), snapshot.writer.meanUs());
+}
+
+int main(int argc, char **argv)
+{
+    TEST_ASSERT_TRUE(store.begin());
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_store);
+    RUN_TEST(test_snapshot_copies_registry);
+    RUN_TEST(test_held_snapshot_is_immutable);
+    RUN_TEST(test_skipped_publish_retried_on_release);
+    RUN_TEST(test_listener_only_on_new_changes);
+    RUN_TEST(test_concurrent_readers_and_writer);
+    return UNITY_END();
+}
@@ -0,0 +1,206 @@
+// Алгоритмы управления обогревом: гистерезис, ПИД (производная по своим точкам), прогноз и обучение модели
+#include <unity.h>
+#include <heating_controller.h>
+#include <string.h>
+
+#define CALL_INTERVAL 30000 // Период вызовов, как полный обход задачи управления (мс)
+
+static HeatingControllerInput input(float temperature, float target, float hysteresis, bool heating, unsigned long now)
+{
+    HeatingControllerInput in = {temperature, target, hysteresis, heating, now};
+    return in;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_controller_names()
+{
+    for (uint8_t type = 0; type < CONTROLLER_TYPE_COUNT; type++)
+    {
+        uint8_t parsed = CONTROLLER_TYPE_COUNT;
+        TEST_ASSERT_TRUE(parseHeatingController(heatingControllerName(type), parsed));
+        TEST_ASSERT_EQUAL_UINT8(type, parsed);
+    }
+    uint8_t parsed = CONTROLLER_PID;
+    TEST_ASSERT_FALSE(parseHeatingController("bang-bang", parsed));
+    TEST_ASSERT_EQUAL_UINT8(CONTROLLER_PID, parsed);
+    TEST_ASSERT_EQUAL_STRING("hysteresis", heatingControllerName(200));
+}
+
+void test_hysteresis()
+{
+    HeatingControllerState state = {};
+    TEST_ASSERT_TRUE(heatingControllerDecide(CONTROLLER_HYSTERESIS, input(19.4f, 21, 1.5f, false, 0), state));
+    TEST_ASSERT_FALSE(heatingControllerDecide(CONTROLLER_HYSTERESIS, input(19.6f, 21, 1.5f, false, 1000), state));
+    TEST_ASSERT_TRUE(heatingControllerDecide(CONTROLLER_HYSTERESIS, input(20.9f, 21, 1.5f, true, 2000), state));
+    TEST_ASSERT_FALSE(heatingControllerDecide(CONTROLLER_HYSTERESIS, input(21.0f, 21, 1.5f, true, 3000), state));
+}
+
+void test_pid_duty_limits()
+{
+    HeatingControllerState cold = {};
+    HeatingControllerState warm = {};
+    for (unsigned long now = 0; now < PID_WINDOW_TIME; now += CALL_INTERVAL)
+    {
+        TEST_ASSERT_TRUE(heatingControllerDecide(CONTROLLER_PID, input(15, 21, 1, true, now), cold));
+        TEST_ASSERT_FALSE(heatingControllerDecide(CONTROLLER_PID, input(23, 21, 1, false, now), warm));
+    }
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, cold.windowDuty);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, warm.windowDuty);
+    // Интеграл не растет, пока окно полностью включено, и не уходит ниже нуля
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, cold.integral);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, warm.integral);
+}
+
+// Скорость для производной считается на каждом вызове ПИД, модель прогноза за это время
+// еще не набрала ни одной оценки
+void test_pid_rate_from_own_samples()
+{
+    HeatingControllerState steady = {};
+    HeatingControllerState rising = {};
+    const float slope = 3.0f; // °C/ч
+    for (unsigned long now = 0; now < PREDICT_RATE_INTERVAL; now += CALL_INTERVAL)
+    {
+        heatingControllerDecide(CONTROLLER_PID, input(20.5f, 21, 1, false, now), steady);
+        heatingControllerDecide(CONTROLLER_PID, input(20.0f + slope * now / 3600000.0f, 21, 1, false, now), rising);
+    }
+    TEST_ASSERT_EQUAL(0, rising.heatSamples + rising.coolSamples);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, steady.pidRate);
+    // Сглаживание с постоянной PID_RATE_FILTER: за половину постоянной - около 40% скорости
+    TEST_ASSERT_GREATER_THAN_FLOAT(0.3f * slope, rising.pidRate);
+    TEST_ASSERT_LESS_THAN_FLOAT(slope, rising.pidRate);
+    TEST_ASSERT_EQUAL_UINT32(PREDICT_RATE_INTERVAL - CALL_INTERVAL, rising.pidTime);
+
+    // Повтор вызова в тот же момент скорость не меняет
+    float rate = rising.pidRate;
+    heatingControllerDecide(CONTROLLER_PID, input(25, 21, 1, false, rising.pidTime), rising);
+    TEST_ASSERT_EQUAL_FLOAT(rate, rising.pidRate);
+}
+
+// При одинаковой температуре в начале окна растущая температура уменьшает долю обогрева
+void test_pid_derivative_reduces_duty()
+{
+    HeatingControllerState steady = {};
+    HeatingControllerState rising = {};
+    for (unsigned long now = 0; now <= PID_WINDOW_TIME; now += CALL_INTERVAL)
+    {
+        float progress = (float)now / PID_WINDOW_TIME;
+        heatingControllerDecide(CONTROLLER_PID, input(20.5f, 21, 1, false, now), steady);
+        heatingControllerDecide(CONTROLLER_PID, input(19.5f + progress, 21, 1, false, now), rising);
+    }
+    TEST_ASSERT_EQUAL_UINT32(PID_WINDOW_TIME, steady.windowStart);
+    TEST_ASSERT_EQUAL_UINT32(PID_WINDOW_TIME, rising.windowStart);
+    // Без производной окно растущей температуры было бы не меньше: она была ниже, интеграл больше
+    TEST_ASSERT_GREATER_THAN_FLOAT(0.2f, steady.windowDuty);
+    TEST_ASSERT_LESS_THAN_FLOAT(steady.windowDuty - 0.2f, rising.windowDuty);
+}
+
+void test_type_switch_resets_pid_keeps_model()
+{
+    HeatingControllerState state = {};
+    state.integral = 2;
+    state.windowStarted = true;
+    state.pidSampled = true;
+    state.pidRate = 5;
+    state.heatRate = 1.5f;
+    state.heatSamples = 7;
+    state.lag = 300000;
+    state.lagSamples = 2;
+
+    heatingControllerDecide(CONTROLLER_PID, input(20, 21, 1, false, 1000), state);
+    TEST_ASSERT_EQUAL_UINT8(CONTROLLER_PID, state.activeType);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, state.integral);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, state.pidRate);
+    TEST_ASSERT_EQUAL_UINT32(1000, state.windowStart);
+    TEST_ASSERT_EQUAL_FLOAT(1.5f, state.heatRate);
+    TEST_ASSERT_EQUAL_UINT8(7, state.heatSamples);
+    TEST_ASSERT_EQUAL_FLOAT(300000.0f, state.lag);
+}
+
+void test_predictive_falls_back_to_hysteresis()
+{
+    HeatingControllerState predictive = {};
+    HeatingControllerState hysteresis = {};
+    static const float temperatures[] = {19.4f, 19.6f, 20.5f, 21.0f, 21.2f, 20.0f, 19.0f};
+    bool heatingPredictive = false;
+    bool heatingHysteresis = false;
+    for (size_t i = 0; i < sizeof(temperatures) / sizeof(temperatures[0]); i++)
+    {
+        unsigned long now = i * 60000;
+        heatingPredictive = heatingControllerDecide(CONTROLLER_PREDICTIVE, input(temperatures[i], 21, 1.5f, heatingPredictive, now), predictive);
+        heatingHysteresis = heatingControllerDecide(CONTROLLER_HYSTERESIS, input(temperatures[i], 21, 1.5f, heatingHysteresis, now), hysteresis);
+        TEST_ASSERT_EQUAL(heatingHysteresis, heatingPredictive);
+    }
+}
+
+static HeatingControllerState learnedState()
+{
+    HeatingControllerState state = {};
+    state.activeType = CONTROLLER_PREDICTIVE;
+    state.heatRate = 2.0f;
+    state.coolRate = 1.2f;
+    state.heatSamples = PREDICT_MIN_SAMPLES;
+    state.coolSamples = PREDICT_MIN_SAMPLES;
+    state.lag = 1200000; // 20 мин, выбег - половина: 10 мин
+    state.lagSamples = 1;
+    return state;
+}
+
+void test_predictive_switches_ahead_of_coast()
+{
+    // Нагрев: 20.7 + 2 °C/ч * 10 мин = 21.03 - выключение до целевой
+    HeatingControllerState state = learnedState();
+    TEST_ASSERT_FALSE(heatingControllerDecide(CONTROLLER_PREDICTIVE, input(20.7f, 21, 1, true, 0), state));
+    state = learnedState();
+    TEST_ASSERT_TRUE(heatingControllerDecide(CONTROLLER_PREDICTIVE, input(20.5f, 21, 1, true, 0), state));
+
+    // Остывание: 20.1 - 1.2 °C/ч * 10 мин = 19.9 - ниже target - гистерезис, включение раньше гистерезиса
+    state = learnedState();
+    TEST_ASSERT_TRUE(heatingControllerDecide(CONTROLLER_PREDICTIVE, input(20.1f, 21, 1, false, 0), state));
+    HeatingControllerState hysteresis = {};
+    TEST_ASSERT_FALSE(heatingControllerDecide(CONTROLLER_HYSTERESIS, input(20.1f, 21, 1, false, 0), hysteresis));
+}
+
+void test_observe_learns_lag_and_rates()
+{
+    HeatingControllerState state = {};
+    // Обогрев включен в 60 с, температура по инерции падает до минимума в 180 с, затем растет
+    heatingControllerObserve(input(20.0f, 21, 1, false, 0), state);
+    heatingControllerObserve(input(19.9f, 21, 1, true, 60000), state);
+    heatingControllerObserve(input(19.8f, 21, 1, true, 120000), state);
+    heatingControllerObserve(input(19.7f, 21, 1, true, 180000), state);
+    heatingControllerObserve(input(19.75f, 21, 1, true, 240000), state);
+    TEST_ASSERT_TRUE(state.lagTracking);
+    heatingControllerObserve(input(19.85f, 21, 1, true, 300000), state);
+    TEST_ASSERT_FALSE(state.lagTracking);
+    TEST_ASSERT_EQUAL_UINT8(1, state.lagSamples);
+    TEST_ASSERT_EQUAL_FLOAT(120000.0f, state.lag);
+
+    // Скорость нагрева - по точкам после экстремума, не чаще PREDICT_RATE_INTERVAL
+    heatingControllerObserve(input(20.0f, 21, 1, true, 300000 + PREDICT_RATE_INTERVAL - 1), state);
+    TEST_ASSERT_EQUAL_UINT8(0, state.heatSamples);
+    heatingControllerObserve(input(20.15f, 21, 1, true, 300000 + PREDICT_RATE_INTERVAL), state);
+    TEST_ASSERT_EQUAL_UINT8(1, state.heatSamples);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.8f, state.heatRate); // 0.3 °C за 10 мин
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_controller_names);
+    RUN_TEST(test_hysteresis);
+    RUN_TEST(test_pid_duty_limits);
+    RUN_TEST(test_pid_rate_from_own_samples);
+    RUN_TEST(test_pid_derivative_reduces_duty);
+    RUN_TEST(test_type_switch_resets_pid_keeps_model);
+    RUN_TEST(test_predictive_falls_back_to_hysteresis);
+    RUN_TEST(test_predictive_switches_ahead_of_coast);
+    RUN_TEST(test_observe_learns_lag_and_rates);
+    return UNITY_END();
+}
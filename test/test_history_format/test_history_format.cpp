@@ -0,0 +1,214 @@
+// Форматы выгрузки истории: обратимость /history.bin и размер суток показаний в сравнении с /history (JSON)
+#include <unity.h>
+#include <history_format.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define DAY_SLOTS 1440            // Сутки минутного уровня истории
+#define SLOT_INTERVAL 60
+#define UPTIME_START (3 * 86400u) // Выгрузка через трое суток после загрузки
+#define DEVICE_COUNT 10
+#define SIZE_RATIO_TARGET 10.0    // Цель: двоичная выгрузка в 10 раз меньше JSON
+
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return randomState >> 8;
+}
+
+// Сутки минутных средних одного датчика: суточный ход температуры, циклы обогрева по гистерезису,
+// шум усреднения нескольких показаний за минуту и около 1% минут без рекламных пакетов
+static std::vector<HistoryPoint> sensorDay(uint32_t from)
+{
+    std::vector<HistoryPoint> points;
+    double base = 20.0 + (nextRandom() % 300) / 100.0;
+    double heating = 0.0;
+    bool heatingOn = false;
+    double humidity = 40.0 + (nextRandom() % 1500) / 100.0;
+    for (uint32_t slot = 0; slot < DAY_SLOTS; slot++)
+    {
+        heating += heatingOn ? 0.03 : -0.02;
+        heatingOn = heating < -0.3 ? true : heating > 0.3 ? false : heatingOn;
+        humidity += ((int)(nextRandom() % 7) - 3) * 0.01;
+        if (nextRandom() % 100 == 0)
+        {
+            continue;
+        }
+        double temperature = base + 1.5 * sin(2 * M_PI * slot / DAY_SLOTS) + heating + ((int)(nextRandom() % 5) - 2) * 0.01;
+        double measured = humidity + ((int)(nextRandom() % 11) - 5) * 0.01;
+        points.push_back({from + slot * SLOT_INTERVAL, {(int16_t)lround(temperature * 100), (int16_t)lround(measured * 100)}});
+    }
+    return points;
+}
+
+static uint64_t deviceMac(size_t index)
+{
+    return 0xA4C138000000ull + index;
+}
+
+// Поток отсчетов одного устройства, как его выдает HistoryBinaryStream
+static void appendEncoded(const std::vector<HistoryPoint> &points, std::vector<uint8_t> &out)
+{
+    SampleEncoder encoder;
+    uint8_t buffer[SAMPLE_CODEC_BUFFER];
+    for (const auto &point : points)
+    {
+        while (!encoder.append(historyCodecSample(point)))
+        {
+            size_t n = encoder.read(buffer, sizeof(buffer));
+            out.insert(out.end(), buffer, buffer + n);
+        }
+    }
+    while (!encoder.finish())
+    {
+        size_t n = encoder.read(buffer, sizeof(buffer));
+        out.insert(out.end(), buffer, buffer + n);
+    }
+    while (encoder.available() > 0)
+    {
+        size_t n = encoder.read(buffer, sizeof(buffer));
+        out.insert(out.end(), buffer, buffer + n);
+    }
+}
+
+// Ответ /history.bin по всем устройствам
+static std::vector<uint8_t> binaryResponse(const std::vector<std::vector<HistoryPoint>> &days, uint32_t from, uint32_t to)
+{
+    std::vector<uint8_t> out(HISTORY_BINARY_HEADER_SIZE);
+    formatHistoryBinaryHeader(0, SLOT_INTERVAL, to, from, to, (uint16_t)days.size(), out.data());
+    for (size_t i = 0; i < days.size(); i++)
+    {
+        uint8_t device[HISTORY_BINARY_DEVICE_SIZE];
+        formatHistoryBinaryDevice(deviceMac(i), !days[i].empty(), device);
+        out.insert(out.end(), device, device + sizeof(device));
+        if (!days[i].empty())
+        {
+            appendEncoded(days[i], out);
+        }
+    }
+    return out;
+}
+
+// Размер ответа /history одного устройства
+static size_t jsonResponseSize(uint64_t mac, const std::vector<HistoryPoint> &points, uint32_t from, uint32_t to)
+{
+    char record[HISTORY_JSON_RECORD_MAX];
+    size_t total = formatHistoryJsonOpen(mac, SLOT_INTERVAL, to, from, to, record, sizeof(record));
+    TEST_ASSERT_TRUE(total > 0);
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        size_t length = formatHistoryJsonPoint(points[i], i == 0, record, sizeof(record));
+        TEST_ASSERT_TRUE(length > 0);
+        total += length;
+    }
+    return total + strlen(HISTORY_JSON_CLOSE);
+}
+
+static uint32_t readLe32(const uint8_t *in)
+{
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Разбор ответа /history.bin возвращает те же точки, что отдал бы /history
+void test_binary_round_trip()
+{
+    uint32_t from = UPTIME_START;
+    uint32_t to = from + DAY_SLOTS * SLOT_INTERVAL;
+    std::vector<std::vector<HistoryPoint>> days = {sensorDay(from), {}, sensorDay(from)};
+    std::vector<uint8_t> response = binaryResponse(days, from, to);
+
+    TEST_ASSERT_EQUAL_MEMORY("HIST", response.data(), 4);
+    TEST_ASSERT_EQUAL_UINT8(HISTORY_BINARY_VERSION, response[4]);
+    TEST_ASSERT_EQUAL_UINT32(from, readLe32(response.data() + 12));
+    TEST_ASSERT_EQUAL_UINT32(to, readLe32(response.data() + 16));
+    TEST_ASSERT_EQUAL_UINT8(days.size(), response[20]);
+
+    size_t offset = HISTORY_BINARY_HEADER_SIZE;
+    for (size_t i = 0; i < days.size(); i++)
+    {
+        uint8_t mac[HISTORY_BINARY_DEVICE_SIZE];
+        formatHistoryBinaryDevice(deviceMac(i), !days[i].empty(), mac);
+        TEST_ASSERT_EQUAL_MEMORY(mac, response.data() + offset, sizeof(mac));
+        offset += HISTORY_BINARY_DEVICE_SIZE;
+        if (days[i].empty())
+        {
+            continue;
+        }
+        SampleDecoder decoder(response.data() + offset, response.size() - offset);
+        CodecSample sample;
+        size_t count = 0;
+        while (decoder.next(sample))
+        {
+            TEST_ASSERT_TRUE(count < days[i].size());
+            TEST_ASSERT_EQUAL_UINT32(days[i][count].time, sample.time);
+            TEST_ASSERT_EQUAL_INT16(days[i][count].sample.temperature, sample.temperature);
+            TEST_ASSERT_EQUAL_INT16(days[i][count].sample.humidity, sample.humidity);
+            count++;
+        }
+        TEST_ASSERT_FALSE(decoder.error());
+        TEST_ASSERT_EQUAL(days[i].size(), count);
+        offset += decoder.bytesRead();
+    }
+    TEST_ASSERT_EQUAL(response.size(), offset);
+}
+
+// Фрагменты JSON: формат точки и отказ при нехватке буфера
+void test_json_fragments()
+{
+    char record[HISTORY_JSON_RECORD_MAX];
+    HistoryPoint point = {259260, {2153, -5}};
+    TEST_ASSERT_EQUAL(20, formatHistoryJsonPoint(point, true, record, sizeof(record)));
+    TEST_ASSERT_EQUAL_STRING("[259260,21.53,-0.05]", record);
+    TEST_ASSERT_EQUAL(21, formatHistoryJsonPoint(point, false, record, sizeof(record)));
+    TEST_ASSERT_EQUAL_STRING(",[259260,21.53,-0.05]", record);
+    TEST_ASSERT_EQUAL(0, formatHistoryJsonPoint(point, false, record, 21));
+
+    size_t length = formatHistoryJsonOpen(0xA4C138010203ull, 60, 300, 0, 300, record, sizeof(record));
+    TEST_ASSERT_EQUAL(strlen(record), length);
+    TEST_ASSERT_EQUAL_STRING("{\"mac\":\"a4:c1:38:01:02:03\",\"res\":60,\"now\":300,\"from\":0,\"to\":300,\"points\":[", record);
+}
+
+// Сутки минутной истории: /history.bin по всем устройствам против запросов /history по каждому
+void test_day_download_size()
+{
+    uint32_t from = UPTIME_START;
+    uint32_t to = from + DAY_SLOTS * SLOT_INTERVAL;
+    std::vector<std::vector<HistoryPoint>> days;
+    size_t points = 0;
+    size_t jsonSize = 0;
+    for (size_t i = 0; i < DEVICE_COUNT; i++)
+    {
+        days.push_back(sensorDay(from));
+        points += days.back().size();
+        jsonSize += jsonResponseSize(deviceMac(i), days.back(), from, to);
+    }
+    size_t singleJson = jsonResponseSize(deviceMac(0), days[0], from, to);
+    size_t singleBinary = binaryResponse({days[0]}, from, to).size();
+    size_t binarySize = binaryResponse(days, from, to).size();
+
+    char message[200];
+    snprintf(message, sizeof(message), "1 device, %zu points: JSON %zu B, binary %zu B (%.2f B/point), ratio %.1fx",
+             days[0].size(), singleJson, singleBinary, (double)singleBinary / days[0].size(), (double)singleJson / singleBinary);
+    TEST_MESSAGE(message);
+    snprintf(message, sizeof(message), "%d devices, %zu points: JSON %zu B, binary %zu B (%.2f B/point), ratio %.1fx",
+             DEVICE_COUNT, points, jsonSize, binarySize, (double)binarySize / points, (double)jsonSize / binarySize);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE((double)singleJson / singleBinary >= SIZE_RATIO_TARGET);
+    TEST_ASSERT_TRUE((double)jsonSize / binarySize >= SIZE_RATIO_TARGET);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_binary_round_trip);
+    RUN_TEST(test_json_fragments);
+    RUN_TEST(test_day_download_size);
+    return UNITY_END();
+}
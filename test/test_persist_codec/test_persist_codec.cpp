@@ -0,0 +1,344 @@
+// Двоичные blob'ы NVS: обратимость, отказ на поврежденных данных, размер и скорость полного реестра
+#include <unity.h>
+#include <persist_codec.h>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+#define BENCHMARK_ROUNDS 1000
+
+static DeviceData makeDevice(int i)
+{
+    DeviceData device("Комната " + std::to_string(i), 0xA4C138000000ULL + i * 0x010203ULL);
+    device.enabled = i % 2 == 0;
+    device.controllerType = i % CONTROLLER_TYPE_COUNT;
+    device.targetTemperature = 18.5f + i * 0.25f;
+    device.totalHeatingTime = 3600000UL * i + 123;
+    device.humidity = 40.0f + i;
+    device.battery = (uint8_t)(100 - i);
+    device.batteryV = (uint16_t)(3000 - i);
+    for (int pin = 0; pin < i % 4; pin++)
+    {
+        device.gpioPins.push_back((uint8_t)(pin * 10 + i % 10));
+    }
+    // Показания, которые в blob не пишутся
+    device.updateSensorData(22.5f, device.humidity, device.battery, device.batteryV, 1000);
+    return device;
+}
+
+static void assertSameDevice(const DeviceData &expected, const DeviceData &actual)
+{
+    TEST_ASSERT_EQUAL_HEX64(expected.mac, actual.mac);
+    TEST_ASSERT_EQUAL_STRING(expected.macAddress.c_str(), actual.macAddress.c_str());
+    TEST_ASSERT_EQUAL_STRING(expected.name.c_str(), actual.name.c_str());
+    TEST_ASSERT_EQUAL(expected.enabled, actual.enabled);
+    TEST_ASSERT_EQUAL_UINT8(expected.controllerType, actual.controllerType);
+    TEST_ASSERT_EQUAL_FLOAT(expected.targetTemperature, actual.targetTemperature);
+    TEST_ASSERT_EQUAL_UINT32(expected.totalHeatingTime, actual.totalHeatingTime);
+    TEST_ASSERT_EQUAL_FLOAT(expected.humidity, actual.humidity);
+    TEST_ASSERT_EQUAL_UINT8(expected.battery, actual.battery);
+    TEST_ASSERT_EQUAL_UINT16(expected.batteryV, actual.batteryV);
+    TEST_ASSERT_EQUAL(expected.gpioPins.size(), actual.gpioPins.size());
+    for (size_t i = 0; i < expected.gpioPins.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(expected.gpioPins[i], actual.gpioPins[i]);
+    }
+    // Загруженное устройство оффлайн до первого пакета, температура - целевая
+    TEST_ASSERT_FALSE(actual.isOnline);
+    TEST_ASSERT_FALSE(actual.isDataValid(1000));
+    TEST_ASSERT_EQUAL_FLOAT(actual.targetTemperature, actual.currentTemperature);
+}
+
+// Перевод blob'а в формат v1, как его записывала прежняя прошивка: CRC только данных
+static void toVersion1(std::vector<uint8_t> &blob)
+{
+    blob[3] = PERSIST_VERSION_V1;
+    uint32_t crc = persistCrc32(blob.data() + PERSIST_HEADER_SIZE, blob.size() - PERSIST_HEADER_SIZE);
+    for (int i = 0; i < 4; i++)
+    {
+        blob[8 + i] = (uint8_t)(crc >> (8 * i));
+    }
+}
+
+static void fillRegistry(DeviceRegistry &registry, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        TEST_ASSERT_NOT_NULL(registry.add(makeDevice(i)));
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_crc32_reference()
+{
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, persistCrc32((const uint8_t *)"123456789", 9));
+    // Продолжение по частям дает тот же результат
+    uint32_t crc = persistCrc32((const uint8_t *)"1234", 4);
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, persistCrc32((const uint8_t *)"56789", 5, crc));
+}
+
+void test_devices_round_trip()
+{
+    DeviceRegistry registry;
+    fillRegistry(registry, 12);
+    std::vector<uint8_t> blob;
+    encodeDevicesBlob(registry, blob);
+    TEST_ASSERT_TRUE(isPersistBlob(blob.data(), blob.size(), PERSIST_KIND_DEVICES));
+    TEST_ASSERT_FALSE(isPersistBlob(blob.data(), blob.size(), PERSIST_KIND_GPIO));
+
+    std::vector<DeviceData> decoded;
+    TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL(registry.size(), decoded.size());
+    for (size_t i = 0; i < decoded.size(); i++)
+    {
+        assertSameDevice(registry[i], decoded[i]);
+    }
+}
+
+void test_single_device_and_index()
+{
+    DeviceRegistry registry;
+    fillRegistry(registry, 5);
+    std::vector<uint8_t> blob;
+    encodeDeviceBlob(registry[3], blob);
+    std::vector<DeviceData> decoded;
+    TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL(1, decoded.size());
+    assertSameDevice(registry[3], decoded[0]);
+
+    encodeDeviceIndexBlob(registry, blob);
+    std::vector<uint64_t> macs;
+    TEST_ASSERT_TRUE(decodeDeviceIndexBlob(blob.data(), blob.size(), macs));
+    TEST_ASSERT_EQUAL(registry.size(), macs.size());
+    for (size_t i = 0; i < macs.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_HEX64(registry[i].mac, macs[i]);
+    }
+    // Индекс не читается как список устройств
+    TEST_ASSERT_FALSE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+}
+
+void test_gpio_round_trip()
+{
+    std::vector<GpioPin> gpios = {GpioPin(4, STATE_GPIO_AUTO, "Реле 1"), GpioPin(5, STATE_GPIO_ON, ""),
+                                  GpioPin(40, STATE_GPIO_OFF, "Насос")};
+    gpios[0].totalHeatingTime = 86400000UL;
+    gpios[2].outputActive = true;
+    std::vector<uint8_t> blob;
+    encodeGpioBlob(gpios, blob);
+
+    std::vector<GpioPin> decoded;
+    TEST_ASSERT_TRUE(decodeGpioBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL(gpios.size(), decoded.size());
+    for (size_t i = 0; i < gpios.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(gpios[i].pin, decoded[i].pin);
+        TEST_ASSERT_EQUAL_UINT8(gpios[i].state, decoded[i].state);
+        TEST_ASSERT_EQUAL_UINT32(gpios[i].totalHeatingTime, decoded[i].totalHeatingTime);
+        TEST_ASSERT_EQUAL_STRING(gpios[i].name.c_str(), decoded[i].name.c_str());
+        // Уровень выхода не сохраняется: после загрузки его выставит задача управления
+        TEST_ASSERT_FALSE(decoded[i].outputActive);
+    }
+}
+
+void test_empty_lists()
+{
+    DeviceRegistry registry;
+    std::vector<uint8_t> blob;
+    encodeDevicesBlob(registry, blob);
+    TEST_ASSERT_EQUAL(PERSIST_HEADER_SIZE, blob.size());
+    std::vector<DeviceData> decoded(3);
+    TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL(0, decoded.size());
+}
+
+void test_corrupted_blobs_rejected()
+{
+    DeviceRegistry registry;
+    fillRegistry(registry, 4);
+    std::vector<uint8_t> blob;
+    encodeDevicesBlob(registry, blob);
+    std::vector<DeviceData> decoded;
+
+    // Каждый байт данных защищен CRC
+    for (size_t i = PERSIST_HEADER_SIZE; i < blob.size(); i++)
+    {
+        std::vector<uint8_t> corrupted = blob;
+        corrupted[i] ^= 0x10;
+        TEST_ASSERT_FALSE(decodeDevicesBlob(corrupted.data(), corrupted.size(), decoded));
+    }
+    // Неизвестная версия, чужая сигнатура, несовпадение длины
+    std::vector<uint8_t> versioned = blob;
+    versioned[3] = PERSIST_VERSION + 1;
+    TEST_ASSERT_FALSE(decodeDevicesBlob(versioned.data(), versioned.size(), decoded));
+    std::vector<uint8_t> magic = blob;
+    magic[0] = '{';
+    TEST_ASSERT_FALSE(decodeDevicesBlob(magic.data(), magic.size(), decoded));
+    std::vector<uint8_t> longer = blob;
+    longer.push_back(0);
+    TEST_ASSERT_FALSE(decodeDevicesBlob(longer.data(), longer.size(), decoded));
+    // Обрезанный blob, в том числе внутри заголовка
+    for (size_t length = 0; length < blob.size(); length += 7)
+    {
+        TEST_ASSERT_FALSE(decodeDevicesBlob(blob.data(), length, decoded));
+    }
+    // Поля заголовка входят в CRC
+    for (size_t i = 4; i < 8; i++)
+    {
+        std::vector<uint8_t> header = blob;
+        header[i] ^= 0x01;
+        TEST_ASSERT_FALSE(decodeDevicesBlob(header.data(), header.size(), decoded));
+    }
+}
+
+void test_version1_blobs_still_read()
+{
+    DeviceRegistry registry;
+    fillRegistry(registry, 6);
+    std::vector<uint8_t> blob;
+    encodeDevicesBlob(registry, blob);
+    toVersion1(blob);
+    std::vector<DeviceData> decoded;
+    TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL(registry.size(), decoded.size());
+    assertSameDevice(registry[5], decoded[5]);
+
+    std::vector<GpioPin> gpios = {GpioPin(4, STATE_GPIO_AUTO, "Реле 1")};
+    encodeGpioBlob(gpios, blob);
+    toVersion1(blob);
+    std::vector<GpioPin> decodedGpios;
+    TEST_ASSERT_TRUE(decodeGpioBlob(blob.data(), blob.size(), decodedGpios));
+    TEST_ASSERT_EQUAL(1, decodedGpios.size());
+}
+
+// В v1 число записей не защищено CRC: искаженное значение не должно приводить к выделению памяти под него
+void test_version1_count_checked_against_length()
+{
+    DeviceRegistry registry;
+    fillRegistry(registry, 3);
+    std::vector<uint8_t> blob;
+    std::vector<DeviceData> decoded;
+    std::vector<uint64_t> macs;
+    std::vector<GpioPin> gpios;
+
+    encodeDevicesBlob(registry, blob);
+    toVersion1(blob);
+    blob[4] = 0xFF;
+    blob[5] = 0xFF;
+    TEST_ASSERT_FALSE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL(0, decoded.capacity());
+
+    encodeDeviceIndexBlob(registry, blob);
+    toVersion1(blob);
+    blob[4] = 4;
+    TEST_ASSERT_FALSE(decodeDeviceIndexBlob(blob.data(), blob.size(), macs));
+    TEST_ASSERT_EQUAL(0, macs.capacity());
+
+    encodeGpioBlob({GpioPin(4, STATE_GPIO_AUTO, "")}, blob);
+    toVersion1(blob);
+    blob[4] = 2;
+    TEST_ASSERT_FALSE(decodeGpioBlob(blob.data(), blob.size(), gpios));
+    TEST_ASSERT_EQUAL(0, gpios.capacity());
+}
+
+void test_controller_type_bits()
+{
+    DeviceData device = makeDevice(1);
+    std::vector<uint8_t> blob;
+    std::vector<DeviceData> decoded;
+    for (uint8_t type = 0; type < CONTROLLER_TYPE_COUNT; type++)
+    {
+        for (int enabled = 0; enabled < 2; enabled++)
+        {
+            device.controllerType = type;
+            device.enabled = enabled != 0;
+            encodeDeviceBlob(device, blob);
+            TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+            TEST_ASSERT_EQUAL_UINT8(type, decoded[0].controllerType);
+            TEST_ASSERT_EQUAL(enabled != 0, decoded[0].enabled);
+        }
+    }
+    // Неизвестный алгоритм в битах 1-2 читается как гистерезис
+    device.controllerType = 3;
+    encodeDeviceBlob(device, blob);
+    TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL_UINT8(CONTROLLER_HYSTERESIS, decoded[0].controllerType);
+}
+
+void test_long_name_truncated()
+{
+    DeviceData device = makeDevice(2);
+    device.name = std::string(300, 'x');
+    std::vector<uint8_t> blob;
+    encodeDeviceBlob(device, blob);
+    std::vector<DeviceData> decoded;
+    TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL(DEVICE_NAME_MAX, decoded[0].name.size());
+
+    // Двухбайтовые символы не разрезаются
+    device.name.clear();
+    for (int i = 0; i < 200; i++)
+    {
+        device.name += "ж";
+    }
+    encodeDeviceBlob(device, blob);
+    TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    TEST_ASSERT_EQUAL(DEVICE_NAME_MAX - 1, decoded[0].name.size());
+    TEST_ASSERT_EQUAL_STRING(device.name.substr(0, DEVICE_NAME_MAX - 1).c_str(), decoded[0].name.c_str());
+}
+
+// Полный реестр: размер blob'а и время кодирования/декодирования
+void test_full_registry_benchmark()
+{
+    DeviceRegistry registry;
+    fillRegistry(registry, DEVICE_REGISTRY_CAPACITY);
+    std::vector<uint8_t> blob;
+    std::vector<DeviceData> decoded;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++)
+    {
+        encodeDevicesBlob(registry, blob);
+    }
+    auto encodedAt = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++)
+    {
+        TEST_ASSERT_TRUE(decodeDevicesBlob(blob.data(), blob.size(), decoded));
+    }
+    auto decodedAt = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL(DEVICE_REGISTRY_CAPACITY, decoded.size());
+
+    double encodeUs = std::chrono::duration<double, std::micro>(encodedAt - start).count() / BENCHMARK_ROUNDS;
+    double decodeUs = std::chrono::duration<double, std::micro>(decodedAt - encodedAt).count() / BENCHMARK_ROUNDS;
+    char message[160];
+    snprintf(message, sizeof(message), "%d devices: %u bytes (%.1f per device), encode %.1f us, decode %.1f us",
+             DEVICE_REGISTRY_CAPACITY, (unsigned)blob.size(), (double)(blob.size() - PERSIST_HEADER_SIZE) / DEVICE_REGISTRY_CAPACITY,
+             encodeUs, decodeUs);
+    TEST_MESSAGE(message);
+    // Blob устройств должен помещаться в одну запись NVS (до 4000 байт на страницу)
+    TEST_ASSERT_LESS_THAN(4000, blob.size());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_crc32_reference);
+    RUN_TEST(test_devices_round_trip);
+    RUN_TEST(test_single_device_and_index);
+    RUN_TEST(test_gpio_round_trip);
+    RUN_TEST(test_empty_lists);
+    RUN_TEST(test_corrupted_blobs_rejected);
+    RUN_TEST(test_version1_blobs_still_read);
+    RUN_TEST(test_version1_count_checked_against_length);
+    RUN_TEST(test_controller_type_bits);
+    RUN_TEST(test_long_name_truncated);
+    RUN_TEST(test_full_registry_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,171 @@
+// Ступень выходов реле с заглушкой драйвера: какие маски уходят в configure и write
+#include <unity.h>
+#include <relay_output.h>
+#include <vector>
+
+// Заглушка драйвера: запоминает вызовы и ведет уровни пинов
+class MockOutputDriver : public RelayOutputDriver
+{
+public:
+    struct Write
+    {
+        uint64_t setMask;
+        uint64_t clearMask;
+    };
+
+    void configure(uint64_t pins) override
+    {
+        configureCalls.push_back(pins);
+        outputPins |= pins;
+        levels &= ~pins;
+    }
+
+    void write(uint64_t setMask, uint64_t clearMask) override
+    {
+        writes.push_back({setMask, clearMask});
+        levels = (levels | setMask) & ~clearMask;
+    }
+
+    std::vector<uint64_t> configureCalls;
+    std::vector<Write> writes;
+    uint64_t outputPins = 0;
+    uint64_t levels = 0;
+};
+
+static const uint64_t PIN_4 = 1ULL << 4;
+static const uint64_t PIN_5 = 1ULL << 5;
+static const uint64_t PIN_12 = 1ULL << 12;
+static const uint64_t PIN_40 = 1ULL << 40; // Второй банк регистров
+
+static MockOutputDriver *driver;
+static RelayOutputStage *stage;
+
+void setUp()
+{
+    driver = new MockOutputDriver();
+    stage = new RelayOutputStage();
+}
+
+void tearDown()
+{
+    delete stage;
+    delete driver;
+}
+
+void test_configure_sets_output_mode_low()
+{
+    stage->configure(*driver, PIN_4 | PIN_40);
+    TEST_ASSERT_EQUAL(1, driver->configureCalls.size());
+    TEST_ASSERT_EQUAL_HEX64(PIN_4 | PIN_40, driver->configureCalls[0]);
+    TEST_ASSERT_EQUAL(0, driver->writes.size());
+    TEST_ASSERT_EQUAL_HEX64(0, stage->outputs());
+}
+
+void test_only_changed_pins_written()
+{
+    uint64_t configured = PIN_4 | PIN_5 | PIN_40;
+    stage->configure(*driver, configured);
+
+    stage->apply(*driver, PIN_4 | PIN_40, configured, configured, 0, 1000);
+    TEST_ASSERT_EQUAL(1, driver->writes.size());
+    TEST_ASSERT_EQUAL_HEX64(PIN_4 | PIN_40, driver->writes[0].setMask);
+    TEST_ASSERT_EQUAL_HEX64(0, driver->writes[0].clearMask);
+
+    // Тот же спрос - драйвер не вызывается
+    stage->apply(*driver, PIN_4 | PIN_40, configured, configured, 0, 5000);
+    TEST_ASSERT_EQUAL(1, driver->writes.size());
+
+    // Снятие спроса после минимального времени работы: только сброс этих пинов
+    stage->apply(*driver, PIN_4, configured, configured, 0, 1000 + RELAY_MIN_ON_TIME);
+    TEST_ASSERT_EQUAL(2, driver->writes.size());
+    TEST_ASSERT_EQUAL_HEX64(0, driver->writes[1].setMask);
+    TEST_ASSERT_EQUAL_HEX64(PIN_40, driver->writes[1].clearMask);
+    TEST_ASSERT_EQUAL_HEX64(PIN_4, driver->levels);
+    TEST_ASSERT_EQUAL_HEX64(PIN_4, stage->outputs());
+}
+
+void test_manual_modes_override_demand()
+{
+    uint64_t configured = PIN_4 | PIN_5 | PIN_12;
+    stage->configure(*driver, configured);
+
+    // PIN_4 - авто со спросом, PIN_5 - включен вручную без спроса, PIN_12 - выключен вручную при спросе
+    uint64_t levels = stage->apply(*driver, PIN_4 | PIN_12, configured, PIN_4, PIN_5, 1000);
+    TEST_ASSERT_EQUAL_HEX64(PIN_4 | PIN_5, levels);
+    TEST_ASSERT_EQUAL_HEX64(PIN_4 | PIN_5, driver->levels);
+    TEST_ASSERT_EQUAL(1, driver->writes.size());
+    TEST_ASSERT_EQUAL_HEX64(0, driver->writes[0].clearMask);
+}
+
+void test_min_on_time_delays_clear()
+{
+    uint64_t configured = PIN_4;
+    stage->configure(*driver, configured);
+    stage->apply(*driver, PIN_4, configured, configured, 0, 1000);
+    TEST_ASSERT_EQUAL(1, driver->writes.size());
+
+    stage->apply(*driver, 0, configured, configured, 0, 2000);
+    TEST_ASSERT_EQUAL(1, driver->writes.size());
+    TEST_ASSERT_EQUAL_UINT32(RELAY_MIN_ON_TIME - 1000, stage->scheduler().nextChangeIn());
+
+    stage->apply(*driver, 0, configured, configured, 0, 1000 + RELAY_MIN_ON_TIME);
+    TEST_ASSERT_EQUAL(2, driver->writes.size());
+    TEST_ASSERT_EQUAL_HEX64(PIN_4, driver->writes[1].clearMask);
+    TEST_ASSERT_EQUAL_HEX64(0, driver->levels);
+}
+
+void test_starts_staggered_across_writes()
+{
+    uint64_t configured = PIN_4 | PIN_5 | PIN_12 | PIN_40;
+    stage->configure(*driver, configured);
+
+    stage->apply(*driver, configured, configured, configured, 0, 1000);
+    TEST_ASSERT_EQUAL(1, driver->writes.size());
+    TEST_ASSERT_EQUAL(RELAY_MAX_STARTS, __builtin_popcountll(driver->writes[0].setMask));
+
+    stage->apply(*driver, configured, configured, configured, 0, 1000 + RELAY_STAGGER_DELAY);
+    TEST_ASSERT_EQUAL(2, driver->writes.size());
+    TEST_ASSERT_EQUAL_HEX64(0, driver->writes[0].setMask & driver->writes[1].setMask);
+    TEST_ASSERT_EQUAL_HEX64(configured, driver->levels);
+}
+
+void test_new_pins_configured_before_write()
+{
+    stage->configure(*driver, PIN_4);
+    stage->apply(*driver, PIN_4 | PIN_12, PIN_4 | PIN_12, PIN_4 | PIN_12, 0, 1000);
+
+    // Добавленный в настройки пин настраивается один раз, уже настроенный - нет
+    TEST_ASSERT_EQUAL(2, driver->configureCalls.size());
+    TEST_ASSERT_EQUAL_HEX64(PIN_12, driver->configureCalls[1]);
+    TEST_ASSERT_EQUAL_HEX64(PIN_4 | PIN_12, driver->writes[0].setMask);
+
+    stage->apply(*driver, PIN_4 | PIN_12, PIN_4 | PIN_12, PIN_4 | PIN_12, 0, 2000);
+    TEST_ASSERT_EQUAL(2, driver->configureCalls.size());
+}
+
+void test_unconfigured_pins_never_written()
+{
+    uint64_t configured = PIN_4 | PIN_5;
+    stage->configure(*driver, configured);
+    // Спрос и ручное включение пина, которого нет в настройках
+    stage->apply(*driver, PIN_4 | PIN_12, configured, configured | PIN_12, PIN_40, 1000);
+    stage->apply(*driver, 0, configured, configured, 0, 1000 + RELAY_MIN_ON_TIME);
+    for (const auto &write : driver->writes)
+    {
+        TEST_ASSERT_EQUAL_HEX64(0, (write.setMask | write.clearMask) & ~configured);
+    }
+    TEST_ASSERT_EQUAL_HEX64(configured, driver->outputPins);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_configure_sets_output_mode_low);
+    RUN_TEST(test_only_changed_pins_written);
+    RUN_TEST(test_manual_modes_override_demand);
+    RUN_TEST(test_min_on_time_delays_clear);
+    RUN_TEST(test_starts_staggered_across_writes);
+    RUN_TEST(test_new_pins_configured_before_write);
+    RUN_TEST(test_unconfigured_pins_never_written);
+    return UNITY_END();
+}
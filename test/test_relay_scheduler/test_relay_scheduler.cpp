@@ -0,0 +1,259 @@
+// Планировщик реле: минимальные времена, ступенчатое включение и прогон суток показаний датчиков
+#include <unity.h>
+#include <relay_scheduler.h>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#define ROOM_COUNT 20                 // Комнаты, у каждой свое реле (пины 1..20)
+#define DAY_MS 86400000UL
+#define SENSOR_INTERVAL 10000         // Период показаний датчика (мс)
+#define REPLAY_STEP 1000              // Шаг прогона, как пробуждения задачи управления (мс)
+#define REPLAY_TARGET 2100            // Целевая температура (сотые °C)
+#define REPLAY_HYSTERESIS 20          // Гистерезис (сотые °C)
+
+static const uint64_t ALL_PINS = ~0ULL;
+
+static uint64_t pinBit(int pin)
+{
+    return 1ULL << pin;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_first_start_immediate()
+{
+    RelayScheduler scheduler;
+    TEST_ASSERT_EQUAL_HEX64(pinBit(3), scheduler.apply(pinBit(3), ALL_PINS, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, scheduler.startCount());
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.nextChangeIn());
+}
+
+void test_min_on_time()
+{
+    RelayScheduler scheduler;
+    scheduler.apply(pinBit(3), ALL_PINS, 1000);
+    TEST_ASSERT_EQUAL_HEX64(pinBit(3), scheduler.apply(0, ALL_PINS, 1000 + RELAY_MIN_ON_TIME - 1));
+    TEST_ASSERT_EQUAL_UINT32(1, scheduler.nextChangeIn());
+    TEST_ASSERT_EQUAL_HEX64(0, scheduler.apply(0, ALL_PINS, 1000 + RELAY_MIN_ON_TIME));
+    TEST_ASSERT_EQUAL_UINT32(1, scheduler.stopCount());
+}
+
+void test_min_off_time()
+{
+    RelayScheduler scheduler;
+    scheduler.apply(pinBit(3), ALL_PINS, 0);
+    scheduler.apply(0, ALL_PINS, RELAY_MIN_ON_TIME);
+    unsigned long offAt = RELAY_MIN_ON_TIME;
+    TEST_ASSERT_EQUAL_HEX64(0, scheduler.apply(pinBit(3), ALL_PINS, offAt + 1000));
+    TEST_ASSERT_EQUAL_UINT32(RELAY_MIN_OFF_TIME - 1000, scheduler.nextChangeIn());
+    TEST_ASSERT_EQUAL_HEX64(pinBit(3), scheduler.apply(pinBit(3), ALL_PINS, offAt + RELAY_MIN_OFF_TIME));
+}
+
+void test_staggered_starts()
+{
+    RelayScheduler scheduler;
+    uint64_t desired = pinBit(1) | pinBit(2) | pinBit(3) | pinBit(4) | pinBit(5);
+    uint64_t state = scheduler.apply(desired, ALL_PINS, 0);
+    TEST_ASSERT_EQUAL(RELAY_MAX_STARTS, __builtin_popcountll(state));
+    TEST_ASSERT_EQUAL_UINT32(RELAY_STAGGER_DELAY, scheduler.nextChangeIn());
+
+    // До конца паузы новых включений нет
+    TEST_ASSERT_EQUAL_HEX64(state, scheduler.apply(desired, ALL_PINS, RELAY_STAGGER_DELAY - 1));
+    state = scheduler.apply(desired, ALL_PINS, RELAY_STAGGER_DELAY);
+    TEST_ASSERT_EQUAL(2 * RELAY_MAX_STARTS, __builtin_popcountll(state));
+    state = scheduler.apply(desired, ALL_PINS, 2 * RELAY_STAGGER_DELAY);
+    TEST_ASSERT_EQUAL_HEX64(desired, state);
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.nextChangeIn());
+    TEST_ASSERT_EQUAL_UINT8(RELAY_MAX_STARTS, scheduler.peakStarts());
+}
+
+void test_longest_waiting_first()
+{
+    RelayScheduler scheduler;
+    scheduler.apply(pinBit(1) | pinBit(2), ALL_PINS, 0);
+    // Пин 30 встал в очередь раньше пинов 5 и 6
+    scheduler.apply(pinBit(1) | pinBit(2) | pinBit(30), ALL_PINS, 500);
+    uint64_t state = scheduler.apply(pinBit(1) | pinBit(2) | pinBit(30) | pinBit(5) | pinBit(6), ALL_PINS, 1000);
+    TEST_ASSERT_EQUAL_HEX64(pinBit(1) | pinBit(2), state);
+    state = scheduler.apply(pinBit(1) | pinBit(2) | pinBit(30) | pinBit(5) | pinBit(6), ALL_PINS, RELAY_STAGGER_DELAY);
+    TEST_ASSERT_EQUAL_HEX64(pinBit(1) | pinBit(2) | pinBit(30) | pinBit(5), state);
+}
+
+void test_cancelled_request_leaves_queue()
+{
+    RelayScheduler scheduler;
+    scheduler.apply(pinBit(1) | pinBit(2) | pinBit(3), ALL_PINS, 0);
+    // Спрос пина 3 снят, пока он ждал в очереди
+    uint64_t state = scheduler.apply(pinBit(1) | pinBit(2), ALL_PINS, RELAY_STAGGER_DELAY);
+    TEST_ASSERT_EQUAL_HEX64(pinBit(1) | pinBit(2), state);
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.nextChangeIn());
+    TEST_ASSERT_EQUAL_UINT32(2, scheduler.startCount());
+}
+
+void test_unconfigured_pins_dropped()
+{
+    RelayScheduler scheduler;
+    scheduler.apply(pinBit(1) | pinBit(2), ALL_PINS, 0);
+    // Пин 2 убран из настроек: сразу сброшен, без минимального времени
+    TEST_ASSERT_EQUAL_HEX64(pinBit(1), scheduler.apply(pinBit(1) | pinBit(2), pinBit(1), 1000));
+    TEST_ASSERT_EQUAL_HEX64(0, scheduler.apply(pinBit(7), pinBit(1), 2000) & pinBit(7));
+}
+
+// Прогон суток ++++++++++++++++++++++++++++++++++++++
+// Записанные показания: сотые °C, ROOM_COUNT комнат с периодом SENSOR_INTERVAL.
+// Запись строится детерминированно: модель помещения (нагрев, теплопотери на улицу с суточным
+// ходом температуры, разная теплоизоляция комнат) под гистерезисом без планировщика и шум датчика
+static std::vector<int16_t> recordDay()
+{
+    const int samples = DAY_MS / SENSOR_INTERVAL;
+    std::vector<int16_t> readings(samples * ROOM_COUNT);
+    uint32_t randomState = 12345;
+    float temperature[ROOM_COUNT];
+    bool heating[ROOM_COUNT] = {};
+    for (int room = 0; room < ROOM_COUNT; room++)
+    {
+        temperature[room] = 19.0f + 0.1f * room;
+    }
+    for (int sample = 0; sample < samples; sample++)
+    {
+        float outside = 5.0f + 5.0f * sinf(sample * (float)SENSOR_INTERVAL / DAY_MS * 6.2832f);
+        for (int room = 0; room < ROOM_COUNT; room++)
+        {
+            float loss = 0.0001f * (1 + 0.1f * room) * (temperature[room] - outside);
+            temperature[room] += (heating[room] ? 0.02f : 0.0f) - loss;
+            randomState = randomState * 1103515245u + 12345u;
+            float noise = (((randomState >> 16) & 0x7FFF) / 32767.0f - 0.5f) * 0.4f;
+            int16_t reading = (int16_t)lroundf((temperature[room] + noise) * 100);
+            readings[sample * ROOM_COUNT + room] = reading;
+            if (!heating[room] && reading + REPLAY_HYSTERESIS < REPLAY_TARGET)
+            {
+                heating[room] = true;
+            }
+            else if (heating[room] && reading >= REPLAY_TARGET)
+            {
+                heating[room] = false;
+            }
+        }
+    }
+    return readings;
+}
+
+struct ReplayResult
+{
+    uint32_t switches;
+    uint32_t peakStarts;
+    unsigned long shortestOn;
+    unsigned long shortestOff;
+    uint64_t demandMs; // Сумма по комнатам: время со спросом
+    uint64_t servedMs; // Из него - время с включенным реле
+};
+
+// Решение гистерезиса по записанным показаниям, выходы - напрямую или через планировщик
+static ReplayResult replayDay(const std::vector<int16_t> &readings, bool useScheduler)
+{
+    ReplayResult result = {0, 0, DAY_MS, DAY_MS, 0, 0};
+    RelayScheduler scheduler;
+    const uint64_t configured = ((1ULL << ROOM_COUNT) - 1) << 1;
+    uint64_t demand = 0;
+    uint64_t outputs = 0;
+    unsigned long lastChange[ROOM_COUNT + 1] = {};
+    bool changed[ROOM_COUNT + 1] = {};
+
+    for (unsigned long now = 0; now < DAY_MS; now += REPLAY_STEP)
+    {
+        if (now % SENSOR_INTERVAL == 0)
+        {
+            const int16_t *sample = &readings[now / SENSOR_INTERVAL * ROOM_COUNT];
+            for (int room = 0; room < ROOM_COUNT; room++)
+            {
+                uint64_t bit = pinBit(room + 1);
+                if (!(demand & bit) && sample[room] + REPLAY_HYSTERESIS < REPLAY_TARGET)
+                {
+                    demand |= bit;
+                }
+                else if ((demand & bit) && sample[room] >= REPLAY_TARGET)
+                {
+                    demand &= ~bit;
+                }
+            }
+        }
+
+        uint64_t next = useScheduler ? scheduler.apply(demand, configured, now) : demand;
+        uint64_t starts = next & ~outputs;
+        uint32_t startCount = __builtin_popcountll(starts);
+        if (startCount > result.peakStarts)
+        {
+            result.peakStarts = startCount;
+        }
+        uint64_t flips = next ^ outputs;
+        result.switches += __builtin_popcountll(flips);
+        while (flips)
+        {
+            int pin = __builtin_ctzll(flips);
+            flips &= flips - 1;
+            if (changed[pin])
+            {
+                unsigned long held = now - lastChange[pin];
+                unsigned long &shortest = (outputs & pinBit(pin)) ? result.shortestOn : result.shortestOff;
+                if (held < shortest)
+                {
+                    shortest = held;
+                }
+            }
+            lastChange[pin] = now;
+            changed[pin] = true;
+        }
+        outputs = next;
+        result.demandMs += (uint64_t)__builtin_popcountll(demand) * REPLAY_STEP;
+        result.servedMs += (uint64_t)__builtin_popcountll(demand & outputs) * REPLAY_STEP;
+    }
+    return result;
+}
+
+static void reportReplay(const char *name, const ReplayResult &result)
+{
+    char message[200];
+    snprintf(message, sizeof(message),
+             "%s: switches %u, peak simultaneous starts %u, shortest on %lu s, shortest off %lu s, demand served %.1f%%",
+             name, (unsigned)result.switches, (unsigned)result.peakStarts, result.shortestOn / 1000,
+             result.shortestOff / 1000, 100.0 * result.servedMs / result.demandMs);
+    TEST_MESSAGE(message);
+}
+
+void test_day_replay()
+{
+    std::vector<int16_t> readings = recordDay();
+    ReplayResult direct = replayDay(readings, false);
+    ReplayResult scheduled = replayDay(readings, true);
+    reportReplay("direct", direct);
+    reportReplay("scheduler", scheduled);
+
+    TEST_ASSERT_LESS_OR_EQUAL(RELAY_MAX_STARTS, scheduled.peakStarts);
+    TEST_ASSERT_GREATER_OR_EQUAL(RELAY_MIN_ON_TIME, scheduled.shortestOn);
+    TEST_ASSERT_GREATER_OR_EQUAL(RELAY_MIN_OFF_TIME, scheduled.shortestOff);
+    TEST_ASSERT_LESS_OR_EQUAL(direct.switches, scheduled.switches);
+    // Прогон детерминирован: без планировщика выходы повторяют запись
+    TEST_ASSERT_GREATER_THAN(RELAY_MAX_STARTS, direct.peakStarts);
+    TEST_ASSERT_EQUAL_UINT64(direct.demandMs, direct.servedMs);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_start_immediate);
+    RUN_TEST(test_min_on_time);
+    RUN_TEST(test_min_off_time);
+    RUN_TEST(test_staggered_starts);
+    RUN_TEST(test_longest_waiting_first);
+    RUN_TEST(test_cancelled_request_leaves_queue);
+    RUN_TEST(test_unconfigured_pins_dropped);
+    RUN_TEST(test_day_replay);
+    return UNITY_END();
+}
@@ -0,0 +1,175 @@
+// Моделирование помещения на неделю: сравнение алгоритмов управления при одном и том же погодном сценарии.
+// Помещение - два тепловых звена (радиатор и воздух), уличная температура с суточным ходом,
+// датчик с шумом и округлением до 0.1 °C раз в минуту, полный обход раз в 30 с, реле через RelayScheduler
+#include <unity.h>
+#include <heating_controller.h>
+#include <relay_scheduler.h>
+#include <math.h>
+#include <stdio.h>
+
+#define SIM_DAYS 7
+#define SIM_STEP 1000            // Шаг модели (мс)
+#define SIM_SENSOR_INTERVAL 60000
+#define SIM_SWEEP_INTERVAL 30000
+#define SIM_TARGET 21.0
+#define SIM_DAY_MS 86400000UL
+
+// Параметры помещения
+#define ROOM_HEATER_POWER 1500.0  // Вт
+#define ROOM_LOSS 30.0            // Теплопотери, Вт/°C
+#define ROOM_CAPACITY 1.5e6       // Теплоемкость воздуха и стен, Дж/°C
+#define HEATER_CAPACITY 40e3      // Теплоемкость радиатора, Дж/°C
+#define HEATER_TRANSFER 50.0      // Теплопередача радиатор - воздух, Вт/°C
+
+struct SimResult
+{
+    double onHours;      // Работа обогрева в сутки (ч)
+    double meanDev;      // Среднее |T - target| (°C)
+    double rmsDev;
+    double belowBand;    // Доля времени ниже target - гистерезис (%)
+    double maxOver;      // Наибольшее превышение target (°C)
+    unsigned startsPerDay;
+};
+
+static uint32_t randomState;
+
+// Приближенно нормальный шум: сумма четырех равномерных, СКО sigma
+static double noise(double sigma)
+{
+    double sum = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        randomState = randomState * 1664525u + 1013904223u;
+        sum += (randomState >> 8) / 16777216.0 - 0.5;
+    }
+    return sum * sigma * sqrt(3.0);
+}
+
+static SimResult simulate(uint8_t type, float hysteresis)
+{
+    randomState = 1;
+    HeatingControllerState state = {};
+    RelayScheduler scheduler;
+    double room = 19;
+    double heater = 19;
+    float reading = 19;
+    bool heating = false;
+    bool relay = false;
+    double onMs = 0, absSum = 0, squareSum = 0, belowMs = 0, maxOver = 0;
+    unsigned long samples = 0, starts = 0;
+    unsigned long nextSensor = 0, nextSweep = 0;
+    const unsigned long end = SIM_DAYS * SIM_DAY_MS;
+
+    for (unsigned long now = 0; now < end; now += SIM_STEP)
+    {
+        double outside = 5 * sin(2 * M_PI * now / SIM_DAY_MS);
+        heater += ((relay ? ROOM_HEATER_POWER : 0) - HEATER_TRANSFER * (heater - room)) / HEATER_CAPACITY;
+        room += (HEATER_TRANSFER * (heater - room) - ROOM_LOSS * (room - outside)) / ROOM_CAPACITY;
+
+        bool event = false;
+        if (now >= nextSensor)
+        {
+            reading = roundf((room + noise(0.03)) * 10) / 10;
+            nextSensor = now + SIM_SENSOR_INTERVAL;
+            event = true;
+        }
+        if (now >= nextSweep)
+        {
+            nextSweep = now + SIM_SWEEP_INTERVAL;
+            event = true;
+        }
+        if (event)
+        {
+            HeatingControllerInput input = {reading, (float)SIM_TARGET, hysteresis, heating, now};
+            heating = heatingControllerDecide(type, input, state);
+        }
+        bool next = scheduler.apply(heating ? 1 : 0, 1, now) & 1;
+        if (next && !relay)
+        {
+            starts++;
+        }
+        relay = next;
+        if (relay)
+        {
+            onMs += SIM_STEP;
+        }
+        // Первые сутки - прогрев и обучение модели, в статистику не входят
+        if (now >= SIM_DAY_MS)
+        {
+            double deviation = room - SIM_TARGET;
+            absSum += fabs(deviation);
+            squareSum += deviation * deviation;
+            samples++;
+            if (room < SIM_TARGET - hysteresis)
+            {
+                belowMs += SIM_STEP;
+            }
+            if (deviation > maxOver)
+            {
+                maxOver = deviation;
+            }
+        }
+    }
+
+    SimResult result;
+    result.onHours = onMs / 3.6e6 / SIM_DAYS;
+    result.meanDev = absSum / samples;
+    result.rmsDev = sqrt(squareSum / samples);
+    result.belowBand = belowMs * 100.0 / (end - SIM_DAY_MS);
+    result.maxOver = maxOver;
+    result.startsPerDay = starts / SIM_DAYS;
+    return result;
+}
+
+static SimResult report(uint8_t type, float hysteresis)
+{
+    SimResult result = simulate(type, hysteresis);
+    char message[200];
+    snprintf(message, sizeof(message),
+             "h=%.1f %-10s on %5.2f h/day, |dev| %.2f, rms %.2f, below band %4.1f%%, max over %+.2f, starts/day %u",
+             hysteresis, heatingControllerName(type), result.onHours, result.meanDev, result.rmsDev, result.belowBand,
+             result.maxOver, result.startsPerDay);
+    TEST_MESSAGE(message);
+    return result;
+}
+
+static void compareControllers(float hysteresis)
+{
+    SimResult hysteresisResult = report(CONTROLLER_HYSTERESIS, hysteresis);
+    SimResult pidResult = report(CONTROLLER_PID, hysteresis);
+    SimResult predictiveResult = report(CONTROLLER_PREDICTIVE, hysteresis);
+
+    // Прогноз выбега сокращает провалы ниже полосы гистерезиса
+    TEST_ASSERT_LESS_THAN(hysteresisResult.belowBand, predictiveResult.belowBand);
+    // ПИД держит температуру у целевой
+    TEST_ASSERT_LESS_THAN(hysteresisResult.meanDev, pidResult.meanDev);
+    TEST_ASSERT_LESS_THAN(0.2, pidResult.meanDev);
+    // Реле не включается чаще, чем позволяет минимальное время работы и паузы
+    TEST_ASSERT_LESS_OR_EQUAL(SIM_DAY_MS / (RELAY_MIN_ON_TIME + RELAY_MIN_OFF_TIME), pidResult.startsPerDay);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_wide_hysteresis()
+{
+    compareControllers(1.5f);
+}
+
+void test_narrow_hysteresis()
+{
+    compareControllers(0.5f);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_wide_hysteresis);
+    RUN_TEST(test_narrow_hysteresis);
+    return UNITY_END();
+}
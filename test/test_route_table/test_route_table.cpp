@@ -0,0 +1,177 @@
+// Поиск маршрута по ключу: правильность и сравнение со списком обработчиков, проверяемых по очереди
+#include <unity.h>
+#include <route_key.h>
+#include <chrono>
+#include <stdio.h>
+
+#define LOOKUP_ROUNDS 200000
+
+// Значения WebRequestMethod из ESPAsyncWebServer
+#define HTTP_GET 0b00000001
+#define HTTP_POST 0b00000010
+#define HTTP_DELETE 0b00000100
+
+struct TestRoute
+{
+    uint8_t method;
+    const char *path;
+};
+
+// Список маршрутов API прошивки (web_server_setting.cpp)
+#define TEST_ROUTES(ROUTE)                                                   \
+    ROUTE(clients, HTTP_GET, "/clients", 0)                                  \
+    ROUTE(availableGpio, HTTP_GET, "/availablegpio", 0)                      \
+    ROUTE(saveAvailableGpio, HTTP_POST, "/availablegpio", 0)                 \
+    ROUTE(serverInfo, HTTP_GET, "/serverinfo", 0)                            \
+    ROUTE(updateClient, HTTP_POST, "/client", 0)                             \
+    ROUTE(deleteClient, HTTP_DELETE, "/client", 0)                           \
+    ROUTE(batchUpdateClients, HTTP_POST, "/clients/batch", 0)                \
+    ROUTE(scan, HTTP_GET, "/scan", 0)                                        \
+    ROUTE(heatingStats, HTTP_GET, "/heating_stats", 0)                       \
+    ROUTE(history, HTTP_GET, "/history", 0)                                  \
+    ROUTE(historyBinary, HTTP_GET, "/history.bin", 0)                        \
+    ROUTE(resetStats, HTTP_POST, "/reset_stats", 0)                          \
+    ROUTE(heatingGpioStats, HTTP_GET, "/heating_gpio_stats", 0)              \
+    ROUTE(resetGpioStats, HTTP_POST, "/reset_gpio_stats", 0)                 \
+    ROUTE(resetWorkTime, HTTP_DELETE, "/reset_work_time", 0)                 \
+    ROUTE(saveHysteresisTemp, HTTP_POST, "/save_hysteresis_temp", 0)         \
+    ROUTE(getHysteresisTemp, HTTP_GET, "/get_hysteresis_temp", 0)
+
+#define TEST_ROUTE_ENTRY(name, method, path, response) {method, path},
+
+enum
+{
+    TEST_ROUTES(ROUTE_INDEX) TEST_ROUTE_COUNT
+};
+
+static const TestRoute testRoutes[TEST_ROUTE_COUNT] = {TEST_ROUTES(TEST_ROUTE_ENTRY)};
+
+static int findTestRoute(uint32_t key)
+{
+    switch (key)
+    {
+        TEST_ROUTES(ROUTE_CASE)
+    default:
+        return -1;
+    }
+}
+
+// Прежний способ: каждый обработчик server.on по очереди сверяет метод и путь
+static const TestRoute *findLinear(uint8_t method, const char *path)
+{
+    for (const auto &route : testRoutes)
+    {
+        if ((route.method & method) && strcmp(route.path, path) == 0)
+        {
+            return &route;
+        }
+    }
+    return nullptr;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_every_route_found()
+{
+    for (int i = 0; i < TEST_ROUTE_COUNT; i++)
+    {
+        const TestRoute *route = findRoute(testRoutes, findTestRoute, testRoutes[i].method, testRoutes[i].path);
+        TEST_ASSERT_TRUE(route == &testRoutes[i]);
+    }
+}
+
+void test_same_path_different_methods()
+{
+    TEST_ASSERT_TRUE(findRoute(testRoutes, findTestRoute, HTTP_GET, "/availablegpio") == &testRoutes[ROUTE_INDEX_availableGpio]);
+    TEST_ASSERT_TRUE(findRoute(testRoutes, findTestRoute, HTTP_POST, "/availablegpio") == &testRoutes[ROUTE_INDEX_saveAvailableGpio]);
+    TEST_ASSERT_TRUE(findRoute(testRoutes, findTestRoute, HTTP_POST, "/client") == &testRoutes[ROUTE_INDEX_updateClient]);
+    TEST_ASSERT_TRUE(findRoute(testRoutes, findTestRoute, HTTP_DELETE, "/client") == &testRoutes[ROUTE_INDEX_deleteClient]);
+}
+
+void test_unknown_path_rejected()
+{
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_GET, "/"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_GET, "/index.html"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_GET, "/client"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_GET, "/clients/"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_GET, "/CLIENTS"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_GET, ""));
+}
+
+void test_method_mismatch_rejected()
+{
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_POST, "/clients"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_DELETE, "/scan"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_GET, "/reset_stats"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findTestRoute, HTTP_GET | HTTP_POST, "/availablegpio"));
+}
+
+// Совпадение ключа без совпадения строки: lookup, возвращающий индекс для любого ключа
+static int findAlways(uint32_t key)
+{
+    return ROUTE_INDEX_scan;
+}
+
+void test_key_collision_checked_by_path()
+{
+    TEST_ASSERT_TRUE(findRoute(testRoutes, findAlways, HTTP_GET, "/scan") == &testRoutes[ROUTE_INDEX_scan]);
+    TEST_ASSERT_NULL(findRoute(testRoutes, findAlways, HTTP_GET, "/scam"));
+    TEST_ASSERT_NULL(findRoute(testRoutes, findAlways, HTTP_POST, "/scan"));
+}
+
+void test_lookup_latency()
+{
+    // Запросы ко всем маршрутам и к статическим страницам, которые API не обслуживает
+    static const TestRoute requests[] = {
+        {HTTP_GET, "/clients"}, {HTTP_GET, "/heating_stats"}, {HTTP_GET, "/get_hysteresis_temp"},
+        {HTTP_POST, "/save_hysteresis_temp"}, {HTTP_DELETE, "/reset_work_time"}, {HTTP_GET, "/history.bin"},
+        {HTTP_GET, "/"}, {HTTP_GET, "/app.css"}, {HTTP_GET, "/heating_stats.html"}, {HTTP_GET, "/index.html"}};
+    const size_t requestCount = sizeof(requests) / sizeof(requests[0]);
+    volatile uintptr_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < LOOKUP_ROUNDS; round++)
+    {
+        const TestRoute &request = requests[round % requestCount];
+        sink = sink + (uintptr_t)findLinear(request.method, request.path);
+    }
+    auto linearAt = std::chrono::steady_clock::now();
+    for (int round = 0; round < LOOKUP_ROUNDS; round++)
+    {
+        const TestRoute &request = requests[round % requestCount];
+        sink = sink + (uintptr_t)findRoute(testRoutes, findTestRoute, request.method, request.path);
+    }
+    auto tableAt = std::chrono::steady_clock::now();
+
+    // Оба способа находят одно и то же
+    for (size_t i = 0; i < requestCount; i++)
+    {
+        TEST_ASSERT_TRUE(findLinear(requests[i].method, requests[i].path) ==
+                         findRoute(testRoutes, findTestRoute, requests[i].method, requests[i].path));
+    }
+
+    double linearNs = std::chrono::duration<double, std::nano>(linearAt - start).count() / LOOKUP_ROUNDS;
+    double tableNs = std::chrono::duration<double, std::nano>(tableAt - linearAt).count() / LOOKUP_ROUNDS;
+    char message[128];
+    snprintf(message, sizeof(message), "%d routes: linear strcmp %.1f ns/request, key switch %.1f ns/request",
+             TEST_ROUTE_COUNT, linearNs, tableNs);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_every_route_found);
+    RUN_TEST(test_same_path_different_methods);
+    RUN_TEST(test_unknown_path_rejected);
+    RUN_TEST(test_method_mismatch_rejected);
+    RUN_TEST(test_key_collision_checked_by_path);
+    RUN_TEST(test_lookup_latency);
+    return UNITY_END();
+}
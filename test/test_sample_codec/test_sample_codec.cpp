@@ -0,0 +1,215 @@
+// Сжатие рядов показаний: обратимость, крайние значения, поврежденные потоки, степень сжатия и скорость
+#include <unity.h>
+#include <sample_codec.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#define SERIES_LENGTH 20000
+
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return randomState >> 8;
+}
+
+// Кодирование с выдачей байт порциями chunk (как при потоковой отдаче HTTP)
+static std::vector<uint8_t> encodeAll(const std::vector<CodecSample> &samples, size_t chunk = 7)
+{
+    std::vector<uint8_t> out;
+    SampleEncoder encoder;
+    uint8_t buffer[SAMPLE_CODEC_BUFFER];
+    for (const auto &sample : samples)
+    {
+        while (!encoder.append(sample))
+        {
+            size_t n = encoder.read(buffer, chunk);
+            out.insert(out.end(), buffer, buffer + n);
+        }
+    }
+    while (!encoder.finish())
+    {
+        size_t n = encoder.read(buffer, chunk);
+        out.insert(out.end(), buffer, buffer + n);
+    }
+    while (encoder.available() > 0)
+    {
+        size_t n = encoder.read(buffer, chunk);
+        out.insert(out.end(), buffer, buffer + n);
+    }
+    return out;
+}
+
+static void assertRoundTrip(const std::vector<CodecSample> &samples, const std::vector<uint8_t> &encoded)
+{
+    SampleDecoder decoder(encoded.data(), encoded.size());
+    CodecSample sample;
+    size_t count = 0;
+    while (decoder.next(sample))
+    {
+        TEST_ASSERT_TRUE(count < samples.size());
+        TEST_ASSERT_EQUAL_UINT32(samples[count].time, sample.time);
+        TEST_ASSERT_EQUAL_INT16(samples[count].temperature, sample.temperature);
+        TEST_ASSERT_EQUAL_INT16(samples[count].humidity, sample.humidity);
+        TEST_ASSERT_EQUAL_UINT16(samples[count].batteryV, sample.batteryV);
+        count++;
+    }
+    TEST_ASSERT_FALSE(decoder.error());
+    TEST_ASSERT_EQUAL(samples.size(), count);
+    TEST_ASSERT_EQUAL(encoded.size(), decoder.bytesRead());
+}
+
+// Ряд как у датчика: отсчет раз в минуту с редким дрожанием, медленный дрейф показаний
+static std::vector<CodecSample> sensorSeries(size_t count)
+{
+    std::vector<CodecSample> samples;
+    uint32_t time = 1000;
+    double temperature = 21.0;
+    double humidity = 45.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        time += nextRandom() % 10 == 0 ? 60 + nextRandom() % 5 : 60;
+        temperature += ((int)(nextRandom() % 5) - 2) * 0.01;
+        humidity += ((int)(nextRandom() % 7) - 3) * 0.02;
+        samples.push_back({time, (int16_t)lround(temperature * 100), (int16_t)lround(humidity * 100),
+                           (uint16_t)(3000 - i / 1000)});
+    }
+    return samples;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_empty_stream()
+{
+    std::vector<CodecSample> samples;
+    std::vector<uint8_t> encoded = encodeAll(samples);
+    TEST_ASSERT_EQUAL(0, encoded.size());
+    assertRoundTrip(samples, encoded);
+}
+
+void test_single_sample()
+{
+    std::vector<CodecSample> samples = {{123456, -1234, 5678, 2999}};
+    std::vector<uint8_t> encoded = encodeAll(samples);
+    // 80 бит заголовка + 36 бит маркера конца, дополнение до байта
+    TEST_ASSERT_EQUAL(15, encoded.size());
+    assertRoundTrip(samples, encoded);
+}
+
+void test_extreme_values_and_time_jumps()
+{
+    std::vector<CodecSample> samples = {
+        {0, INT16_MIN, INT16_MAX, 0},
+        {60, INT16_MAX, INT16_MIN, 65535},      // Наибольшие разности значений
+        {120, 0, 0, 0},
+        {120, 0, 0, 0},                         // Повтор времени
+        {100, 1, -1, 1},                        // Время назад
+        {100 + 2048, 1, -1, 1},                 // Границы диапазонов delta-of-delta
+        {100 + 2048 + 2048 + 2048, 1, -1, 1},
+        {2000000000u, -500, 10000, 3000},       // Скачок почти на 2^31 с (предел delta-of-delta)
+        {2000000060u, -499, 10001, 3001},
+        {2000000120u, -499, 10001, 3001},
+    };
+    assertRoundTrip(samples, encodeAll(samples));
+}
+
+void test_delta_ranges()
+{
+    // Каждая ширина префикса значения и времени на своих границах
+    static const int32_t deltas[] = {0, 1, -1, 7, -8, 8, -9, 63, -64, 64, -65, 511, -512, 512, -513, 30000, -30000};
+    static const int32_t dods[] = {0, 64, -63, 65, -64, 256, -255, 257, -256, 2048, -2047, 2049, -2048, 100000};
+    std::vector<CodecSample> samples;
+    CodecSample sample = {100000, 0, 0, 1000};
+    int64_t delta = 60;
+    samples.push_back(sample);
+    const size_t deltaCount = sizeof(deltas) / sizeof(deltas[0]);
+    const size_t dodCount = sizeof(dods) / sizeof(dods[0]);
+    for (size_t i = 0; i < std::max(deltaCount, dodCount); i++)
+    {
+        int32_t valueDelta = deltas[i % deltaCount];
+        delta += dods[i % dodCount];
+        sample.time = (uint32_t)(sample.time + delta);
+        sample.temperature = (int16_t)(sample.temperature + valueDelta);
+        sample.humidity = (int16_t)(sample.humidity - valueDelta);
+        sample.batteryV = (uint16_t)(sample.batteryV + valueDelta);
+        samples.push_back(sample);
+    }
+    assertRoundTrip(samples, encodeAll(samples));
+}
+
+void test_chunk_size_does_not_change_stream()
+{
+    std::vector<CodecSample> samples = sensorSeries(500);
+    std::vector<uint8_t> byByte = encodeAll(samples, 1);
+    std::vector<uint8_t> whole = encodeAll(samples, SAMPLE_CODEC_BUFFER);
+    TEST_ASSERT_EQUAL(whole.size(), byByte.size());
+    TEST_ASSERT_EQUAL_MEMORY(whole.data(), byByte.data(), whole.size());
+}
+
+void test_truncated_stream_reports_error()
+{
+    std::vector<CodecSample> samples = sensorSeries(100);
+    std::vector<uint8_t> encoded = encodeAll(samples);
+    encoded.resize(encoded.size() / 2);
+
+    SampleDecoder decoder(encoded.data(), encoded.size());
+    CodecSample sample;
+    size_t count = 0;
+    while (decoder.next(sample))
+    {
+        TEST_ASSERT_EQUAL_UINT32(samples[count].time, sample.time);
+        count++;
+    }
+    TEST_ASSERT_TRUE(decoder.error());
+    TEST_ASSERT_TRUE(count < samples.size());
+    // Заголовок первого отсчета тоже обрезан
+    SampleDecoder header(encoded.data(), 5);
+    TEST_ASSERT_FALSE(header.next(sample));
+    TEST_ASSERT_TRUE(header.error());
+}
+
+// Степень сжатия и скорость на ряде, похожем на реальный
+void test_series_compression()
+{
+    std::vector<CodecSample> samples = sensorSeries(SERIES_LENGTH);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> encoded = encodeAll(samples);
+    auto encodedAt = std::chrono::steady_clock::now();
+    assertRoundTrip(samples, encoded);
+    auto decodedAt = std::chrono::steady_clock::now();
+
+    double bitsPerSample = encoded.size() * 8.0 / samples.size();
+    double encodeNs = std::chrono::duration<double, std::nano>(encodedAt - start).count() / samples.size();
+    double decodeNs = std::chrono::duration<double, std::nano>(decodedAt - encodedAt).count() / samples.size();
+    char message[160];
+    snprintf(message, sizeof(message), "%d samples: %u bytes, %.2f bits/sample (raw 80), encode+read %.1f ns/sample, decode+check %.1f ns/sample",
+             SERIES_LENGTH, (unsigned)encoded.size(), bitsPerSample, encodeNs, decodeNs);
+    TEST_MESSAGE(message);
+
+    // Без сжатия отсчет занимает 80 бит; ряд с изменением почти каждого показания сжимается больше чем вчетверо
+    TEST_ASSERT_LESS_THAN(20.0, bitsPerSample);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_stream);
+    RUN_TEST(test_single_sample);
+    RUN_TEST(test_extreme_values_and_time_jumps);
+    RUN_TEST(test_delta_ranges);
+    RUN_TEST(test_chunk_size_does_not_change_stream);
+    RUN_TEST(test_truncated_stream_reports_error);
+    RUN_TEST(test_series_compression);
+    return UNITY_END();
+}